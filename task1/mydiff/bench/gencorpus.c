@@ -0,0 +1,232 @@
+/**
+ * @file gencorpus.c
+ * @author Georg Hubinger (9947673) <georg.hubinger@tuwien.ac.at>
+ * @brief Generate a pair of text files for benchmarking mydiff
+ * @details The first file consists of random lines whose lengths follow the given distribution:
+ * fixed:N, uniform:MIN:MAX or exp:MEAN (geometric, with a long tail of long lines).
+ * The second file is a copy of the first one, where every line is changed with probability -m
+ * (-c of its chars replaced) and a new random line is inserted in front of a line with probability -i.
+ * The same seed always gives the same files.
+ * @date 16.10.2013
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/** Bailout with formatted error message */
+#define exit_error(fmt, ...) \
+	do {\
+		(void) fprintf(stderr, fmt, __VA_ARGS__);\
+		exit(EXIT_FAILURE); \
+	} while(0);
+
+/** Size of the pool of random text lines are cut from */
+#define POOL_SIZE (1 << 20)
+
+/** Longest line that gets generated, longer ones are cut */
+#define MAX_LINE (POOL_SIZE / 2)
+
+/**
+* @brief distribution of the line lengths
+*/
+struct dist {
+
+	enum { dist_fixed, dist_uniform, dist_exp } kind; /**< kind of distribution */
+	double a; /**< length (fixed), minimum (uniform) or mean (exp) */
+	double b; /**< maximum (uniform) */
+
+};
+
+/** True global for storing the programm's path */
+char *pname = NULL;
+
+/** Random text the lines are cut from */
+static char pool[POOL_SIZE];
+
+/** State of the random number generator */
+static uint64_t state = 88172645463325252ull;
+
+/** Print out usage message */
+static void usage(void);
+
+/** xorshift64, good enough and the same on every platform */
+static uint64_t rnd(void)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+/** uniformly distributed in [0, 1) */
+static double rnd_unit(void)
+{
+	return (double) (rnd() >> 11) / 9007199254740992.0;
+}
+
+static size_t line_length(const struct dist *d)
+{
+	double len;
+
+	switch(d->kind) {
+		case dist_fixed:
+			len = d->a;
+		break;
+		case dist_uniform:
+			len = d->a + (double) (rnd() % (uint64_t) (d->b - d->a + 1));
+		break;
+		default:
+			/* geometric: count failures until the first success with p = 1 / (mean + 1) */
+			len = 0;
+			while(len < MAX_LINE && rnd_unit() >= 1.0 / (d->a + 1.0)) {
+				len++;
+			}
+		break;
+	}
+
+	return len > MAX_LINE ? MAX_LINE : (size_t) len;
+}
+
+/* random printable line of len chars, cut out of the pool */
+static const char *random_line(size_t len)
+{
+	return pool + rnd() % (POOL_SIZE - len);
+}
+
+static void write_line(FILE *f, const char *p, size_t len)
+{
+	if(fwrite(p, 1, len, f) != len || putc('\n', f) == EOF) {
+		exit_error("%s: Fehler beim Schreiben!\n", pname);
+	}
+}
+
+/* parse a size with an optional K, M or G suffix */
+static size_t parse_size(const char *s)
+{
+	char *end;
+	double v = strtod(s, &end);
+
+	switch(*end) {
+		case 'K': v *= 1024.0; end++; break;
+		case 'M': v *= 1024.0 * 1024.0; end++; break;
+		case 'G': v *= 1024.0 * 1024.0 * 1024.0; end++; break;
+		default: break;
+	}
+
+	if(end == s || *end != '\0' || v < 0) {
+		exit_error("%s: Ungültige Größe '%s'!\n", pname, s);
+	}
+
+	return (size_t) v;
+}
+
+static double parse_rate(const char *s)
+{
+	char *end;
+	double v = strtod(s, &end);
+
+	if(end == s || *end != '\0' || v < 0 || v > 1) {
+		exit_error("%s: Ungültige Rate '%s' (0 - 1)!\n", pname, s);
+	}
+
+	return v;
+}
+
+static void parse_dist(struct dist *d, const char *s)
+{
+	int ok;
+
+	if(strncmp(s, "fixed:", 6) == 0) {
+		d->kind = dist_fixed;
+		ok = sscanf(s + 6, "%lf", &d->a) == 1;
+	} else if(strncmp(s, "uniform:", 8) == 0) {
+		d->kind = dist_uniform;
+		ok = sscanf(s + 8, "%lf:%lf", &d->a, &d->b) == 2 && d->a <= d->b;
+	} else if(strncmp(s, "exp:", 4) == 0) {
+		d->kind = dist_exp;
+		ok = sscanf(s + 4, "%lf", &d->a) == 1;
+	} else {
+		ok = 0;
+	}
+
+	if(!ok || d->a < 0) {
+		exit_error("%s: Ungültige Verteilung '%s' (fixed:N, uniform:MIN:MAX, exp:MEAN)!\n", pname, s);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct dist dist = { dist_exp, 80, 0 };
+	double mismatch = 0.01, chars = 0.1, insert = 0.0;
+	size_t size = 64 << 20, written = 0, i;
+	static char changed[MAX_LINE];
+	FILE *fa, *fb;
+	int c;
+
+	if(argc) pname = argv[0];
+
+	while((c = getopt(argc, argv, "s:l:m:c:i:S:")) != -1) {
+		switch(c) {
+			case 's': size = parse_size(optarg); break;
+			case 'l': parse_dist(&dist, optarg); break;
+			case 'm': mismatch = parse_rate(optarg); break;
+			case 'c': chars = parse_rate(optarg); break;
+			case 'i': insert = parse_rate(optarg); break;
+			case 'S': state = strtoull(optarg, NULL, 10) | 1; break;
+			default: usage(); break;
+		}
+	}
+
+	if(argc - optind != 2) {
+		usage();
+	}
+
+	for(i = 0; i < POOL_SIZE; i++) {
+		pool[i] = "abcdefghijklmnopqrstuvwxyz      0123456789"[rnd() % 42];
+	}
+
+	if((fa = fopen(argv[optind], "w")) == NULL || (fb = fopen(argv[optind + 1], "w")) == NULL) {
+		exit_error("%s: Ausgabedateien konnten nicht angelegt werden!\n", pname);
+	}
+
+	while(written < size) {
+
+		size_t len = line_length(&dist);
+		const char *line = random_line(len);
+
+		write_line(fa, line, len);
+		written += len + 1;
+
+		if(rnd_unit() < insert) {
+			size_t extra = line_length(&dist);
+			write_line(fb, random_line(extra), extra);
+		}
+
+		if(len && rnd_unit() < mismatch) {
+
+			size_t k, n = (size_t) (chars * (double) len) + 1;
+
+			memcpy(changed, line, len);
+			for(k = 0; k < n; k++) {
+				changed[rnd() % len] = 'A' + (char) (rnd() % 26);
+			}
+			line = changed;
+		}
+
+		write_line(fb, line, len);
+	}
+
+	if(fclose(fa) != 0 || fclose(fb) != 0) {
+		exit_error("%s: Fehler beim Schreiben!\n", pname);
+	}
+
+	return 0;
+}
+
+static void usage(void)
+{
+	exit_error("Usage: %s [-s SIZE[K|M|G]] [-l fixed:N|uniform:MIN:MAX|exp:MEAN] [-m LINE_RATE] [-c CHAR_RATE] [-i INSERT_RATE] [-S SEED] FILE1 FILE2\n", pname);
+}
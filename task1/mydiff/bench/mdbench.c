@@ -0,0 +1,415 @@
+/**
+ * @file mdbench.c
+ * @author Georg Hubinger (9947673) <georg.hubinger@tuwien.ac.at>
+ * @brief Measure mydiff's throughput
+ * @details Runs mydiff on a pair of files once per engine (a set of options, a forced kernel or a pipe as input) and repetition.
+ * The "stdio" engine is the original fgets loop of mydiff, built into the bench, as the reference the others are measured against.
+ * Prints one tab separated line per engine: name, bytes of both files, lines of the first file, best wall clock time,
+ * GB/s and lines/s derived from it, and the peak resident set size over all repetitions.
+ * mydiff's output goes to /dev/null, so only the comparison is measured.
+ * With -c both files are dropped from the page cache before every run, so the disk is measured as well.
+ * @date 16.10.2013
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/** Bailout with formatted error message */
+#define exit_error(fmt, ...) \
+	do {\
+		(void) fprintf(stderr, fmt, __VA_ARGS__);\
+		exit(EXIT_FAILURE); \
+	} while(0);
+
+/**
+* @brief a way of running mydiff
+*/
+struct engine {
+
+	const char *name; /**< name as printed and as used with -e */
+	const char *kernel; /**< value of MYDIFF_KERNEL, NULL to let mydiff choose */
+	const char *opt; /**< option to pass, NULL if none */
+	int jobs; /**< nonzero to pass -j N */
+	int use_pipe; /**< nonzero to pass the first file through a pipe on stdin ("-") */
+	int stdio; /**< nonzero to run the original stdio engine (see compare_stdio) instead of mydiff */
+
+};
+
+/** all engines, in the order they are run */
+static const struct engine engines[] = {
+	{ "stdio", NULL, NULL, 0, 0, 1 },
+	{ "plain", NULL, NULL, 0, 0, 0 },
+	{ "plain-scalar", "scalar", NULL, 0, 0, 0 },
+	{ "plain-sse2", "sse2", NULL, 0, 0, 0 },
+	{ "plain-avx2", "avx2", NULL, 0, 0, 0 },
+	{ "plain-avx512", "avx512", NULL, 0, 0, 0 },
+	{ "ignore-case", NULL, "-i", 0, 0, 0 },
+	{ "ignore-space", NULL, "-w", 0, 0, 0 },
+	{ "pipe", NULL, NULL, 0, 1, 0 },
+	{ "uring", NULL, "-u", 0, 0, 0 },
+	{ "parallel", NULL, NULL, 1, 0, 0 },
+	{ "hash", NULL, "-H", 0, 0, 0 },
+	{ "hash-only", NULL, "--hash-only", 0, 0, 0 },
+	{ "distance", NULL, "-e", 0, 0, 0 },
+	{ "aligned", NULL, "-a", 0, 0, 0 },
+	{ "binary", NULL, "-b", 0, 0, 0 },
+};
+
+#define NENGINES (sizeof(engines) / sizeof(engines[0]))
+
+/** True global for storing the programm's path */
+char *pname = NULL;
+
+/** Print out usage message */
+static void usage(void);
+
+/** wall clock in seconds */
+static double now(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/* size of a file and number of '\n' in it */
+static void measure_file(const char *path, unsigned long long *bytes, unsigned long long *lines)
+{
+	static char buf[1 << 16];
+	size_t got, i;
+	FILE *f;
+
+	if((f = fopen(path, "r")) == NULL) {
+		exit_error("%s: Datei '%s' konnte nicht geöffnet werden (%s)!\n", pname, path, strerror(errno));
+	}
+
+	while((got = fread(buf, 1, sizeof(buf), f)) > 0) {
+		*bytes += got;
+		for(i = 0; i < got; i++) {
+			*lines += buf[i] == '\n';
+		}
+	}
+
+	(void) fclose(f);
+}
+
+/** Maximum line length the original engine compares at once, longer lines are compared piecewise */
+#define STDIO_MAX_LEN 20
+
+/** Does given char signal EOL. NULL char means either end of last line in file or line size exceeded buffer size */
+#define STOP_COMPARE_CHAR(c) ((c) == 0 || (c) == '\n')
+
+/* the original mydiff: fgets both files in steps of STDIO_MAX_LEN - 1 chars, print the mismatches of every step to stdout */
+static int compare_stdio(const char *path1, const char *path2)
+{
+	char buf1[STDIO_MAX_LEN], buf2[STDIO_MAX_LEN];
+	int line = 1;
+	FILE *f1, *f2;
+
+	if((f1 = fopen(path1, "r")) == NULL || (f2 = fopen(path2, "r")) == NULL) {
+		return 1;
+	}
+
+	while(fgets(buf1, STDIO_MAX_LEN, f1) != NULL) {
+
+		int n = 0;
+
+		if(fgets(buf2, STDIO_MAX_LEN, f2) == NULL) {
+			break;
+		}
+
+		for(char *c1 = buf1, *c2 = buf2; !(STOP_COMPARE_CHAR(*c1) || STOP_COMPARE_CHAR(*c2)); c1++, c2++) {
+
+			if(*c1 != *c2) {
+				n++;
+			}
+
+		}
+
+		if(n) {
+			fprintf(stdout, "Zeile: %d Zeichen: %d\n", line, n);
+		}
+
+		line++;
+	}
+
+	(void) fclose(f1);
+	(void) fclose(f2);
+
+	return fflush(stdout) == 0 ? 0 : 1;
+}
+
+/* ask mydiff's self test which kernels the cpu supports */
+static int kernel_supported(const char *mydiff, const char *kernel)
+{
+	static char report[4096];
+	static int have_report = 0;
+	char line[128];
+
+	if(!have_report) {
+
+		char cmd[4096];
+		FILE *p;
+		size_t len = 0;
+
+		(void) snprintf(cmd, sizeof(cmd), "'%s' -t", mydiff);
+
+		if((p = popen(cmd, "r")) != NULL) {
+			len = fread(report, 1, sizeof(report) - 1, p);
+			(void) pclose(p);
+		}
+
+		report[len] = '\0';
+		have_report = 1;
+	}
+
+	(void) snprintf(line, sizeof(line), "kernel %s: ok", kernel);
+	return strstr(report, line) != NULL;
+}
+
+/* drop a file's pages from the page cache, the next run has to read it from disk. Dirty pages are written first */
+static void drop_cache(const char *path)
+{
+	int fd, err;
+
+	if((fd = open(path, O_RDONLY)) == -1) {
+		exit_error("%s: Datei '%s' konnte nicht geöffnet werden (%s)!\n", pname, path, strerror(errno));
+	}
+
+	(void) fdatasync(fd);
+
+	if((err = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED)) != 0) {
+		exit_error("%s: Datei '%s' konnte nicht aus dem Cache entfernt werden (%s)!\n", pname, path, strerror(err));
+	}
+
+	(void) close(fd);
+}
+
+/* copy a file into a pipe, from a child process of its own, so mydiff has to read a real stream */
+static pid_t feed(const char *path, int *fd)
+{
+	static char buf[1 << 20];
+	int fds[2], in;
+	ssize_t got;
+	pid_t pid;
+
+	if(pipe(fds) == -1 || (pid = fork()) == -1) {
+		exit_error("%s: Pipe konnte nicht angelegt werden (%s)!\n", pname, strerror(errno));
+	}
+
+	if(pid == 0) {
+
+		(void) close(fds[0]);
+
+		if((in = open(path, O_RDONLY)) == -1) {
+			_exit(127);
+		}
+
+		while((got = read(in, buf, sizeof(buf))) > 0) {
+
+			char *p = buf;
+
+			while(got > 0) {
+
+				ssize_t put = write(fds[1], p, (size_t) got);
+
+				if(put == -1) {
+					_exit(errno == EPIPE ? 0 : 127);
+				}
+
+				p += put;
+				got -= put;
+			}
+		}
+
+		_exit(got == 0 ? 0 : 127);
+	}
+
+	(void) close(fds[1]);
+	*fd = fds[0];
+
+	return pid;
+}
+
+/* run mydiff (or the stdio engine in a child of our own) once, return the wall clock time and the peak rss in KiB. -1 if it failed */
+static double run(const char *mydiff, const struct engine *e, unsigned int jobs, const char *f1, const char *f2, long *rss)
+{
+	char jarg[16];
+	const char *args[8];
+	struct rusage ru;
+	double start, elapsed;
+	pid_t pid, feeder = -1;
+	int n = 0, status, in = STDIN_FILENO;
+
+	args[n++] = mydiff;
+	if(e->opt != NULL) {
+		args[n++] = e->opt;
+	}
+	if(e->jobs) {
+		(void) snprintf(jarg, sizeof(jarg), "%u", jobs);
+		args[n++] = "-j";
+		args[n++] = jarg;
+	}
+	args[n++] = e->use_pipe ? "-" : f1;
+	args[n++] = f2;
+	args[n] = NULL;
+
+	start = now();
+
+	if(e->use_pipe) {
+		feeder = feed(f1, &in);
+	}
+
+	switch(pid = fork()) {
+		case -1:
+			exit_error("%s: fork fehlgeschlagen (%s)!\n", pname, strerror(errno));
+		break;
+		case 0: {
+			int null = open("/dev/null", O_WRONLY);
+
+			if(null == -1 || dup2(null, STDOUT_FILENO) == -1 || dup2(in, STDIN_FILENO) == -1) {
+				_exit(127);
+			}
+			if(e->kernel != NULL && setenv("MYDIFF_KERNEL", e->kernel, 1) == -1) {
+				_exit(127);
+			}
+			if(e->stdio) {
+				_exit(compare_stdio(f1, f2));
+			}
+
+			(void) execv(mydiff, (char * const *) args);
+			_exit(127);
+		}
+		default:
+		break;
+	}
+
+	while(wait4(pid, &status, 0, &ru) == -1) {
+		if(errno != EINTR) {
+			exit_error("%s: wait4 fehlgeschlagen (%s)!\n", pname, strerror(errno));
+		}
+	}
+
+	elapsed = now() - start;
+
+	/* mydiff may stop reading early, the feeder gets EPIPE then */
+	if(feeder != -1) {
+		(void) close(in);
+		(void) waitpid(feeder, NULL, 0);
+	}
+
+	if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		return -1;
+	}
+
+	*rss = ru.ru_maxrss;
+	return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long bytes = 0, lines = 0, dummy = 0;
+	unsigned int runs = 3, jobs = 4, r;
+	const char *select = NULL;
+	size_t i;
+	int c, cold = 0;
+
+	if(argc) pname = argv[0];
+
+	while((c = getopt(argc, argv, "r:j:e:c")) != -1) {
+		switch(c) {
+			case 'r': runs = (unsigned int) strtoul(optarg, NULL, 10); break;
+			case 'j': jobs = (unsigned int) strtoul(optarg, NULL, 10); break;
+			case 'e': select = optarg; break;
+			case 'c': cold = 1; break;
+			default: usage(); break;
+		}
+	}
+
+	if(argc - optind != 3 || runs == 0 || jobs == 0) {
+		usage();
+	}
+
+	measure_file(argv[optind + 1], &bytes, &lines);
+	measure_file(argv[optind + 2], &bytes, &dummy);
+
+	(void) printf("engine\tbytes\tlines\tseconds\tgb_per_s\tlines_per_s\tmax_rss_kib\n");
+	/* the stdio engine runs in a fork of us, it must not inherit the buffer */
+	(void) fflush(stdout);
+
+	for(i = 0; i < NENGINES; i++) {
+
+		const struct engine *e = &engines[i];
+		double best = -1;
+		long rss = 0;
+
+		/* -e takes a comma separated list of engine names */
+		if(select != NULL) {
+
+			const char *p = strstr(select, e->name);
+			size_t len = strlen(e->name);
+
+			while(p != NULL && !((p == select || p[-1] == ',') && (p[len] == ',' || p[len] == '\0'))) {
+				p = strstr(p + 1, e->name);
+			}
+			if(p == NULL) {
+				continue;
+			}
+		}
+
+		if(e->kernel != NULL && !kernel_supported(argv[optind], e->kernel)) {
+			(void) fprintf(stderr, "%s: %s übersprungen, vom Prozessor nicht unterstützt\n", pname, e->name);
+			continue;
+		}
+
+		for(r = 0; r < runs; r++) {
+
+			long peak = 0;
+			double t;
+
+			if(cold) {
+				drop_cache(argv[optind + 1]);
+				drop_cache(argv[optind + 2]);
+			}
+
+			t = run(argv[optind], e, jobs, argv[optind + 1], argv[optind + 2], &peak);
+
+			if(t < 0) {
+				best = -1;
+				break;
+			}
+			if(best < 0 || t < best) {
+				best = t;
+			}
+			if(peak > rss) {
+				rss = peak;
+			}
+		}
+
+		if(best < 0) {
+			(void) fprintf(stderr, "%s: %s fehlgeschlagen\n", pname, e->name);
+			continue;
+		}
+
+		(void) printf("%s\t%llu\t%llu\t%.6f\t%.3f\t%.0f\t%ld\n", e->name, bytes, lines, best,
+				(double) bytes / best / 1e9, (double) lines / best, rss);
+		(void) fflush(stdout);
+	}
+
+	return 0;
+}
+
+static void usage(void)
+{
+	exit_error("Usage: %s [-c] [-r RUNS] [-j N] [-e ENGINE,...] MYDIFF FILE1 FILE2\n", pname);
+}
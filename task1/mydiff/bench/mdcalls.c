@@ -0,0 +1,192 @@
+/**
+ * @file mdcalls.c
+ * @author Georg Hubinger (9947673) <georg.hubinger@tuwien.ac.at>
+ * @brief Measure the cost of a comparison call: spawning mydiff against libmydiff's streaming comparator
+ * @details Compares a pair of files N times, once by running mydiff (fork, exec, open, map) and once in process
+ * with a single comparator, that is fed both files in pieces of a fixed size and reset after each comparison.
+ * Prints one tab separated line per way: name, calls, seconds, calls/s and the mismatching lines of the last call.
+ * @date 16.10.2013
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "libmydiff.h"
+
+/** Bailout with formatted error message */
+#define exit_error(fmt, ...) \
+	do {\
+		(void) fprintf(stderr, fmt, __VA_ARGS__);\
+		exit(EXIT_FAILURE); \
+	} while(0);
+
+/** True global for storing the programm's path */
+char *pname = NULL;
+
+/** Print out usage message */
+static void usage(void);
+
+/** wall clock in seconds */
+static double now(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/* read a whole file into memory, like a service would have it at hand */
+static char *slurp(const char *path, size_t *len)
+{
+	char *buf = NULL;
+	size_t cap = 0, got;
+	FILE *f;
+
+	if((f = fopen(path, "r")) == NULL) {
+		exit_error("%s: Datei '%s' konnte nicht geöffnet werden (%s)!\n", pname, path, strerror(errno));
+	}
+
+	*len = 0;
+
+	do {
+		if(*len == cap) {
+
+			cap = cap ? 2 * cap : 1 << 16;
+
+			if((buf = realloc(buf, cap)) == NULL) {
+				exit_error("%s: Nicht genug Speicher für '%s'!\n", pname, path);
+			}
+		}
+
+		got = fread(buf + *len, 1, cap - *len, f);
+		*len += got;
+	} while(got > 0);
+
+	(void) fclose(f);
+	return buf;
+}
+
+/* run mydiff once with its output on /dev/null, exit on failure */
+static void spawn(const char *mydiff, const char *f1, const char *f2)
+{
+	int status;
+	pid_t pid;
+
+	switch(pid = fork()) {
+		case -1:
+			exit_error("%s: fork fehlgeschlagen (%s)!\n", pname, strerror(errno));
+		break;
+		case 0: {
+			int null = open("/dev/null", O_WRONLY);
+
+			if(null == -1 || dup2(null, STDOUT_FILENO) == -1) {
+				_exit(127);
+			}
+
+			(void) execl(mydiff, mydiff, f1, f2, (char *) NULL);
+			_exit(127);
+		}
+		default:
+		break;
+	}
+
+	while(waitpid(pid, &status, 0) == -1) {
+		if(errno != EINTR) {
+			exit_error("%s: waitpid fehlgeschlagen (%s)!\n", pname, strerror(errno));
+		}
+	}
+
+	if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		exit_error("%s: '%s' fehlgeschlagen\n", pname, mydiff);
+	}
+}
+
+/* count the records of a call */
+static void count_record(void *arg, const struct mydiff_record *rec)
+{
+	(void) rec;
+	(*(unsigned long *) arg)++;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long calls = 1000, i, records = 0;
+	size_t piece = 4096, la, lb;
+	struct mydiff *d;
+	char *a, *b;
+	double start, elapsed;
+	int c;
+
+	if(argc) pname = argv[0];
+
+	while((c = getopt(argc, argv, "n:p:")) != -1) {
+		switch(c) {
+			case 'n': calls = strtoul(optarg, NULL, 10); break;
+			case 'p': piece = (size_t) strtoul(optarg, NULL, 10); break;
+			default: usage(); break;
+		}
+	}
+
+	if(argc - optind != 3 || calls == 0 || piece == 0) {
+		usage();
+	}
+
+	a = slurp(argv[optind + 1], &la);
+	b = slurp(argv[optind + 2], &lb);
+
+	(void) printf("way\tcalls\tseconds\tcalls_per_s\trecords\n");
+
+	start = now();
+	for(i = 0; i < calls; i++) {
+		spawn(argv[optind], argv[optind + 1], argv[optind + 2]);
+	}
+	elapsed = now() - start;
+
+	(void) printf("spawn\t%lu\t%.6f\t%.0f\t-\n", calls, elapsed, (double) calls / elapsed);
+	(void) fflush(stdout);
+
+	if((d = mydiff_new(0, 0, count_record, &records)) == NULL) {
+		exit_error("%s: Nicht genug Speicher für den Comparator!\n", pname);
+	}
+
+	start = now();
+	for(i = 0; i < calls; i++) {
+
+		size_t fa, fb;
+
+		records = 0;
+
+		for(fa = fb = 0; fa < la || fb < lb; fa += piece, fb += piece) {
+
+			size_t na = fa < la ? (la - fa < piece ? la - fa : piece) : 0;
+			size_t nb = fb < lb ? (lb - fb < piece ? lb - fb : piece) : 0;
+
+			if(mydiff_feed(d, a + fa, na, b + fb, nb) == -1) {
+				exit_error("%s: Nicht genug Speicher für den Comparator!\n", pname);
+			}
+		}
+
+		mydiff_finish(d);
+		mydiff_reset(d);
+	}
+	elapsed = now() - start;
+
+	(void) printf("library\t%lu\t%.6f\t%.0f\t%lu\n", calls, elapsed, (double) calls / elapsed, records);
+
+	mydiff_free(d);
+	free(a);
+	free(b);
+
+	return 0;
+}
+
+static void usage(void)
+{
+	exit_error("Usage: %s [-n CALLS] [-p PIECE] MYDIFF FILE1 FILE2\n", pname);
+}
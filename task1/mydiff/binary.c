@@ -0,0 +1,162 @@
+/**
+* @file binary.c
+* @brief compare two inputs as flat byte streams and report runs of differing bytes
+* @details The scan alternates between looking for the next differing byte and the next equal one (see scan_bytes in mismatch.h),
+* so long equal stretches are skipped at vector speed and every run of differing bytes costs a single output line.
+* The common part of the inputs is split into chunks that are scanned on a pool of threads. A run belongs to the chunk it starts in,
+* the chunk's task follows it beyond the chunk's end if necessary, the next task skips it.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "binary.h"
+#include "mismatch.h"
+#include "workpool.h"
+
+/* === Constants === */
+
+/** Chunks per thread, more chunks balance the load better if the differences are clustered */
+#define CHUNKS_PER_JOB 8
+
+/** Minimum size of a chunk, smaller ones aren't worth a task */
+#define MIN_CHUNK (1 << 20)
+
+/* === Structures === */
+
+/**
+* @brief output of a chunk
+*/
+struct chunk {
+
+	char *buf; /**< the chunk's output */
+	size_t len; /**< length of the output */
+	int failed; /**< nonzero if the output buffer could not be allocated */
+
+};
+
+/**
+* @brief state shared by all tasks of a binary comparison
+*/
+struct binary {
+
+	const char *a; /**< first input */
+	const char *b; /**< second input */
+	size_t common; /**< number of bytes both inputs have */
+	size_t total; /**< size of the longer input */
+	size_t size; /**< size of a chunk (the last one may be shorter) */
+	struct chunk *chunks; /**< output per chunk */
+
+};
+
+/* === Implementation === */
+
+/*
+* print the runs starting within [from, to). A run that reaches the end of the common part
+* goes on until the end of the longer input, its extra bytes differ anyway.
+*/
+static void scan(FILE *out, const struct binary *p, size_t from, size_t to)
+{
+	size_t i = from, start;
+
+	/* a run that started in front of from is printed by whoever scanned that part */
+	if(i > 0 && i < to && p->a[i - 1] != p->b[i - 1]) {
+		i += scan_bytes(p->a + i, p->b + i, p->common - i, 0);
+	}
+
+	while(i < to) {
+
+		i += scan_bytes(p->a + i, p->b + i, to - i, 1);
+
+		if(i == to) {
+			break;
+		}
+
+		start = i;
+		i += scan_bytes(p->a + i, p->b + i, p->common - i, 0);
+
+		(void) fprintf(out, "Offset: %lu Länge: %lu\n", (unsigned long) start, (unsigned long) ((i == p->common ? p->total : i) - start));
+	}
+}
+
+static void chunk_task(void *arg, size_t task)
+{
+	struct binary *p = arg;
+	struct chunk *c = &p->chunks[task];
+	size_t from = task * p->size, to = from + p->size < p->common ? from + p->size : p->common;
+	FILE *out;
+
+	if((out = open_memstream(&c->buf, &c->len)) == NULL) {
+		c->failed = 1;
+		return;
+	}
+
+	scan(out, p, from, to);
+
+	if(fclose(out) != 0) {
+		c->failed = 1;
+	}
+}
+
+int compare_binary(FILE *out, const struct input *a, const struct input *b, unsigned int jobs)
+{
+	struct binary p;
+	struct workpool wp;
+	size_t i, nchunks;
+	int ret = 0;
+
+	memset(&p, 0, sizeof(p));
+	p.a = a->data;
+	p.b = b->data;
+	p.common = a->size < b->size ? a->size : b->size;
+	p.total = a->size < b->size ? b->size : a->size;
+
+	nchunks = (size_t) jobs * CHUNKS_PER_JOB;
+	if(nchunks > p.common / MIN_CHUNK) {
+		nchunks = p.common / MIN_CHUNK;
+	}
+
+	if(nchunks <= 1) {
+
+		/* not worth any threads, print right away */
+		scan(out, &p, 0, p.common);
+
+	} else {
+
+		p.size = (p.common + nchunks - 1) / nchunks;
+
+		if((p.chunks = calloc(nchunks, sizeof(*p.chunks))) == NULL) {
+			return -1;
+		}
+
+		if(workpool_start(&wp, jobs, nchunks, chunk_task, &p) == -1) {
+			free(p.chunks);
+			return -1;
+		}
+
+		/* print the chunks in order. Once one failed, the output would have a gap, so just free the rest */
+		for(i = 0; i < nchunks; i++) {
+
+			workpool_wait(&wp, i);
+
+			if(p.chunks[i].failed) {
+				ret = -1;
+			}
+
+			if(ret == 0 && p.chunks[i].len) {
+				(void) fwrite(p.chunks[i].buf, 1, p.chunks[i].len, out);
+			}
+
+			free(p.chunks[i].buf);
+			p.chunks[i].buf = NULL;
+		}
+
+		workpool_join(&wp);
+		free(p.chunks);
+	}
+
+	/* the extra bytes of the longer input, unless the last run of the common part took them already */
+	if(ret == 0 && p.common < p.total && (p.common == 0 || p.a[p.common - 1] == p.b[p.common - 1])) {
+		(void) fprintf(out, "Offset: %lu Länge: %lu\n", (unsigned long) p.common, (unsigned long) (p.total - p.common));
+	}
+
+	return ret;
+}
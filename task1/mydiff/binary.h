@@ -0,0 +1,25 @@
+/**
+* @file binary.h
+* @brief header file for mydiff's binary comparison (inputs as flat byte streams, no lines)
+*/
+
+#ifndef BINARY_H
+#define BINARY_H
+#include <stdio.h> //needed for FILE
+#include "input.h"
+
+/**
+* @brief compare two inputs byte by byte and print "Offset: OFFSET Länge: LENGTH" for every run of differing bytes.
+* If one input is longer, its extra bytes count as differing. The inputs are split into chunks that are scanned on jobs threads,
+* the output is the same for any number of threads
+*
+* @param out stream to print the runs to
+* @param a first input (in memory, i.e. mapped or loaded)
+* @param b second input (in memory)
+* @param jobs number of threads to scan with
+*
+* @return 0 on success, -1 if memory or threads could not be allocated
+*/
+int compare_binary(FILE *out, const struct input *a, const struct input *b, unsigned int jobs);
+
+#endif
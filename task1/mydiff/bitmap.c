@@ -0,0 +1,723 @@
+/**
+* @file bitmap.c
+* @brief the set of mismatching lines as a compressed bitmap, Roaring style: the line numbers are split into containers of BITMAP_CHUNK lines
+* (by their high bits), every container is stored in whichever form is the smallest for its lines
+* @details A container is a sorted array of 16 bit line numbers, a list of runs (first line, length - 1) or a plain bitmap of 8 KiB.
+* The counts of its lines follow it, as varints in line order. A directory at the end of the file (found through the header)
+* holds key, form, offsets and rank (number of lines in front of it) of every container, so a query only touches the containers
+* overlapping its range. Everything is written in host byte order, like the sidecars.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "bitmap.h"
+
+/* === Constants === */
+
+/** First bytes of every bitmap file */
+#define BITMAP_MAGIC "MYDIFFBM"
+
+/** Layout version, files of other versions are rejected */
+#define BITMAP_VERSION 1
+
+/** 64 bit words of a bitmap container */
+#define WORDS (BITMAP_CHUNK / 64)
+
+/** Most bytes a varint of 64 bits takes */
+#define VARINT_MAX 10
+
+/** Containers start at multiples of this, so bitmap containers can be read word by word */
+#define ALIGN 8
+
+/**
+* @brief forms of a container
+*/
+enum kind {
+	kind_array = 1, /**< sorted array of the low 16 bits of the lines */
+	kind_runs, /**< pairs of 16 bits: first line of a run, length of the run - 1 */
+	kind_bitmap /**< WORDS words, one bit per line */
+};
+
+/* === Structures === */
+
+/**
+* @brief start of a bitmap file
+*/
+struct header {
+
+	char magic[8]; /**< BITMAP_MAGIC */
+	uint32_t version; /**< BITMAP_VERSION */
+	uint32_t chunk; /**< BITMAP_CHUNK */
+	uint64_t count; /**< number of lines */
+	uint64_t n; /**< number of containers */
+	uint64_t dir; /**< offset of the directory */
+
+};
+
+/**
+* @brief a container in the directory
+*/
+struct bitmap_entry {
+
+	uint64_t key; /**< line numbers of the container divided by BITMAP_CHUNK */
+	uint64_t data; /**< offset of the container */
+	uint64_t counts; /**< offset of its counts */
+	uint64_t rank; /**< number of lines in the containers in front of it */
+	uint32_t n; /**< number of lines in the container, 1 .. BITMAP_CHUNK */
+	uint32_t kind; /**< form of the container, see enum kind */
+	uint32_t runs; /**< number of runs of a kind_runs container */
+	uint32_t counts_len; /**< bytes taken by the counts */
+
+};
+
+struct bitmap_writer {
+
+	int fd; /**< file being written */
+	uint64_t off; /**< end of what has been written */
+	uint64_t count; /**< number of lines added */
+	unsigned long last; /**< line added last */
+	int err; /**< errno of the first failure, 0 else */
+
+	int open; /**< nonzero while a container is being filled */
+	uint64_t key; /**< key of that container */
+	size_t n; /**< number of its lines */
+	size_t runs; /**< number of runs in them */
+	uint16_t low[BITMAP_CHUNK]; /**< low 16 bits of its lines */
+	unsigned char counts[BITMAP_CHUNK * VARINT_MAX]; /**< varints of their counts */
+	size_t counts_len; /**< bytes in counts */
+	uint16_t pairs[2 * (BITMAP_CHUNK / 32)]; /**< runs of a kind_runs container. It is only chosen if they take less than a bitmap */
+	uint64_t words[WORDS]; /**< a kind_bitmap container */
+
+	struct bitmap_entry *dir; /**< directory of the containers written */
+	size_t ndir; /**< number of entries in dir */
+	size_t cap; /**< allocated entries of dir */
+
+};
+
+/**
+* @brief state of a query within one container
+*/
+struct scan {
+
+	bitmap_callback_t cb; /**< callback, NULL to count only */
+	void *arg; /**< argument of cb */
+	uint64_t base; /**< first line of the container */
+	const unsigned char *p; /**< next count */
+	const unsigned char *end; /**< end of the counts */
+	unsigned long found; /**< lines found */
+	int started; /**< nonzero once the counts in front of the first line found are skipped */
+
+};
+
+/* === Writing === */
+
+static int write_all(int fd, const void *buf, size_t n)
+{
+	const char *p = buf;
+
+	while(n) {
+
+		ssize_t put = write(fd, p, n);
+
+		if(put == -1) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+
+		p += put;
+		n -= (size_t) put;
+	}
+
+	return 0;
+}
+
+/* append to the file, the first error sticks */
+static void put(struct bitmap_writer *w, const void *buf, size_t n)
+{
+	if(w->err == 0 && write_all(w->fd, buf, n) == -1) {
+		w->err = errno;
+	}
+
+	w->off += n;
+}
+
+/* write the container being filled in its smallest form, followed by its counts */
+static void flush(struct bitmap_writer *w)
+{
+	static const char zeros[ALIGN];
+	struct bitmap_entry *e;
+	size_t array = 2 * w->n, runs = 4 * w->runs, i;
+
+	if(w->ndir == w->cap) {
+
+		size_t cap = w->cap ? 2 * w->cap : 64;
+		struct bitmap_entry *dir = realloc(w->dir, cap * sizeof(*dir));
+
+		if(dir == NULL) {
+			w->err = w->err ? w->err : ENOMEM;
+			w->open = 0;
+			return;
+		}
+
+		w->dir = dir;
+		w->cap = cap;
+	}
+
+	e = &w->dir[w->ndir++];
+	e->key = w->key;
+	e->data = w->off;
+	e->rank = w->count - w->n;
+	e->n = (uint32_t) w->n;
+	e->runs = 0;
+
+	if(array <= runs && array <= sizeof(w->words)) {
+
+		e->kind = kind_array;
+		put(w, w->low, array);
+
+	} else if(runs <= sizeof(w->words)) {
+
+		size_t r = 0;
+
+		for(i = 0; i < w->n; i++) {
+			if(i == 0 || w->low[i] != w->low[i - 1] + 1) {
+				w->pairs[2 * r] = w->low[i];
+				w->pairs[2 * r + 1] = 0;
+				r++;
+			} else {
+				w->pairs[2 * r - 1]++;
+			}
+		}
+
+		e->kind = kind_runs;
+		e->runs = (uint32_t) r;
+		put(w, w->pairs, runs);
+
+	} else {
+
+		memset(w->words, 0, sizeof(w->words));
+		for(i = 0; i < w->n; i++) {
+			w->words[w->low[i] / 64] |= (uint64_t) 1 << (w->low[i] % 64);
+		}
+
+		e->kind = kind_bitmap;
+		put(w, w->words, sizeof(w->words));
+	}
+
+	e->counts = w->off;
+	e->counts_len = (uint32_t) w->counts_len;
+	put(w, w->counts, w->counts_len);
+	put(w, zeros, (ALIGN - w->off % ALIGN) % ALIGN);
+
+	w->open = 0;
+}
+
+struct bitmap_writer *bitmap_create(int fd)
+{
+	struct bitmap_writer *w;
+	struct header h;
+
+	if((w = calloc(1, sizeof(*w))) == NULL) {
+		return NULL;
+	}
+
+	w->fd = fd;
+
+	/* a placeholder, the real header is known at the end */
+	memset(&h, 0, sizeof(h));
+	put(w, &h, sizeof(h));
+
+	return w;
+}
+
+void bitmap_add(struct bitmap_writer *w, unsigned long line, unsigned long count)
+{
+	uint64_t key = (uint64_t) line / BITMAP_CHUNK, c = count;
+	uint16_t low = (uint16_t) (line % BITMAP_CHUNK);
+
+	if(w->count && line <= w->last) {
+		w->err = w->err ? w->err : EINVAL;
+		return;
+	}
+
+	if(w->open && key != w->key) {
+		flush(w);
+	}
+
+	if(!w->open) {
+		w->open = 1;
+		w->key = key;
+		w->n = 0;
+		w->runs = 0;
+		w->counts_len = 0;
+	}
+
+	if(w->n == 0 || low != w->low[w->n - 1] + 1) {
+		w->runs++;
+	}
+
+	w->low[w->n++] = low;
+
+	/* 7 bits per byte, the high bit says another one follows */
+	while(c >= 0x80) {
+		w->counts[w->counts_len++] = (unsigned char) (c | 0x80);
+		c >>= 7;
+	}
+	w->counts[w->counts_len++] = (unsigned char) c;
+
+	w->last = line;
+	w->count++;
+}
+
+int bitmap_finish(struct bitmap_writer *w)
+{
+	struct header h;
+	int err;
+
+	if(w->open) {
+		flush(w);
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, BITMAP_MAGIC, sizeof(h.magic));
+	h.version = BITMAP_VERSION;
+	h.chunk = BITMAP_CHUNK;
+	h.count = w->count;
+	h.n = w->ndir;
+	h.dir = w->off;
+
+	put(w, w->dir, w->ndir * sizeof(*w->dir));
+
+	if(w->err == 0 && pwrite(w->fd, &h, sizeof(h), 0) != (ssize_t) sizeof(h)) {
+		w->err = errno ? errno : EIO;
+	}
+
+	err = w->err;
+
+	free(w->dir);
+	free(w);
+
+	errno = err;
+	return err ? -1 : 0;
+}
+
+/* === Querying === */
+
+/* skip k varints, NULL if they run past end */
+static const unsigned char *skip_counts(const unsigned char *p, const unsigned char *end, size_t k)
+{
+	while(k && p < end) {
+		k -= (*p++ & 0x80) == 0;
+	}
+
+	return k ? NULL : p;
+}
+
+/* read a varint, NULL if it runs past end */
+static const unsigned char *read_count(const unsigned char *p, const unsigned char *end, unsigned long *count)
+{
+	uint64_t c = 0;
+	unsigned int shift = 0;
+
+	while(p < end && shift < 64) {
+
+		c |= (uint64_t) (*p & 0x7f) << shift;
+		shift += 7;
+
+		if((*p++ & 0x80) == 0) {
+			*count = (unsigned long) c;
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+/* pass one line on, with its count. rank is its index in the container, the counts in front of the first line found get skipped */
+static int emit(struct scan *s, size_t rank, unsigned int low)
+{
+	unsigned long count;
+
+	s->found++;
+
+	if(s->cb == NULL) {
+		return 0;
+	}
+
+	if(!s->started) {
+		if((s->p = skip_counts(s->p, s->end, rank)) == NULL) {
+			return -1;
+		}
+		s->started = 1;
+	}
+
+	if((s->p = read_count(s->p, s->end, &count)) == NULL) {
+		return -1;
+	}
+
+	s->cb(s->arg, (unsigned long) (s->base + low), count);
+	return 0;
+}
+
+/* the scan_ functions pass the lines from lo to hi (low 16 bits) of a container on. -1 if its counts are damaged */
+static int scan_array(struct scan *s, const uint16_t *low, size_t n, unsigned int lo, unsigned int hi)
+{
+	size_t a = 0, b = n, i;
+
+	/* first line >= lo */
+	while(a < b) {
+
+		size_t mid = a + (b - a) / 2;
+
+		if(low[mid] < lo) {
+			a = mid + 1;
+		} else {
+			b = mid;
+		}
+	}
+
+	for(i = a; i < n && low[i] <= hi; i++) {
+		if(emit(s, i, low[i]) == -1) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int scan_runs(struct scan *s, const uint16_t *pairs, size_t runs, unsigned int lo, unsigned int hi)
+{
+	size_t r, rank = 0;
+
+	for(r = 0; r < runs; r++) {
+
+		unsigned int first = pairs[2 * r], last = first + pairs[2 * r + 1], v;
+
+		if(first > hi) {
+			break;
+		}
+
+		for(v = first > lo ? first : lo; v <= last && v <= hi; v++) {
+			if(emit(s, rank + (v - first), v) == -1) {
+				return -1;
+			}
+		}
+
+		rank += last - first + 1;
+	}
+
+	return 0;
+}
+
+static int scan_bitmap(struct scan *s, const uint64_t *words, unsigned int lo, unsigned int hi)
+{
+	size_t rank = 0, k;
+
+	for(k = 0; k < lo / 64; k++) {
+		rank += (size_t) __builtin_popcountll(words[k]);
+	}
+
+	for(k = lo / 64; k <= hi / 64; k++) {
+
+		uint64_t w = words[k];
+
+		/* bits in front of lo count for the rank only, bits behind hi not at all */
+		if(k == lo / 64) {
+			uint64_t before = w & (((uint64_t) 1 << (lo % 64)) - 1);
+
+			rank += (size_t) __builtin_popcountll(before);
+			w &= ~before;
+		}
+		if(k == hi / 64 && hi % 64 != 63) {
+			w &= ((uint64_t) 2 << (hi % 64)) - 1;
+		}
+
+		while(w) {
+
+			unsigned int bit = (unsigned int) __builtin_ctzll(w);
+
+			if(emit(s, rank, (unsigned int) (k * 64 + bit)) == -1) {
+				return -1;
+			}
+
+			rank++;
+			w &= w - 1;
+		}
+	}
+
+	return 0;
+}
+
+/* sizes of a container's data */
+static uint64_t data_len(const struct bitmap_entry *e)
+{
+	return e->kind == kind_array ? 2 * (uint64_t) e->n : e->kind == kind_runs ? 4 * (uint64_t) e->runs : WORDS * 8;
+}
+
+int bitmap_open(struct bitmap *b, int fd)
+{
+	const struct header *h;
+	struct stat st;
+	uint64_t rank = 0, i;
+	void *map;
+
+	if(fstat(fd, &st) == -1) {
+		return -1;
+	}
+
+	if((uint64_t) st.st_size < sizeof(*h)) {
+		errno = 0;
+		return -1;
+	}
+
+	if((map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		return -1;
+	}
+
+	b->data = map;
+	b->size = (size_t) st.st_size;
+	h = map;
+
+	if(memcmp(h->magic, BITMAP_MAGIC, sizeof(h->magic)) != 0 || h->version != BITMAP_VERSION || h->chunk != BITMAP_CHUNK
+			|| h->dir % ALIGN != 0 || h->dir > b->size || h->n > (b->size - h->dir) / sizeof(struct bitmap_entry)
+			|| h->dir + h->n * sizeof(struct bitmap_entry) != b->size) {
+		goto invalid;
+	}
+
+	b->dir = (const struct bitmap_entry *) (b->data + h->dir);
+	b->n = (size_t) h->n;
+	b->count = (unsigned long) h->count;
+
+	/* the directory has to describe containers we could have written, queries rely on it */
+	for(i = 0; i < h->n; i++) {
+
+		const struct bitmap_entry *e = &b->dir[i];
+
+		if((i && e->key <= b->dir[i - 1].key) || e->n == 0 || e->n > BITMAP_CHUNK || e->rank != rank
+				|| (e->kind != kind_array && e->kind != kind_runs && e->kind != kind_bitmap) || e->runs > e->n
+				|| e->data % ALIGN != 0 || e->data < sizeof(*h) || e->data + data_len(e) != e->counts
+				|| e->counts + e->counts_len > h->dir) {
+			goto invalid;
+		}
+
+		rank += e->n;
+	}
+
+	if(rank != h->count) {
+		goto invalid;
+	}
+
+	return 0;
+
+invalid:
+	(void) munmap(map, b->size);
+	errno = 0;
+	return -1;
+}
+
+unsigned long bitmap_query(const struct bitmap *b, unsigned long from, unsigned long to, bitmap_callback_t cb, void *arg)
+{
+	uint64_t kfrom = (uint64_t) from / BITMAP_CHUNK, kto = (uint64_t) to / BITMAP_CHUNK;
+	size_t lo = 0, hi = b->n, i;
+	unsigned long total = 0;
+
+	if(from > to) {
+		return 0;
+	}
+
+	/* first container that may hold from */
+	while(lo < hi) {
+
+		size_t mid = lo + (hi - lo) / 2;
+
+		if(b->dir[mid].key < kfrom) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	for(i = lo; i < b->n && b->dir[i].key <= kto; i++) {
+
+		const struct bitmap_entry *e = &b->dir[i];
+		const char *data = b->data + e->data;
+		unsigned int first = e->key == kfrom ? (unsigned int) (from % BITMAP_CHUNK) : 0;
+		unsigned int last = e->key == kto ? (unsigned int) (to % BITMAP_CHUNK) : BITMAP_CHUNK - 1;
+		struct scan s;
+		int ret;
+
+		/* counting a whole container needs its size only */
+		if(cb == NULL && first == 0 && last == BITMAP_CHUNK - 1) {
+			total += e->n;
+			continue;
+		}
+
+		s.cb = cb;
+		s.arg = arg;
+		s.base = e->key * BITMAP_CHUNK;
+		s.p = (const unsigned char *) b->data + e->counts;
+		s.end = s.p + e->counts_len;
+		s.found = 0;
+		s.started = 0;
+
+		if(e->kind == kind_array) {
+			ret = scan_array(&s, (const uint16_t *) data, e->n, first, last);
+		} else if(e->kind == kind_runs) {
+			ret = scan_runs(&s, (const uint16_t *) data, e->runs, first, last);
+		} else {
+			ret = scan_bitmap(&s, (const uint64_t *) data, first, last);
+		}
+
+		if(ret == -1) {
+			return (unsigned long) -1;
+		}
+
+		total += s.found;
+	}
+
+	return total;
+}
+
+void bitmap_close(struct bitmap *b)
+{
+	if(b->data != NULL) {
+		(void) munmap((void *) b->data, b->size);
+	}
+
+	b->data = NULL;
+	b->size = 0;
+}
+
+/* === Self test === */
+
+/** number of random sets */
+#define TEST_SETS 40
+/** number of random queries per set */
+#define TEST_QUERIES 200
+/** most lines in a set */
+#define TEST_MAX_LINES 200000
+
+/* xorshift, we want the same test data on every run */
+static uint32_t test_rand(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/**
+* @brief what a query returned
+*/
+struct test_result {
+
+	unsigned long *line; /**< lines */
+	unsigned long *count; /**< their counts */
+	size_t n; /**< number of lines */
+
+};
+
+static void test_collect(void *arg, unsigned long line, unsigned long count)
+{
+	struct test_result *r = arg;
+
+	if(r->n < TEST_MAX_LINES) {
+		r->line[r->n] = line;
+		r->count[r->n] = count;
+	}
+
+	r->n++;
+}
+
+/* sparse lines, dense ones and long runs, so all forms of containers show up. Counts are mostly small, now and then huge */
+static size_t test_set(unsigned long *line, unsigned long *count, uint32_t *state)
+{
+	unsigned int style = test_rand(state) % 3;
+	size_t n = test_rand(state) % TEST_MAX_LINES, i;
+	unsigned long l = 1 + test_rand(state) % 100000;
+
+	for(i = 0; i < n; i++) {
+
+		uint32_t r = test_rand(state);
+
+		line[i] = l;
+		count[i] = r % 16 == 0 ? ((unsigned long) r << 20) | r : 1 + r % 100;
+
+		if(style == 0) {
+			l += 1 + r % 50000;
+		} else if(style == 1) {
+			l += 1 + r % 3;
+		} else {
+			l += r % 200 == 0 ? 1 + r % 100000 : 1;
+		}
+	}
+
+	return n;
+}
+
+int bitmap_self_test(void)
+{
+	static unsigned long line[TEST_MAX_LINES], count[TEST_MAX_LINES], got_line[TEST_MAX_LINES], got_count[TEST_MAX_LINES];
+	uint32_t state = 2463534242u;
+	int set, ret = 0;
+
+	for(set = 0; set < TEST_SETS && ret == 0; set++) {
+
+		size_t n = test_set(line, count, &state), i;
+		struct bitmap_writer *w;
+		struct bitmap b;
+		FILE *f;
+		int q;
+
+		if((f = tmpfile()) == NULL || (w = bitmap_create(fileno(f))) == NULL) {
+			ret = -1;
+			break;
+		}
+
+		for(i = 0; i < n; i++) {
+			bitmap_add(w, line[i], count[i]);
+		}
+
+		if(bitmap_finish(w) == -1 || bitmap_open(&b, fileno(f)) == -1 || b.count != n) {
+			(void) fclose(f);
+			ret = -1;
+			break;
+		}
+
+		for(q = 0; q < TEST_QUERIES && ret == 0; q++) {
+
+			unsigned long span = n ? line[n - 1] + 10 : 10, from = test_rand(&state) % span, to = from + test_rand(&state) % (q % 2 ? 1000 : span);
+			struct test_result r;
+			size_t k = 0, j;
+
+			r.line = got_line;
+			r.count = got_count;
+			r.n = 0;
+
+			/* the lines in range, found the slow way */
+			while(k < n && line[k] < from) {
+				k++;
+			}
+			for(j = k; j < n && line[j] <= to; j++);
+
+			if(bitmap_query(&b, from, to, test_collect, &r) != j - k || r.n != j - k || bitmap_query(&b, from, to, NULL, NULL) != j - k
+					|| memcmp(got_line, line + k, (j - k) * sizeof(*line)) != 0 || memcmp(got_count, count + k, (j - k) * sizeof(*count)) != 0) {
+				ret = -1;
+			}
+		}
+
+		bitmap_close(&b);
+		(void) fclose(f);
+	}
+
+	(void) fprintf(stdout, ret == 0 ? "bitmap: ok\n" : "bitmap: FAILED\n");
+	return ret;
+}
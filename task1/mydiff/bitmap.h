@@ -0,0 +1,108 @@
+/**
+* @file bitmap.h
+* @brief header file for the compressed bitmap of mismatching lines (-B), written while comparing and queried by mdquery
+*/
+
+#ifndef BITMAP_H
+#define BITMAP_H
+#include <stddef.h> //needed for size_t
+
+/**
+* @brief number of line numbers per container, the low 16 bits of a line number address it within its container
+*/
+#define BITMAP_CHUNK (1 << 16)
+
+/**
+* @brief opaque type of a bitmap being written
+*/
+struct bitmap_writer;
+
+/**
+* @brief a bitmap mapped for queries
+*/
+struct bitmap {
+
+	const char *data; /**< the mapped file */
+	size_t size; /**< size of the file */
+	const struct bitmap_entry *dir; /**< directory of the containers, ordered by key */
+	size_t n; /**< number of containers */
+	unsigned long count; /**< number of lines in the bitmap */
+
+};
+
+/**
+* @brief type definition of the callback receiving the lines of a query, in ascending order
+*
+* @param arg argument given to bitmap_query
+* @param line number of the line
+* @param count number of mismatching chars of the line
+*/
+typedef void (*bitmap_callback_t)(void *arg, unsigned long line, unsigned long count);
+
+/**
+* @brief start writing a bitmap
+*
+* @param fd file descriptor of an empty, seekable file (not closed by the writer). The header is written last, at offset 0
+*
+* @return the writer, NULL if memory ran out
+*/
+struct bitmap_writer *bitmap_create(int fd);
+
+/**
+* @brief add a line. Lines have to be added in ascending order. Write errors are kept until bitmap_finish
+*
+* @param w the writer
+* @param line number of the line, counting from 1
+* @param count number of mismatching chars of the line, kept in the side array
+*/
+void bitmap_add(struct bitmap_writer *w, unsigned long line, unsigned long count);
+
+/**
+* @brief write the last container, the directory and the header, and release the writer
+*
+* @param w the writer
+*
+* @return 0 on success, -1 if anything could not be written (errno is set)
+*/
+int bitmap_finish(struct bitmap_writer *w);
+
+/**
+* @brief map a bitmap written by bitmap_finish. Header and directory are checked, the containers are only touched by queries
+*
+* @param b bitmap to initialize
+* @param fd file descriptor of the bitmap file (not closed)
+*
+* @return 0 on success, -1 if the file can't be mapped (errno is set) or is no valid bitmap (errno is 0)
+*/
+int bitmap_open(struct bitmap *b, int fd);
+
+/**
+* @brief find the lines from .. to (both included). Only the containers overlapping the range are decoded,
+* the counts of a container only up to the last line in range
+*
+* @param b the bitmap
+* @param from first line of the range
+* @param to last line of the range
+* @param cb callback receiving the lines, NULL to count them only (containers completely in range aren't decoded then)
+* @param arg passed on to cb
+*
+* @return number of lines in range, (unsigned long) -1 if a container turns out to be damaged
+*/
+unsigned long bitmap_query(const struct bitmap *b, unsigned long from, unsigned long to, bitmap_callback_t cb, void *arg);
+
+/**
+* @brief unmap a bitmap
+*
+* @param b the bitmap
+*/
+void bitmap_close(struct bitmap *b);
+
+/**
+* @brief write random sets of lines (sparse, dense and in runs) into a temporary file and check queries on random ranges
+* against the sets. Reports on stdout
+*
+* @return 0 if all queries agree, -1 else
+*/
+int bitmap_self_test(void);
+
+#endif
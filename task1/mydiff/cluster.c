@@ -0,0 +1,428 @@
+/**
+* @file cluster.c
+* @brief find near-duplicate pairs among many files without comparing all of them with each other
+* @details Three steps, the first and the last one on a pool of threads:
+* every file gets a MinHash signature of its set of lines (each file is read once, whatever the number of files).
+* The signatures are cut into bands, files with an equal band land in the same bucket (locality sensitive hashing),
+* pairs sharing a bucket are the candidates. Candidates with an estimated similarity below the threshold are dropped.
+* The remaining pairs get compared line by line, each one into its own memory stream, printed in order of the pairs.
+* So the exact comparison runs on the shortlist only, instead of on all n * (n - 1) / 2 pairs.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "cluster.h"
+#include "hash.h"
+#include "workpool.h"
+#include "stats.h"
+
+/* === Constants === */
+
+/** log2 of CLUSTER_HASHES: the top bits of a line hash pick its bin */
+#define BIN_BITS 7
+
+/** Value of a bin no line hash has landed in */
+#define EMPTY UINT64_MAX
+
+/** Added per bin skipped by an empty bin borrowing a value, so borrowed values differ from the originals */
+#define DENSIFY 0x9e3779b97f4a7c15ULL
+
+/** Number of bands of a signature */
+#define BANDS (CLUSTER_HASHES / CLUSTER_ROWS)
+
+/* === Structures === */
+
+/**
+* @brief a file in a bucket of a band
+*/
+struct bucket {
+
+	uint64_t key; /**< hash of the file's band */
+	size_t file; /**< index of the file */
+
+};
+
+/**
+* @brief a shortlisted pair of files and the result of comparing them
+*/
+struct pair {
+
+	size_t i; /**< index of the first file */
+	size_t j; /**< index of the second file, greater than i */
+	double similarity; /**< estimated Jaccard similarity */
+	int ret; /**< return value of the comparison, -2 if the output buffer could not be allocated */
+	char *buf; /**< output of the comparison */
+	size_t len; /**< length of the output */
+
+};
+
+/**
+* @brief state shared by all tasks of a cluster comparison
+*/
+struct clusters {
+
+	char *const *paths; /**< paths of the files */
+	size_t n; /**< number of files */
+	uint64_t *sigs; /**< CLUSTER_HASHES values per file */
+	int *signed_ok; /**< nonzero for the files that could be signed */
+	struct pair *pairs; /**< shortlisted pairs */
+	size_t npairs; /**< number of shortlisted pairs */
+	size_t cap; /**< allocated pairs */
+	cluster_sign_t sign; /**< callback signing a file */
+	tree_compare_t cmp; /**< callback comparing a pair */
+	void *arg; /**< argument of the callbacks */
+
+};
+
+/* === Implementation === */
+
+void cluster_signature(uint64_t *sig, const char *data, size_t size)
+{
+	const char *p = data, *end = data + size;
+	unsigned char full[CLUSTER_HASHES];
+	size_t i, j, dist;
+
+	for(i = 0; i < CLUSTER_HASHES; i++) {
+		sig[i] = EMPTY;
+	}
+
+	/* a set: lines that occur more than once don't change the minimum */
+	while(p < end) {
+
+		const char *nl = memchr(p, '\n', (size_t) (end - p));
+		const char *stop = nl != NULL ? nl : end;
+		uint64_t h = line_hash(p, (size_t) (stop - p));
+		size_t bin = (size_t) (h >> (64 - BIN_BITS));
+
+		if(h < sig[bin]) {
+			sig[bin] = h;
+		}
+
+		p = stop + (nl != NULL);
+	}
+
+	for(i = 0; i < CLUSTER_HASHES; i++) {
+		full[i] = sig[i] != EMPTY;
+	}
+
+	/* an empty bin takes the value of the next full one to its right (never a borrowed one), so similar sets still agree on it. An empty set stays empty */
+	for(i = 0; i < CLUSTER_HASHES; i++) {
+
+		if(full[i]) {
+			continue;
+		}
+
+		for(dist = 1, j = (i + 1) % CLUSTER_HASHES; dist < CLUSTER_HASHES && !full[j]; dist++, j = (j + 1) % CLUSTER_HASHES);
+
+		if(dist < CLUSTER_HASHES) {
+			sig[i] = sig[j] + dist * DENSIFY;
+		}
+	}
+}
+
+double cluster_similarity(const uint64_t *a, const uint64_t *b)
+{
+	size_t i, equal = 0;
+
+	for(i = 0; i < CLUSTER_HASHES; i++) {
+		equal += a[i] == b[i];
+	}
+
+	return (double) equal / CLUSTER_HASHES;
+}
+
+static void sign_task(void *arg, size_t task)
+{
+	struct clusters *c = arg;
+
+	c->signed_ok[task] = c->sign(c->sigs + task * CLUSTER_HASHES, c->paths[task], c->arg) == 0;
+}
+
+static int cmp_buckets(const void *x, const void *y)
+{
+	const struct bucket *a = x, *b = y;
+
+	if(a->key != b->key) {
+		return a->key < b->key ? -1 : 1;
+	}
+
+	return a->file < b->file ? -1 : a->file > b->file;
+}
+
+static int cmp_pairs(const void *x, const void *y)
+{
+	const struct pair *a = x, *b = y;
+
+	if(a->i != b->i) {
+		return a->i < b->i ? -1 : 1;
+	}
+
+	return a->j < b->j ? -1 : a->j > b->j;
+}
+
+/* nonzero if the signatures of files i and j agree on a band in front of the given one, the pair has been seen there already */
+static int seen_before(const struct clusters *c, size_t i, size_t j, size_t band)
+{
+	const uint64_t *a = c->sigs + i * CLUSTER_HASHES, *b = c->sigs + j * CLUSTER_HASHES;
+	size_t k;
+
+	for(k = 0; k < band; k++) {
+		if(memcmp(a + k * CLUSTER_ROWS, b + k * CLUSTER_ROWS, CLUSTER_ROWS * sizeof(*a)) == 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int add_pair(struct clusters *c, size_t i, size_t j, double similarity)
+{
+	if(c->npairs == c->cap) {
+
+		size_t cap = c->cap ? 2 * c->cap : 64;
+		struct pair *p = realloc(c->pairs, cap * sizeof(*p));
+
+		if(p == NULL) {
+			return -1;
+		}
+
+		c->pairs = p;
+		c->cap = cap;
+	}
+
+	memset(&c->pairs[c->npairs], 0, sizeof(*c->pairs));
+	c->pairs[c->npairs].i = i;
+	c->pairs[c->npairs].j = j;
+	c->pairs[c->npairs].similarity = similarity;
+	c->npairs++;
+
+	return 0;
+}
+
+/* bucket the files by each band of their signatures in turn, pairs within a bucket that are similar enough get shortlisted */
+static int shortlist(struct clusters *c, double threshold)
+{
+	struct bucket *b;
+	size_t band, i, m, s, e, x, y;
+
+	if((b = malloc(c->n * sizeof(*b) + 1)) == NULL) {
+		return -1;
+	}
+
+	for(band = 0; band < BANDS; band++) {
+
+		for(i = m = 0; i < c->n; i++) {
+			if(c->signed_ok[i]) {
+				b[m].key = line_hash((const char *) (c->sigs + i * CLUSTER_HASHES + band * CLUSTER_ROWS), CLUSTER_ROWS * sizeof(*c->sigs));
+				b[m].file = i;
+				m++;
+			}
+		}
+
+		qsort(b, m, sizeof(*b), cmp_buckets);
+
+		for(s = 0; s < m; s = e) {
+
+			for(e = s + 1; e < m && b[e].key == b[s].key; e++);
+
+			for(x = s; x < e; x++) {
+				for(y = x + 1; y < e; y++) {
+
+					const uint64_t *sx = c->sigs + b[x].file * CLUSTER_HASHES, *sy = c->sigs + b[y].file * CLUSTER_HASHES;
+					double similarity;
+
+					/* the keys of different bands may collide, and a pair sharing an earlier band is in the list already */
+					if(memcmp(sx + band * CLUSTER_ROWS, sy + band * CLUSTER_ROWS, CLUSTER_ROWS * sizeof(*sx)) != 0 || seen_before(c, b[x].file, b[y].file, band)) {
+						continue;
+					}
+
+					if((similarity = cluster_similarity(sx, sy)) >= threshold && add_pair(c, b[x].file, b[y].file, similarity) == -1) {
+						free(b);
+						return -1;
+					}
+				}
+			}
+		}
+	}
+
+	free(b);
+
+	qsort(c->pairs, c->npairs, sizeof(*c->pairs), cmp_pairs);
+	return 0;
+}
+
+static void pair_task(void *arg, size_t task)
+{
+	struct clusters *c = arg;
+	struct pair *p = &c->pairs[task];
+	FILE *out;
+
+	if((out = open_memstream(&p->buf, &p->len)) == NULL) {
+		p->ret = -2;
+		return;
+	}
+
+	p->ret = c->cmp(out, c->paths[p->i], c->paths[p->j], c->arg);
+
+	if(fclose(out) != 0) {
+		p->ret = -2;
+	}
+}
+
+long compare_clusters(FILE *out, char *const *paths, size_t n, unsigned int jobs, double threshold, cluster_sign_t sign, tree_compare_t cmp, void *arg)
+{
+	struct clusters c;
+	struct workpool wp;
+	size_t i;
+	long failed = 0;
+	int nomem = 0;
+
+	memset(&c, 0, sizeof(c));
+	c.paths = paths;
+	c.n = n;
+	c.sign = sign;
+	c.cmp = cmp;
+	c.arg = arg;
+
+	if((c.sigs = malloc(n * CLUSTER_HASHES * sizeof(*c.sigs) + 1)) == NULL || (c.signed_ok = calloc(n + 1, sizeof(*c.signed_ok))) == NULL) {
+		failed = -1;
+		goto out;
+	}
+
+	if(workpool_run(jobs, n, sign_task, &c) == -1 || shortlist(&c, threshold) == -1) {
+		failed = -1;
+		goto out;
+	}
+
+	/* the failing files have been reported by sign */
+	for(i = 0; i < n; i++) {
+		failed += !c.signed_ok[i];
+	}
+
+	if(c.npairs == 0) {
+		goto out;
+	}
+
+	stats_phase(stats_compare);
+
+	if(workpool_start(&wp, jobs, c.npairs, pair_task, &c) == -1) {
+		failed = -1;
+		goto out;
+	}
+
+	/* print the pairs in order, as soon as they are ready */
+	for(i = 0; i < c.npairs; i++) {
+
+		struct pair *p = &c.pairs[i];
+
+		workpool_wait(&wp, i);
+
+		if(p->ret >= 0) {
+			(void) fprintf(out, "Paar: %s %s Ähnlichkeit: %.2f\n", paths[p->i], paths[p->j], p->similarity);
+			(void) fwrite(p->buf, 1, p->len, out);
+		} else if(p->ret == -1) {
+			failed++;
+		} else {
+			nomem = 1;
+		}
+
+		free(p->buf);
+		p->buf = NULL;
+	}
+
+	workpool_join(&wp);
+
+	if(nomem) {
+		failed = -1;
+	}
+
+out:
+	free(c.sigs);
+	free(c.signed_ok);
+	free(c.pairs);
+
+	if(failed == -1) {
+		errno = ENOMEM;
+	}
+
+	return failed;
+}
+
+/* === Self test === */
+
+/** number of lines per set */
+#define TEST_LINES 4000
+/** most a similarity estimate may be off */
+#define TEST_TOLERANCE 0.12
+
+/* xorshift, we want the same test data on every run */
+static uint32_t test_rand(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/* print the lines numbered first .. first + n - 1 into buf: n random ones of them first, then all of them in order */
+static size_t test_set(char *buf, unsigned long first, size_t n, uint32_t *state)
+{
+	size_t len = 0, i;
+
+	/* order and repetitions must not change the signature of the set */
+	for(i = 0; i < n; i++) {
+		len += (size_t) sprintf(buf + len, "Zeile %lu mit etwas Text\n", first + test_rand(state) % n);
+	}
+
+	for(i = 0; i < n; i++) {
+		len += (size_t) sprintf(buf + len, "Zeile %lu mit etwas Text\n", first + i);
+	}
+
+	return len;
+}
+
+int cluster_self_test(void)
+{
+	static const double similarity[] = { 0.0, 0.1, 0.3, 0.5, 0.7, 0.9, 1.0 };
+	uint64_t sa[CLUSTER_HASHES], sb[CLUSTER_HASHES];
+	uint32_t state = 2463534242u;
+	char *a, *b;
+	size_t k;
+	int ret = 0;
+
+	if((a = malloc(2 * TEST_LINES * 40)) == NULL || (b = malloc(2 * TEST_LINES * 40)) == NULL) {
+		free(a);
+		(void) fprintf(stdout, "cluster: FAILED\n");
+		return -1;
+	}
+
+	for(k = 0; k < sizeof(similarity) / sizeof(*similarity); k++) {
+
+		/* two sets of TEST_LINES lines sharing s of them: J = s / (2 * TEST_LINES - s) */
+		unsigned long s = (unsigned long) (2 * TEST_LINES * similarity[k] / (1 + similarity[k]) + 0.5);
+		double want = (double) s / (2 * TEST_LINES - s), got;
+
+		cluster_signature(sa, a, test_set(a, 0, TEST_LINES, &state));
+		cluster_signature(sb, b, test_set(b, TEST_LINES - s, TEST_LINES, &state));
+
+		got = cluster_similarity(sa, sb);
+
+		if(got < want - TEST_TOLERANCE || got > want + TEST_TOLERANCE) {
+			ret = -1;
+		}
+	}
+
+	/* empty sets are equal to each other only */
+	cluster_signature(sa, a, 0);
+	cluster_signature(sb, "\n", 1);
+	if(cluster_similarity(sa, sa) != 1.0 || cluster_similarity(sa, sb) != 0.0) {
+		ret = -1;
+	}
+
+	free(a);
+	free(b);
+
+	(void) fprintf(stdout, ret == 0 ? "cluster: ok\n" : "cluster: FAILED\n");
+	return ret;
+}
@@ -0,0 +1,88 @@
+/**
+* @file cluster.h
+* @brief header file for mydiff's cluster mode: find the near-duplicate pairs among many files by MinHash signatures
+* of their sets of lines, and compare only those line by line
+*/
+
+#ifndef CLUSTER_H
+#define CLUSTER_H
+#include <stdio.h> //needed for FILE
+#include <stddef.h> //needed for size_t
+#include <stdint.h>
+#include "tree.h"
+
+/**
+* @brief number of MinHash values in a signature
+*/
+#define CLUSTER_HASHES 128
+
+/**
+* @brief number of values per band of the LSH step. Files agreeing on all values of any band become candidates,
+* with 32 bands of 4 that's likely from a Jaccard similarity of about 0.4 on
+*/
+#define CLUSTER_ROWS 4
+
+/**
+* @brief default similarity a candidate pair needs to get compared
+*/
+#define CLUSTER_THRESHOLD 0.8
+
+/**
+* @brief type definition of the callback computing the signature of a file
+*
+* @param sig receives CLUSTER_HASHES values (see cluster_signature)
+* @param path path of the file
+* @param arg argument given to compare_clusters
+*
+* @return 0 on success, -1 if the file could not be read (the callback reports why)
+*/
+typedef int (*cluster_sign_t)(uint64_t *sig, const char *path, void *arg);
+
+/**
+* @brief MinHash signature of the set of lines of a buffer (one permutation hashing: every line hash lands in one of
+* CLUSTER_HASHES bins by its top bits, each bin keeps its smallest hash, empty bins borrow from the next full one).
+* Equal values at the same index estimate the Jaccard similarity of two sets
+*
+* @param sig receives CLUSTER_HASHES values
+* @param data first char of the buffer
+* @param size number of chars in data
+*/
+void cluster_signature(uint64_t *sig, const char *data, size_t size);
+
+/**
+* @brief estimate the Jaccard similarity of two sets of lines from their signatures
+*
+* @param a signature of the first set
+* @param b signature of the second set
+*
+* @return the fraction of equal values, 0 .. 1
+*/
+double cluster_similarity(const uint64_t *a, const uint64_t *b);
+
+/**
+* @brief sign all files on a pool of jobs threads, shortlist the pairs whose signatures share a band (LSH),
+* and compare the shortlisted pairs with an estimated similarity of at least threshold on the pool.
+* Results are printed in order of the pairs (by the positions of their files in paths):
+* "Paar: PATH1 PATH2 Ähnlichkeit: ESTIMATE" followed by the output of cmp. Other pairs print nothing
+*
+* @param out stream to print the results to
+* @param paths paths of the files
+* @param n number of files
+* @param jobs number of files signed (and pairs compared) at the same time
+* @param threshold least estimated similarity of a pair to be compared, 0 .. 1
+* @param sign callback computing the signature of a file (called on the pool's threads)
+* @param cmp callback comparing a pair of files (called on the pool's threads), like the one of compare_trees
+* @param arg passed on to sign and cmp
+*
+* @return number of files and pairs the callbacks failed on, -1 if memory or threads could not be allocated (errno is set)
+*/
+long compare_clusters(FILE *out, char *const *paths, size_t n, unsigned int jobs, double threshold, cluster_sign_t sign, tree_compare_t cmp, void *arg);
+
+/**
+* @brief sign random sets of lines with known Jaccard similarities and check the estimates. Reports on stdout
+*
+* @return 0 if all estimates are close enough, -1 else
+*/
+int cluster_self_test(void);
+
+#endif
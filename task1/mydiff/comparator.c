@@ -0,0 +1,412 @@
+/**
+* @file comparator.c
+* @brief streaming comparator of libmydiff: both sides are fed in pieces of any size, line pairs are compared
+* right out of the fed buffers as soon as both sides have them, and every pair with mismatches is handed to a callback
+* @details The comparison of a line pair can stop and resume anywhere: the kernels stop at the end of either buffer,
+* and whatever they counted so far is kept until the pair is done. Once a pair is done (a stop char on either side),
+* the rest of both lines is skipped, each side on its own. Only the bytes of the side that is ahead are copied,
+* into a buffer that is allocated once and only grows if a side runs further ahead than ever before.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include "libmydiff.h"
+#include "mismatch.h"
+#include "compare.h"
+
+/* === Constants === */
+
+/** Bytes a side may run ahead of the other one before its buffer has to grow, unless mydiff_new is told otherwise */
+#define DEFAULT_LAG (64 << 10)
+
+/* === Structures === */
+
+/**
+* @brief one side of a comparator
+*/
+struct side {
+
+	char *buf; /**< bytes fed by earlier calls that have not been looked at yet */
+	size_t cap; /**< size of buf */
+	size_t len; /**< number of bytes in buf */
+	const char *p; /**< next byte to look at */
+	const char *end; /**< end of the bytes p points into */
+	const char *next; /**< bytes fed by the current call, while p is still in buf. NULL else */
+	const char *next_end; /**< end of next */
+	int in_buf; /**< nonzero while p points into buf */
+	int eol; /**< nonzero once the line being skipped has ended */
+
+};
+
+/**
+* @brief a streaming comparator
+*/
+struct mydiff {
+
+	mismatch_kernel_t kernel; /**< kernel of the comparator's flags */
+	mydiff_callback_t cb; /**< callback receiving the records */
+	void *arg; /**< argument of cb */
+	struct side a; /**< side A */
+	struct side b; /**< side B */
+	unsigned long line; /**< number of the current line pair */
+	unsigned long count; /**< mismatches of the current line pair so far */
+	int skipping; /**< nonzero once the current line pair is done and the rest of its lines gets skipped */
+	int finished; /**< nonzero after mydiff_finish */
+
+};
+
+/* === Implementation === */
+
+/* look at what is left of earlier calls first, then at the bytes of this call */
+static void side_start(struct side *s, const char *data, size_t len)
+{
+	if(s->len) {
+		s->p = s->buf;
+		s->end = s->buf + s->len;
+		s->next = data;
+		s->next_end = data + len;
+		s->in_buf = 1;
+	} else {
+		s->p = data;
+		s->end = data + len;
+		s->next = NULL;
+		s->in_buf = 0;
+	}
+}
+
+/* go on with the bytes of this call, once buf is used up. 0 if there are none */
+static int side_refill(struct side *s)
+{
+	if(s->p != s->end || s->next == NULL) {
+		return 0;
+	}
+
+	s->p = s->next;
+	s->end = s->next_end;
+	s->next = NULL;
+	s->in_buf = 0;
+
+	return 1;
+}
+
+/* copy what has not been looked at into buf, the caller's buffer is gone after the call */
+static int side_keep(struct side *s)
+{
+	size_t kept = s->in_buf ? (size_t) (s->end - s->p) : 0;
+	const char *rest = s->in_buf ? s->next : s->p;
+	size_t more = s->in_buf ? (size_t) (s->next_end - s->next) : (size_t) (s->end - s->p);
+
+	if(kept && s->p != s->buf) {
+		memmove(s->buf, s->p, kept);
+	}
+
+	if(kept + more > s->cap) {
+
+		size_t cap = 2 * s->cap > kept + more ? 2 * s->cap : kept + more;
+		char *buf = realloc(s->buf, cap);
+
+		if(buf == NULL) {
+			s->len = kept;
+			return -1;
+		}
+
+		s->buf = buf;
+		s->cap = cap;
+	}
+
+	if(more) {
+		memcpy(s->buf + kept, rest, more);
+	}
+
+	s->len = kept + more;
+	return 0;
+}
+
+/* skip to the start of the next line, as far as there are bytes */
+static void side_skip(struct side *s)
+{
+	while(!s->eol) {
+
+		const char *nl = memchr(s->p, '\n', (size_t) (s->end - s->p));
+
+		if(nl != NULL) {
+			s->p = nl + 1;
+			s->eol = 1;
+			return;
+		}
+
+		s->p = s->end;
+
+		if(!side_refill(s)) {
+			return;
+		}
+	}
+}
+
+static void report(struct mydiff *d)
+{
+	struct mydiff_record rec;
+
+	rec.line = d->line;
+	rec.count = d->count;
+	d->cb(d->arg, &rec);
+}
+
+/* compare and skip as far as both sides have bytes */
+static void step(struct mydiff *d)
+{
+	struct side *a = &d->a, *b = &d->b;
+
+	for(;;) {
+
+		if(d->skipping) {
+
+			side_skip(a);
+			side_skip(b);
+
+			if(!a->eol || !b->eol) {
+				return;
+			}
+
+			d->skipping = 0;
+			d->line++;
+			d->count = 0;
+		}
+
+		for(;;) {
+
+			size_t stop_a, stop_b;
+
+			d->count += d->kernel(a->p, (size_t) (a->end - a->p), b->p, (size_t) (b->end - b->p), &stop_a, &stop_b);
+			a->p += stop_a;
+			b->p += stop_b;
+
+			/* a stop char on either side ends the pair, else one of them ran out of bytes */
+			if((a->p < a->end && STOP_COMPARE_CHAR(*a->p)) || (b->p < b->end && STOP_COMPARE_CHAR(*b->p))) {
+				break;
+			}
+
+			if(!side_refill(a) && !side_refill(b)) {
+				return;
+			}
+		}
+
+		if(d->count) {
+			report(d);
+		}
+
+		d->skipping = 1;
+		a->eol = b->eol = 0;
+	}
+}
+
+struct mydiff *mydiff_new(int flags, size_t lag, mydiff_callback_t cb, void *arg)
+{
+	struct mydiff *d;
+
+	if((d = calloc(1, sizeof(*d))) == NULL) {
+		return NULL;
+	}
+
+	d->a.cap = d->b.cap = lag ? lag : DEFAULT_LAG;
+
+	if((d->a.buf = malloc(d->a.cap)) == NULL || (d->b.buf = malloc(d->b.cap)) == NULL) {
+		mydiff_free(d);
+		return NULL;
+	}
+
+	d->kernel = mismatch_select((flags & MYDIFF_ICASE ? MISMATCH_ICASE : 0) | (flags & MYDIFF_SPACE ? MISMATCH_SPACE : 0));
+	d->cb = cb;
+	d->arg = arg;
+	mydiff_reset(d);
+
+	return d;
+}
+
+int mydiff_feed(struct mydiff *d, const char *a, size_t la, const char *b, size_t lb)
+{
+	int ret = 0;
+
+	if(d->finished) {
+		return 0;
+	}
+
+	side_start(&d->a, a, la);
+	side_start(&d->b, b, lb);
+
+	step(d);
+
+	if(side_keep(&d->a) == -1) {
+		ret = -1;
+	}
+	if(side_keep(&d->b) == -1) {
+		ret = -1;
+	}
+
+	return ret;
+}
+
+/* whatever is left of the other side is never compared, like in compare_lines */
+void mydiff_finish(struct mydiff *d)
+{
+	if(d->finished) {
+		return;
+	}
+
+	if(!d->skipping && d->count) {
+		report(d);
+	}
+
+	d->finished = 1;
+}
+
+void mydiff_reset(struct mydiff *d)
+{
+	d->a.len = d->b.len = 0;
+	d->line = 1;
+	d->count = 0;
+	d->skipping = 0;
+	d->finished = 0;
+}
+
+void mydiff_free(struct mydiff *d)
+{
+	if(d == NULL) {
+		return;
+	}
+
+	free(d->a.buf);
+	free(d->b.buf);
+	free(d);
+}
+
+/* === Self test === */
+
+/** number of random input pairs per set of flags */
+#define TEST_ROUNDS 300
+/** maximum size of a random input */
+#define TEST_MAX_SIZE (16 << 10)
+
+/* xorshift, we want the same test data on every run */
+static uint32_t test_rand(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/* random lines out of a small alphabet with upper case, white space and an occasional NUL. b is a with some bytes changed */
+static void test_inputs(char *a, size_t *la, char *b, size_t *lb, uint32_t *state)
+{
+	size_t i, n = test_rand(state) % TEST_MAX_SIZE, m = 0, rate = 1 + test_rand(state) % 256;
+
+	for(i = 0; i < n; i++) {
+
+		uint32_t r = test_rand(state) % 4096;
+
+		a[i] = r == 0 ? '\0' : r < 64 ? '\n' : "ababAB \t"[r & 7];
+	}
+
+	for(i = 0; i < n && m < TEST_MAX_SIZE; i++) {
+
+		size_t r = test_rand(state) % rate;
+
+		if(r == 0) {
+			continue;
+		}
+		if(r == 1 && m + 1 < TEST_MAX_SIZE) {
+			b[m++] = " \n\tx"[test_rand(state) % 4];
+		}
+
+		b[m++] = r == 2 ? "abA\n"[test_rand(state) % 4] : a[i];
+	}
+
+	*la = n;
+	*lb = m;
+}
+
+static void test_record(void *arg, const struct mydiff_record *rec)
+{
+	(void) fprintf(arg, "Zeile: %lu Zeichen: %lu\n", rec->line, rec->count);
+}
+
+/*
+* The inputs are fed in random pieces (empty ones as well) out of scratch buffers, that are overwritten after each call.
+* A small lag makes the buffers grow now and then. The records have to match what compare_lines prints
+*/
+int mydiff_self_test(void)
+{
+	static char a[TEST_MAX_SIZE], b[TEST_MAX_SIZE], piece_a[TEST_MAX_SIZE], piece_b[TEST_MAX_SIZE];
+	uint32_t state = 2463534242u;
+	int flags, ret = 0;
+
+	for(flags = 0; flags < 4 && ret == 0; flags++) {
+
+		size_t i;
+
+		(void) mismatch_init((flags & MYDIFF_ICASE ? MISMATCH_ICASE : 0) | (flags & MYDIFF_SPACE ? MISMATCH_SPACE : 0));
+
+		for(i = 0; i < TEST_ROUNDS && ret == 0; i++) {
+
+			char *want = NULL, *got = NULL;
+			size_t want_len = 0, got_len = 0, la, lb, fa = 0, fb = 0;
+			const char *c1 = a, *c2 = b;
+			struct mydiff *d = NULL;
+			FILE *f;
+
+			test_inputs(a, &la, b, &lb, &state);
+
+			if((f = open_memstream(&want, &want_len)) != NULL) {
+				(void) compare_lines(f, &c1, a + la, &c2, b + lb, 1, ULONG_MAX);
+				(void) fclose(f);
+			}
+
+			if((f = open_memstream(&got, &got_len)) != NULL && (d = mydiff_new(flags, 1 + test_rand(&state) % 64, test_record, f)) != NULL) {
+
+				while(fa < la || fb < lb) {
+
+					size_t na = test_rand(&state) % 512, nb = test_rand(&state) % 512;
+
+					na = na > la - fa ? la - fa : na;
+					nb = nb > lb - fb ? lb - fb : nb;
+
+					memcpy(piece_a, a + fa, na);
+					memcpy(piece_b, b + fb, nb);
+
+					if(mydiff_feed(d, piece_a, na, piece_b, nb) == -1) {
+						break;
+					}
+
+					memset(piece_a, '?', na);
+					memset(piece_b, '?', nb);
+					fa += na;
+					fb += nb;
+				}
+
+				mydiff_finish(d);
+			}
+
+			if(f != NULL) {
+				(void) fclose(f);
+			}
+
+			if(want == NULL || got == NULL || d == NULL || want_len != got_len || memcmp(want, got, want_len) != 0) {
+				(void) fprintf(stdout, "comparator (flags %d): FAILED (sizes %lu and %lu)\n", flags, (unsigned long) la, (unsigned long) lb);
+				ret = -1;
+			}
+
+			mydiff_free(d);
+			free(want);
+			free(got);
+		}
+	}
+
+	if(ret == 0) {
+		(void) fprintf(stdout, "comparator: ok\n");
+	}
+
+	return ret;
+}
@@ -0,0 +1,656 @@
+/**
+* @file compare.c
+* @brief compare two inputs line by line, char by char. Optionally splits the inputs into ranges of lines that are compared on several threads,
+* or compares streams while they are being read
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include "compare.h"
+#include "reader.h"
+#include "uring.h"
+#include "mismatch.h"
+#include "workpool.h"
+#include "lines.h"
+#include "distance.h"
+#include "stats.h"
+#include "utf8.h"
+
+/* === Constants === */
+
+/** Size of the blocks newlines are counted in by the pre-pass */
+#define COUNT_BLOCK (1 << 20)
+
+/** Number of line ranges per thread. More ranges balance the load better, if some parts of the files are slower to compare */
+#define RANGES_PER_JOB 8
+
+/** Size of the steps equal bytes are scanned in by compare_scanned, their newlines are counted while they are still cached */
+#define SCAN_BLOCK (1 << 16)
+
+/* === Structures === */
+
+/**
+* @brief an input as seen by the parallel comparison
+*/
+struct side {
+
+	const char *data; /**< first char of the input */
+	size_t size; /**< number of chars in data */
+	size_t nblocks; /**< number of COUNT_BLOCK sized blocks (the last one may be shorter) */
+	size_t *prefix; /**< prefix[i] is the number of newlines in the blocks in front of block i (nblocks + 1 entries) */
+
+};
+
+/**
+* @brief output of a range of lines
+*/
+struct range {
+
+	char *buf; /**< the range's output */
+	size_t len; /**< length of the output */
+	int failed; /**< nonzero if the output buffer could not be allocated */
+
+};
+
+/**
+* @brief state shared by all tasks of a parallel comparison
+*/
+struct parallel {
+
+	struct side a; /**< first input */
+	struct side b; /**< second input */
+	unsigned long nlines; /**< number of line pairs to compare */
+	size_t nranges; /**< number of ranges the line pairs are split into */
+	struct range *ranges; /**< output per range */
+
+};
+
+/* === Implementation === */
+
+unsigned long compare_lines(FILE *out, const char **c1, const char *e1, const char **c2, const char *e2, unsigned long line, unsigned long nlines)
+{
+	const char *p1 = *c1, *p2 = *c2;
+	unsigned long done = 0, slow = 0;
+
+	/* if one of the files reaches EOF, quit comparing */
+	for(; done < nlines && p1 < e1 && p2 < e2; done++) {
+
+		size_t stop1, stop2;
+
+		/* count mismatching chars up to the end of the shorter line */
+		unsigned long n = count_mismatch(p1, (size_t) (e1 - p1), p2, (size_t) (e2 - p2), &stop1, &stop2);
+
+		if(n) {
+			(void) fprintf(out, "Zeile: %lu Zeichen: %lu\n", line + done, n);
+			slow++;
+		}
+
+		/* skip what's left of both lines, the longer one has not been looked at completely */
+		p1 = next_line(p1 + stop1, e1);
+		p2 = next_line(p2 + stop2, e2);
+	}
+
+	*c1 = p1;
+	*c2 = p2;
+
+	if(stats_on) {
+		stats_lines(done, slow);
+	}
+
+	return done;
+}
+
+/* count the newlines of a single block. Tasks 0 .. a.nblocks - 1 belong to input a, the rest to input b */
+static void count_task(void *arg, size_t task)
+{
+	struct parallel *p = arg;
+	struct side *s = task < p->a.nblocks ? &p->a : &p->b;
+	size_t block = task < p->a.nblocks ? task : task - p->a.nblocks;
+	size_t offset = block * COUNT_BLOCK;
+	size_t len = s->size - offset < COUNT_BLOCK ? s->size - offset : COUNT_BLOCK;
+
+	s->prefix[block + 1] = count_newlines(s->data + offset, len);
+}
+
+/* number of lines in an input. A last line without '\n' counts as well */
+static unsigned long side_lines(const struct side *s)
+{
+	return (unsigned long) s->prefix[s->nblocks] + (s->size && s->data[s->size - 1] != '\n');
+}
+
+/* find the start of line number line (counting from 0), which has to exist */
+static const char *locate(const struct side *s, unsigned long line)
+{
+	const char *p, *end = s->data + s->size;
+	size_t lo = 0, hi = s->nblocks - 1, skip;
+
+	if(line == 0) {
+		return s->data;
+	}
+
+	/* the line starts right after newline number line - 1: find the last block starting in front of it */
+	while(lo < hi) {
+
+		size_t mid = (lo + hi + 1) / 2;
+
+		if(s->prefix[mid] <= line - 1) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	p = s->data + lo * COUNT_BLOCK;
+
+	for(skip = line - 1 - s->prefix[lo]; ; skip--) {
+
+		p = memchr(p, '\n', (size_t) (end - p));
+
+		if(skip == 0) {
+			return p + 1;
+		}
+
+		p++;
+	}
+}
+
+/* compare a range of lines into a memory stream */
+static void range_task(void *arg, size_t task)
+{
+	struct parallel *p = arg;
+	struct range *r = &p->ranges[task];
+	unsigned long first = (unsigned long) ((unsigned long long) p->nlines * task / p->nranges);
+	unsigned long last = (unsigned long) ((unsigned long long) p->nlines * (task + 1) / p->nranges);
+	const char *c1 = locate(&p->a, first), *c2 = locate(&p->b, first);
+	FILE *out;
+
+	if((out = open_memstream(&r->buf, &r->len)) == NULL) {
+		r->failed = 1;
+		return;
+	}
+
+	(void) compare_lines(out, &c1, p->a.data + p->a.size, &c2, p->b.data + p->b.size, first + 1, last - first);
+
+	if(fclose(out) != 0) {
+		r->failed = 1;
+	}
+}
+
+/* set up a side for the line counting pre-pass */
+static int side_init(struct side *s, const struct input *in)
+{
+	s->data = in->data;
+	s->size = in->size;
+	s->nblocks = (in->size + COUNT_BLOCK - 1) / COUNT_BLOCK;
+
+	return (s->prefix = calloc(s->nblocks + 1, sizeof(*s->prefix))) == NULL ? -1 : 0;
+}
+
+/*
+* Three steps:
+* count the newlines per block of both inputs (in parallel), so every line can be found quickly.
+* split the line pairs into ranges and compare the ranges (in parallel), each one into its own buffer.
+* print the buffers in order of their ranges, as soon as they are ready.
+*/
+int compare_parallel(FILE *out, const struct input *a, const struct input *b, unsigned int jobs)
+{
+	struct parallel p;
+	struct workpool wp;
+	unsigned long la, lb;
+	size_t i;
+	int ret = 0;
+
+	memset(&p, 0, sizeof(p));
+
+	if(side_init(&p.a, a) == -1 || side_init(&p.b, b) == -1) {
+		ret = -1;
+		goto out;
+	}
+
+	stats_phase(stats_index);
+
+	if(workpool_run(jobs, p.a.nblocks + p.b.nblocks, count_task, &p) == -1) {
+		ret = -1;
+		goto out;
+	}
+
+	for(i = 0; i < p.a.nblocks; i++) {
+		p.a.prefix[i + 1] += p.a.prefix[i];
+	}
+	for(i = 0; i < p.b.nblocks; i++) {
+		p.b.prefix[i + 1] += p.b.prefix[i];
+	}
+
+	/* comparison stops as soon as one of the inputs reaches its end */
+	la = side_lines(&p.a);
+	lb = side_lines(&p.b);
+	p.nlines = la < lb ? la : lb;
+
+	if(p.nlines == 0) {
+		goto out;
+	}
+
+	stats_phase(stats_compare);
+
+	p.nranges = (size_t) jobs * RANGES_PER_JOB;
+	if(p.nranges > p.nlines) {
+		p.nranges = p.nlines;
+	}
+
+	if((p.ranges = calloc(p.nranges, sizeof(*p.ranges))) == NULL) {
+		ret = -1;
+		goto out;
+	}
+
+	if(workpool_start(&wp, jobs, p.nranges, range_task, &p) == -1) {
+		ret = -1;
+		goto out;
+	}
+
+	/* print the ranges in order. Once one failed, the output would have a gap, so just free the rest */
+	for(i = 0; i < p.nranges; i++) {
+
+		workpool_wait(&wp, i);
+
+		if(p.ranges[i].failed) {
+			ret = -1;
+		}
+
+		if(ret == 0 && p.ranges[i].len) {
+			(void) fwrite(p.ranges[i].buf, 1, p.ranges[i].len, out);
+		}
+
+		free(p.ranges[i].buf);
+		p.ranges[i].buf = NULL;
+	}
+
+	workpool_join(&wp);
+
+out:
+	free(p.ranges);
+	free(p.a.prefix);
+	free(p.b.prefix);
+
+	return ret;
+}
+
+/**
+* @brief where compare_streams gets the blocks of an input from
+*/
+struct source {
+
+	const struct input *in; /**< the input */
+	struct reader *r; /**< reader of a stream, NULL for mapped inputs */
+	struct uring *u; /**< io_uring reader of a mapped input, NULL if its mapping is used */
+	int done; /**< nonzero once a mapped input has been handed out */
+	unsigned long long bytes; /**< number of bytes handed out */
+
+};
+
+/* a mapped input is a single block, streams and inputs read through io_uring hand out a block of whole lines at a time */
+static int next_block(struct source *s, const char **p, const char **end)
+{
+	const char *data;
+	size_t len;
+	int ret;
+
+	if(s->u != NULL) {
+		ret = uring_next(s->u, &data, &len);
+	} else if(s->r != NULL) {
+		ret = reader_next(s->r, &data, &len);
+	} else {
+
+		if(s->done) {
+			return 0;
+		}
+
+		s->done = 1;
+		data = s->in->data;
+		len = s->in->size;
+		ret = len ? 1 : 0;
+	}
+
+	if(ret == 1) {
+		*p = data;
+		*end = data + len;
+		s->bytes += len;
+	}
+
+	return ret;
+}
+
+/* both sources get started before the first block is waited for, so reads on both inputs are in flight from the start */
+static int start_source(struct source *s, int flags)
+{
+	const struct input *in = s->in;
+
+	if(in->kind == input_mapped && (flags & STREAMS_URING)) {
+
+		if((s->u = uring_start(in->fd, in->size)) != NULL) {
+			return 0;
+		}
+
+		/* no io_uring here, the plain read path gets the same job done */
+		return (s->r = reader_start(in->fd)) == NULL ? -1 : 0;
+	}
+
+	if(in->kind == input_stream) {
+		return (s->r = reader_start(in->fd)) == NULL ? -1 : 0;
+	}
+
+	return 0;
+}
+
+/* blocks end at line boundaries, so compare_lines stops exactly at the end of a line pair whenever it runs out of a block */
+int compare_streams(FILE *out, const struct input *a, const struct input *b, int flags)
+{
+	struct source sa = { a, NULL, NULL, 0, 0 }, sb = { b, NULL, NULL, 0, 0 };
+	const char *p1 = "", *e1 = p1, *p2 = "", *e2 = p2;
+	unsigned long line = 1;
+	int ret = 0, err = 0;
+
+	if(start_source(&sa, flags) == -1 || start_source(&sb, flags) == -1) {
+		ret = -1;
+		err = ENOMEM;
+		goto out;
+	}
+
+	for(;;) {
+
+		/* time spent waiting for the next block is reading, not comparing */
+		if(stats_on) {
+			stats_phase(stats_read);
+		}
+
+		if(p1 == e1 && (ret = next_block(&sa, &p1, &e1)) != 1) {
+			break;
+		}
+
+		if(p2 == e2 && (ret = next_block(&sb, &p2, &e2)) != 1) {
+			break;
+		}
+
+		if(stats_on) {
+			stats_phase(stats_compare);
+		}
+
+		line += compare_lines(out, &p1, e1, &p2, e2, line, ULONG_MAX);
+	}
+
+	err = errno;
+
+	if(stats_on) {
+		stats_input(a->name, sa.bytes);
+		stats_input(b->name, sb.bytes);
+	}
+
+out:
+	if(sa.r) {
+		reader_stop(sa.r);
+	}
+	if(sb.r) {
+		reader_stop(sb.r);
+	}
+	if(sa.u) {
+		uring_stop(sa.u);
+	}
+	if(sb.u) {
+		uring_stop(sb.u);
+	}
+
+	errno = err;
+	return ret == -1 ? -1 : 0;
+}
+
+void hashed_print(FILE *out, unsigned long line, unsigned long value, hashed_report_t report)
+{
+	if(report == hashed_line) {
+		(void) fprintf(out, "Zeile: %lu\n", line);
+	} else if(report == hashed_distance) {
+		(void) fprintf(out, "Zeile: %lu Distanz: %lu\n", line, value);
+	} else {
+		(void) fprintf(out, "Zeile: %lu Zeichen: %lu\n", line, value);
+	}
+}
+
+/*
+* print what report says for a pair of differing lines, its count or distance goes to *value.
+* Returns 1 if something was printed, 0 if the chars turned out to be equal, -1 if memory for their distance could not be allocated
+*/
+static int report_pair(FILE *out, unsigned long line, const char *p1, size_t len1, const char *p2, size_t len2, hashed_report_t report, unsigned long *value)
+{
+	size_t stop1, stop2;
+
+	*value = 0;
+
+	if(report == hashed_distance) {
+
+		size_t d = line_distance(p1, len1, p2, len2);
+
+		if(d == DISTANCE_NOMEM) {
+			return -1;
+		}
+		*value = (unsigned long) d;
+
+	} else if(report == hashed_chars) {
+		*value = count_mismatch(p1, len1, p2, len2, &stop1, &stop2);
+	}
+
+	if(report != hashed_line && *value == 0) {
+		return 0;
+	}
+
+	hashed_print(out, line, *value, report);
+	return 1;
+}
+
+/* number of chars of the line from start up to next (as returned by next_line), without its '\n' */
+static size_t line_len(const char *start, const char *next)
+{
+	return (size_t) (next - start) - (next > start && next[-1] == '\n');
+}
+
+/*
+* Both inputs are scanned in step from the start of a line pair, equal lines are passed over at the speed of the scan kernel.
+* A differing byte belongs to the pair that is reported: its start is the last '\n' in front of the byte, at most one line back.
+*/
+int compare_scanned(FILE *out, const struct input *a, const struct input *b, hashed_report_t report)
+{
+	const char *p1 = a->data, *e1 = a->data + a->size, *p2 = b->data, *e2 = b->data + b->size;
+	/* start of the first line pair passed by the current scan */
+	const char *l1 = p1;
+	unsigned long line = 0, slow = 0, value;
+	int ret = 0;
+
+	/* if one of the files reaches EOF, quit comparing */
+	while(p1 < e1 && p2 < e2) {
+
+		size_t n = (size_t) (e1 - p1) < (size_t) (e2 - p2) ? (size_t) (e1 - p1) : (size_t) (e2 - p2);
+		size_t chunk = n < SCAN_BLOCK ? n : SCAN_BLOCK;
+		size_t d = scan_bytes(p1, p2, chunk, 1);
+		const char *s1, *s2, *n1, *n2;
+
+		/* every newline in front of the differing byte ends a pair of equal lines */
+		line += count_newlines(p1, d);
+		p1 += d;
+		p2 += d;
+
+		if(d == chunk) {
+
+			if(chunk < n) {
+				continue;
+			}
+
+			/* one input ended within equal bytes. Its last line, if it lacks the '\n', pairs with a line of the other one */
+			if(p1 == l1 || p1[-1] == '\n' || ((p1 == e1 || *p1 == '\n') && (p2 == e2 || *p2 == '\n'))) {
+				line += p1 != l1 && p1[-1] != '\n';
+				break;
+			}
+		}
+
+		/* the pair holding the differing byte (or the longer of two last lines) */
+		for(s1 = p1; s1 > l1 && s1[-1] != '\n'; s1--);
+		s2 = p2 - (p1 - s1);
+		n1 = next_line(p1, e1);
+		n2 = next_line(p2, e2);
+
+		if(report_pair(out, line + 1, s1, line_len(s1, n1), s2, line_len(s2, n2), report, &value) == -1) {
+			ret = -1;
+			break;
+		}
+
+		slow++;
+		line++;
+		p1 = l1 = n1;
+		p2 = n2;
+	}
+
+	if(stats_on) {
+		stats_lines(line, slow);
+	}
+
+	return ret;
+}
+
+long compare_hashed_range(FILE *out, const struct lines *la, const struct lines *lb, size_t from, size_t to, hashed_report_t report, struct hashed_result *res)
+{
+	size_t i;
+	long slow = 0;
+
+	for(i = from; i < to; i++) {
+
+		size_t len1 = LINE_LEN(la, i), len2 = LINE_LEN(lb, i);
+		unsigned long value;
+		int r;
+
+		/* a hash match is confirmed byte by byte, like line_equal does for the alignment */
+		if(la->hash[i] == lb->hash[i] && len1 == len2 && memcmp(LINE_PTR(la, i), LINE_PTR(lb, i), len1) == 0) {
+			continue;
+		}
+
+		slow++;
+
+		if((r = report_pair(out, (unsigned long) (i + 1), LINE_PTR(la, i), len1, LINE_PTR(lb, i), len2, report, &value)) == -1) {
+			return -1;
+		}
+
+		if(r == 1 && res != NULL && hashed_result_add(res, i, value) == -1) {
+			return -1;
+		}
+	}
+
+	return slow;
+}
+
+int compare_hashed_index(FILE *out, const struct lines *la, const struct lines *lb, hashed_report_t report)
+{
+	size_t n = la->n < lb->n ? la->n : lb->n;
+	long slow = compare_hashed_range(out, la, lb, 0, n, report, NULL);
+
+	if(stats_on && slow != -1) {
+		stats_lines((unsigned long) n, (unsigned long) slow);
+	}
+
+	return slow == -1 ? -1 : 0;
+}
+
+int hashed_result_add(struct hashed_result *res, size_t line, unsigned long value)
+{
+	if(res->n == res->cap) {
+
+		size_t cap = res->cap ? 2 * res->cap : 1024;
+		struct hashed_entry *e;
+
+		if((e = realloc(res->e, cap * sizeof(*e))) == NULL) {
+			return -1;
+		}
+
+		res->e = e;
+		res->cap = cap;
+	}
+
+	res->e[res->n].line = line;
+	res->e[res->n].value = value;
+	res->n++;
+
+	return 0;
+}
+
+/* the lines of a are known already, only b has to be searched for line ends */
+unsigned long compare_indexed(FILE *out, const struct lines *la, const struct input *b)
+{
+	const char *p = b->data, *end = b->data + b->size;
+	unsigned long slow = 0;
+	size_t i;
+
+	for(i = 0; i < la->n && p < end; i++) {
+
+		size_t stop1, stop2;
+		unsigned long n = count_mismatch(LINE_PTR(la, i), LINE_LEN(la, i), p, (size_t) (end - p), &stop1, &stop2);
+
+		if(n) {
+			(void) fprintf(out, "Zeile: %lu Zeichen: %lu\n", (unsigned long) (i + 1), n);
+			slow++;
+		}
+
+		p = next_line(p + stop2, end);
+	}
+
+	if(stats_on) {
+		stats_lines((unsigned long) i, slow);
+	}
+
+	return (unsigned long) i;
+}
+
+/* the part of a line the kernel didn't look at, from stop up to the line end, is checked on its own */
+static int rest_valid(const char *stop, const char *next)
+{
+	const char *eol = next > stop && next[-1] == '\n' ? next - 1 : next;
+
+	return eol <= stop || utf8_valid(stop, (size_t) (eol - stop));
+}
+
+unsigned long compare_utf8(FILE *out, const struct input *a, const struct input *b)
+{
+	const char *p1 = a->data, *e1 = a->data + a->size, *p2 = b->data, *e2 = b->data + b->size;
+	unsigned long line = 0, slow = 0;
+
+	/* if one of the files reaches EOF, quit comparing */
+	for(; p1 < e1 && p2 < e2; line++) {
+
+		size_t stop1, stop2;
+		int invalid;
+		size_t n = count_utf8(p1, (size_t) (e1 - p1), p2, (size_t) (e2 - p2), &stop1, &stop2, &invalid);
+		const char *n1 = next_line(p1 + stop1, e1), *n2 = next_line(p2 + stop2, e2);
+
+		if(!rest_valid(p1 + stop1, n1)) {
+			invalid |= UTF8_INVALID_A;
+		}
+		if(!rest_valid(p2 + stop2, n2)) {
+			invalid |= UTF8_INVALID_B;
+		}
+
+		if(n) {
+			(void) fprintf(out, "Zeile: %lu Zeichen: %lu\n", line + 1, (unsigned long) n);
+		}
+		if(invalid & UTF8_INVALID_A) {
+			(void) fprintf(out, "Zeile: %lu Ungültiges UTF-8: %s\n", line + 1, a->name);
+		}
+		if(invalid & UTF8_INVALID_B) {
+			(void) fprintf(out, "Zeile: %lu Ungültiges UTF-8: %s\n", line + 1, b->name);
+		}
+
+		slow += n || invalid;
+		p1 = n1;
+		p2 = n2;
+	}
+
+	if(stats_on) {
+		stats_lines(line, slow);
+	}
+
+	return line;
+}
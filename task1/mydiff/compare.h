@@ -0,0 +1,182 @@
+/**
+* @file compare.h
+* @brief header file for mydiff's line by line comparison (sequential and multi-threaded)
+*/
+
+#ifndef COMPARE_H
+#define COMPARE_H
+#include <stdio.h> //needed for FILE
+#include <stdint.h> //needed for uint64_t
+#include "input.h"
+#include "lines.h"
+
+/**
+* @brief what compare_scanned and compare_hashed_index print for a pair of differing lines
+*/
+typedef enum {
+	hashed_chars, /**< "Zeile: LINENO Zeichen: COUNT" if positional mismatches are found, like compare_lines */
+	hashed_line, /**< "Zeile: LINENO", no chars are compared */
+	hashed_distance /**< "Zeile: LINENO Distanz: DISTANCE", the Levenshtein distance of the lines (see distance.h) */
+} hashed_report_t;
+
+/**
+* @brief a pair of lines printed by compare_hashed_range
+*/
+struct hashed_entry {
+
+	uint64_t line; /**< index of the lines (from 0) */
+	uint64_t value; /**< count or distance printed with it, 0 for hashed_line */
+
+};
+
+/**
+* @brief the pairs printed by a comparison, in the order of their lines
+*/
+struct hashed_result {
+
+	struct hashed_entry *e; /**< the pairs */
+	size_t n; /**< number of pairs */
+	size_t cap; /**< room in e */
+
+};
+
+/**
+* @brief compare line pairs positionally and print "Zeile: LINENO Zeichen: COUNT" for every pair with mismatching chars.
+* Stops after nlines pairs or when one of the inputs reaches its end
+*
+* @param out stream to print the mismatches to
+* @param c1 position of the first line in input 1, advanced past the last compared line
+* @param e1 end of input 1
+* @param c2 position of the first line in input 2, advanced past the last compared line
+* @param e2 end of input 2
+* @param line number of the first line pair (used for printing only)
+* @param nlines maximum number of line pairs to compare
+*
+* @return number of compared line pairs
+*/
+unsigned long compare_lines(FILE *out, const char **c1, const char *e1, const char **c2, const char *e2, unsigned long line, unsigned long nlines);
+
+/**
+* @brief compare two inputs like compare_lines does, on jobs threads. Output is exactly the same as the one of compare_lines
+*
+* @param out stream to print the mismatches to
+* @param a first input
+* @param b second input
+* @param jobs number of threads to use
+*
+* @return 0 on success, -1 if memory or threads could not be allocated
+*/
+int compare_parallel(FILE *out, const struct input *a, const struct input *b, unsigned int jobs);
+
+/**
+* @brief flag for compare_streams: read mapped inputs through io_uring (see uring.h) instead of touching their mappings
+*/
+#define STREAMS_URING 1
+
+/**
+* @brief compare two inputs like compare_lines does, where at least one is a stream. Streams are read on separate threads
+* (see reader.h) while the lines read so far get compared. Output is exactly the same as the one of compare_lines.
+* With STREAMS_URING mapped inputs are read as well, with several reads in flight on each. If io_uring is not available,
+* they are read like streams
+*
+* @param out stream to print the mismatches to
+* @param a first input (mapped or stream)
+* @param b second input (mapped or stream)
+* @param flags STREAMS_URING or 0
+*
+* @return 0 on success, -1 on read errors (errno is set)
+*/
+int compare_streams(FILE *out, const struct input *a, const struct input *b, int flags);
+
+/**
+* @brief compare two inputs line by line, passing over equal lines in one pass: the scan kernel runs over both inputs in step
+* up to the first differing byte, while the newlines it passed are counted. Only the pair holding that byte is compared char by char,
+* which gives the same output as compare_lines. Pairs differ if their bytes do, as if their hashes were compared
+* without collisions. No line index is built, and it runs on one thread
+*
+* @param out stream to print the mismatches to
+* @param a first input
+* @param b second input
+* @param report what to print for a pair of differing lines
+*
+* @return 0 on success, -1 if memory for the distance of a long line could not be allocated
+*/
+int compare_scanned(FILE *out, const struct input *a, const struct input *b, hashed_report_t report);
+
+/**
+* @brief compare hashed line pairs of inputs that are indexed already, so an index can be compared against several others.
+* Pairs with equal hashes are confirmed with memcmp, a hash collision can't hide a differing pair
+*
+* @param out stream to print the mismatches to
+* @param la index of the first input (with hashes)
+* @param lb index of the second input (with hashes)
+* @param report what to print for a pair of differing lines
+*
+* @return 0 on success, -1 if memory for the distance of a long line could not be allocated
+*/
+int compare_hashed_index(FILE *out, const struct lines *la, const struct lines *lb, hashed_report_t report);
+
+/**
+* @brief compare_hashed_index for the line pairs from .. to - 1 only.
+* The printed pairs can be recorded, to print them again later with hashed_print
+*
+* @param out stream to print the mismatches to
+* @param la index of the first input (with hashes, at least to lines)
+* @param lb index of the second input (with hashes, at least to lines)
+* @param from index of the first pair to compare
+* @param to index of the pair to stop at
+* @param report what to print for a pair of differing lines
+* @param res receives the printed pairs (appended), NULL if they are not needed
+*
+* @return number of differing pairs, -1 if memory for a distance or for res could not be allocated
+*/
+long compare_hashed_range(FILE *out, const struct lines *la, const struct lines *lb, size_t from, size_t to, hashed_report_t report, struct hashed_result *res);
+
+/**
+* @brief print a pair of differing lines like compare_hashed_index does
+*
+* @param out stream to print to
+* @param line number of the lines (from 1)
+* @param value count or distance to print, ignored for hashed_line
+* @param report what to print
+*/
+void hashed_print(FILE *out, unsigned long line, unsigned long value, hashed_report_t report);
+
+/**
+* @brief append a printed pair to a result
+*
+* @param res result to add to, start with all members 0 and free e when done
+* @param line index of the lines (from 0)
+* @param value count or distance printed with it
+*
+* @return 0 on success, -1 if memory could not be allocated
+*/
+int hashed_result_add(struct hashed_result *res, size_t line, unsigned long value);
+
+/**
+* @brief compare_lines with an index of the first input, so it doesn't have to be searched for line ends again.
+* Output is exactly the same as the one of compare_lines
+*
+* @param out stream to print the mismatches to
+* @param la index of the first input (hashes are not needed)
+* @param b second input (in memory)
+*
+* @return number of compared line pairs
+*/
+unsigned long compare_indexed(FILE *out, const struct lines *la, const struct input *b);
+
+/**
+* @brief compare line pairs positionally by code points with count_utf8 (see utf8.h), which utf8_init has to have selected.
+* Prints "Zeile: LINENO Zeichen: COUNT" for every pair with mismatching code points, then
+* "Zeile: LINENO Ungültiges UTF-8: NAME" for each line of the pair that holds an invalid sequence.
+* The part of the longer line beyond the end of the shorter one is checked for invalid sequences, but not compared
+*
+* @param out stream to print the mismatches to
+* @param a first input (in memory)
+* @param b second input (in memory)
+*
+* @return number of compared line pairs
+*/
+unsigned long compare_utf8(FILE *out, const struct input *a, const struct input *b);
+
+#endif
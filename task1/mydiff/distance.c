@@ -0,0 +1,259 @@
+/**
+* @file distance.c
+* @brief Levenshtein distance of two lines with Myers' bit-parallel algorithm ("A fast bit-vector algorithm for approximate string matching
+* based on dynamic programming", 1999). The vertical differences of a whole column of the dynamic programming matrix are kept in two words,
+* so one text char costs a handful of word operations per 64 chars of the pattern (the shorter line)
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "distance.h"
+#include "mismatch.h"
+
+/* === Implementation === */
+
+/*
+* Advance one block of 64 rows by one column.
+* pv / mv mark the rows whose value is one more / one less than the row above, hin is the difference of the row above the block
+* between this column and the previous one (+1, 0, -1). out selects the row whose horizontal difference is returned, the last one of the block.
+*/
+static inline int advance(uint64_t *pv_, uint64_t *mv_, uint64_t eq, int hin, uint64_t out)
+{
+	uint64_t pv = *pv_, mv = *mv_, xv, xh, ph, mh;
+	int hout = 0;
+
+	xv = eq | mv;
+	if(hin < 0) {
+		eq |= 1;
+	}
+	xh = (((eq & pv) + pv) ^ pv) | eq;
+	ph = mv | ~(xh | pv);
+	mh = pv & xh;
+
+	if(ph & out) {
+		hout = 1;
+	} else if(mh & out) {
+		hout = -1;
+	}
+
+	ph <<= 1;
+	mh <<= 1;
+	if(hin < 0) {
+		mh |= 1;
+	} else if(hin > 0) {
+		ph |= 1;
+	}
+
+	*pv_ = mh | ~(xv | ph);
+	*mv_ = ph & xv;
+
+	return hout;
+}
+
+/* pattern p of 1 to 64 chars: a single word, the match table lives on the stack */
+static size_t distance_word(const unsigned char *p, size_t m, const unsigned char *t, size_t n)
+{
+	uint64_t peq[256], pv = ~(uint64_t) 0, mv = 0, last = (uint64_t) 1 << (m - 1);
+	size_t i, score = m;
+
+	memset(peq, 0, sizeof(peq));
+	for(i = 0; i < m; i++) {
+		peq[p[i]] |= (uint64_t) 1 << i;
+	}
+
+	/* row 0 is the distance to an empty pattern, it grows by one per column */
+	for(i = 0; i < n; i++) {
+		score += advance(&pv, &mv, peq[t[i]], 1, last);
+	}
+
+	return score;
+}
+
+/*
+* pattern p of more than 64 chars: one word per 64 chars, the blocks of a column are advanced top down, each one passing its
+* last row's horizontal difference to the next. Only chars that occur in p get a row of the match table, the others share row 0
+*/
+static size_t distance_blocked(const unsigned char *p, size_t m, const unsigned char *t, size_t n)
+{
+	unsigned short row[256];
+	size_t nb = (m + 63) / 64, nrows = 1, i, k, score = m;
+	uint64_t *peq, *pv, *mv, last = (uint64_t) 1 << ((m - 1) % 64), top = (uint64_t) 1 << 63;
+
+	memset(row, 0, sizeof(row));
+	for(i = 0; i < m; i++) {
+		if(row[p[i]] == 0) {
+			row[p[i]] = (unsigned short) nrows++;
+		}
+	}
+
+	if((peq = calloc((nrows + 2) * nb, sizeof(*peq))) == NULL) {
+		return DISTANCE_NOMEM;
+	}
+
+	pv = peq + nrows * nb;
+	mv = pv + nb;
+
+	for(i = 0; i < m; i++) {
+		peq[row[p[i]] * nb + i / 64] |= (uint64_t) 1 << (i % 64);
+	}
+	for(k = 0; k < nb; k++) {
+		pv[k] = ~(uint64_t) 0;
+	}
+
+	for(i = 0; i < n; i++) {
+
+		const uint64_t *eq = peq + row[t[i]] * nb;
+		int h = 1;
+
+		for(k = 0; k + 1 < nb; k++) {
+			h = advance(&pv[k], &mv[k], eq[k], h, top);
+		}
+
+		score += advance(&pv[k], &mv[k], eq[k], h, last);
+	}
+
+	free(peq);
+	return score;
+}
+
+/* most changed lines differ in a few places only, skipping what they have in common keeps the pattern short */
+size_t line_distance(const char *a, size_t la, const char *b, size_t lb)
+{
+	size_t n = la < lb ? la : lb, head = scan_bytes(a, b, n, 1);
+
+	a += head;
+	b += head;
+	la -= head;
+	lb -= head;
+
+	for(n -= head; n && a[la - 1] == b[lb - 1]; n--) {
+		la--;
+		lb--;
+	}
+
+	/* one of them is empty now, the rest of the other one has to be inserted */
+	if(n == 0) {
+		return la + lb;
+	}
+
+	if(la > lb) {
+
+		const char *s = a;
+		size_t l = la;
+
+		a = b;
+		la = lb;
+		b = s;
+		lb = l;
+	}
+
+	if(la <= 64) {
+		return distance_word((const unsigned char *) a, la, (const unsigned char *) b, lb);
+	}
+
+	return distance_blocked((const unsigned char *) a, la, (const unsigned char *) b, lb);
+}
+
+/* === Self test === */
+
+/** number of random line pairs to check */
+#define TEST_ROUNDS 20000
+/** maximum length of a random test line, several blocks */
+#define TEST_MAX_LEN 300
+
+/* xorshift, we want the same test data on every run */
+static uint32_t test_rand(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/* one row of the dynamic programming matrix at a time */
+static size_t distance_dp(const char *a, size_t la, const char *b, size_t lb)
+{
+	size_t row[TEST_MAX_LEN + 1], i, j;
+
+	for(j = 0; j <= lb; j++) {
+		row[j] = j;
+	}
+
+	for(i = 1; i <= la; i++) {
+
+		size_t diag = row[0];
+
+		row[0] = i;
+
+		for(j = 1; j <= lb; j++) {
+
+			size_t best = diag + (a[i - 1] != b[j - 1]), up = row[j] + 1, left = row[j - 1] + 1;
+
+			if(up < best) {
+				best = up;
+			}
+			if(left < best) {
+				best = left;
+			}
+
+			diag = row[j];
+			row[j] = best;
+		}
+	}
+
+	return row[lb];
+}
+
+/*
+* b is mostly a copy of a with random chars replaced, inserted and deleted. Small alphabets give lots of equal chars,
+* which is where the carries of the bit-parallel additions matter. Random bytes make sure chars above 127 work as well
+*/
+int distance_self_test(void)
+{
+	static const unsigned int alphabets[] = { 2, 4, 26 };
+	static char a[TEST_MAX_LEN], b[TEST_MAX_LEN];
+	uint32_t state = 2463534242u;
+	size_t i;
+
+	for(i = 0; i < TEST_ROUNDS; i++) {
+
+		size_t la = test_rand(&state) % (TEST_MAX_LEN + 1), lb = 0, len = test_rand(&state) % (TEST_MAX_LEN + 1), j, ref, got;
+		unsigned int alphabet = alphabets[test_rand(&state) % 3], any = test_rand(&state) % 8 == 0, fresh = test_rand(&state) % 16 == 0;
+
+		for(j = 0; j < la; j++) {
+			a[j] = any ? (char) test_rand(&state) : (char) ('a' + test_rand(&state) % alphabet);
+		}
+
+		/* now and then a line with nothing in common */
+		for(j = 0; fresh && j < len; j++) {
+			b[lb++] = (char) ('a' + test_rand(&state) % alphabet);
+		}
+
+		for(j = 0; !fresh && j < la && lb < TEST_MAX_LEN; j++) {
+
+			uint32_t r = test_rand(&state) % 64;
+
+			if(r == 0) {
+				continue; /* deleted */
+			}
+			if(r == 1 && lb + 1 < TEST_MAX_LEN) {
+				b[lb++] = (char) ('a' + test_rand(&state) % alphabet); /* inserted */
+			}
+
+			b[lb++] = r == 2 ? (char) ('a' + test_rand(&state) % alphabet) : a[j];
+		}
+
+		ref = distance_dp(a, la, b, lb);
+		got = line_distance(a, la, b, lb);
+
+		if(got != ref || line_distance(b, lb, a, la) != ref) {
+			(void) fprintf(stdout, "distance: FAILED (lengths %lu and %lu: got %lu, expected %lu)\n",
+					(unsigned long) la, (unsigned long) lb, (unsigned long) got, (unsigned long) ref);
+			return -1;
+		}
+	}
+
+	(void) fprintf(stdout, "distance: ok\n");
+	return 0;
+}
@@ -0,0 +1,37 @@
+/**
+* @file distance.h
+* @brief header file for the edit distance of two lines (Myers' bit-parallel algorithm, blocked for long lines)
+*/
+
+#ifndef DISTANCE_H
+#define DISTANCE_H
+#include <stddef.h> //needed for size_t
+
+/**
+* @brief returned by line_distance if the tables for a long line could not be allocated
+*/
+#define DISTANCE_NOMEM ((size_t) -1)
+
+/**
+* @brief Levenshtein distance (inserted, deleted and replaced chars) of two lines.
+* Their common prefix and suffix are skipped, the rest is computed 64 chars of the shorter line per machine word.
+* Lines of more than 64 chars (after skipping) take one word per 64 chars and a table allocated per call
+*
+* @param a chars of the first line
+* @param la number of chars in a
+* @param b chars of the second line
+* @param lb number of chars in b
+*
+* @return the distance, DISTANCE_NOMEM if memory could not be allocated
+*/
+size_t line_distance(const char *a, size_t la, const char *b, size_t lb);
+
+/**
+* @brief check line_distance against the plain dynamic programming solution on random lines
+* of various lengths (spanning several words). Reports on stdout
+*
+* @return 0 if all distances agree, -1 else
+*/
+int distance_self_test(void);
+
+#endif
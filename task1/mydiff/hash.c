@@ -0,0 +1,106 @@
+/**
+* @file hash.c
+* @brief 64 bit hash used to fingerprint lines (xxHash64 algorithm by Yann Collet)
+*/
+#include <string.h>
+#include "hash.h"
+
+/* === Constants === */
+
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+
+/* === Macros === */
+
+/** Rotate x left by r bits */
+#define ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+/* === Implementation === */
+
+/* memcpy compiles to a plain (unaligned) load */
+static uint64_t read64(const char *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t read32(const char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint64_t round64(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME2;
+	acc = ROTL(acc, 31);
+	return acc * PRIME1;
+}
+
+static uint64_t merge64(uint64_t acc, uint64_t val)
+{
+	acc ^= round64(0, val);
+	return acc * PRIME1 + PRIME4;
+}
+
+uint64_t line_hash(const char *p, size_t n)
+{
+	const char *end = p + n;
+	uint64_t h;
+
+	if(n >= 32) {
+
+		/* four independent lanes, so the multiplications can overlap */
+		uint64_t v1 = PRIME1 + PRIME2, v2 = PRIME2, v3 = 0, v4 = -PRIME1;
+
+		for(; p + 32 <= end; p += 32) {
+			v1 = round64(v1, read64(p));
+			v2 = round64(v2, read64(p + 8));
+			v3 = round64(v3, read64(p + 16));
+			v4 = round64(v4, read64(p + 24));
+		}
+
+		h = ROTL(v1, 1) + ROTL(v2, 7) + ROTL(v3, 12) + ROTL(v4, 18);
+		h = merge64(h, v1);
+		h = merge64(h, v2);
+		h = merge64(h, v3);
+		h = merge64(h, v4);
+
+	} else {
+		h = PRIME5;
+	}
+
+	h += (uint64_t) n;
+
+	for(; p + 8 <= end; p += 8) {
+		h ^= round64(0, read64(p));
+		h = ROTL(h, 27) * PRIME1 + PRIME4;
+	}
+
+	if(p + 4 <= end) {
+		h ^= (uint64_t) read32(p) * PRIME1;
+		h = ROTL(h, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+
+	for(; p < end; p++) {
+		h ^= (uint64_t) (unsigned char) *p * PRIME5;
+		h = ROTL(h, 11) * PRIME1;
+	}
+
+	/* final avalanche */
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+
+	return h;
+}
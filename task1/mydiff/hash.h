@@ -0,0 +1,21 @@
+/**
+* @file hash.h
+* @brief header file for the 64 bit hash used to fingerprint lines
+*/
+
+#ifndef HASH_H
+#define HASH_H
+#include <stddef.h> //needed for size_t
+#include <stdint.h>
+
+/**
+* @brief hash a buffer (xxHash64 with seed 0). Reads 32 chars per round, so long lines hash at memory speed
+*
+* @param p first char of the buffer
+* @param n number of chars in the buffer
+*
+* @return 64 bit hash of the buffer
+*/
+uint64_t line_hash(const char *p, size_t n);
+
+#endif
@@ -0,0 +1,176 @@
+/**
+* @file input.c
+* @brief map mydiff's input files into memory, so lines can be compared in place. Streams are opened for reading
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "input.h"
+#include "reader.h"
+
+/* "-" and "/dev/fd/N" name descriptors we already have. They get dup'ed, so closing works the same for all inputs */
+static int open_path(const char *path)
+{
+	char *end;
+	long fd;
+
+	if(strcmp(path, "-") == 0) {
+		return dup(STDIN_FILENO);
+	}
+
+	if(strncmp(path, "/dev/fd/", 8) == 0) {
+
+		fd = strtol(path + 8, &end, 10);
+
+		if(path[8] != '\0' && *end == '\0' && fd >= 0 && fd <= 65535) {
+			return dup((int) fd);
+		}
+	}
+
+	return open(path, O_RDONLY);
+}
+
+/* open path and map it. Anything but non-empty regular files (pipes, but also files in /proc that claim to be empty) is a stream */
+int input_open(struct input *in, const char *path)
+{
+	struct stat st;
+	void *map;
+	int err;
+
+	in->name = path;
+	in->data = "";
+	in->size = 0;
+	in->kind = input_closed;
+
+	if((in->fd = open_path(path)) == -1) {
+		return -1;
+	}
+
+	if(fstat(in->fd, &st) == -1) {
+		goto fail;
+	}
+
+	if(!S_ISREG(st.st_mode) || st.st_size == 0) {
+		in->kind = input_stream;
+		return 0;
+	}
+
+	if((map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, in->fd, 0)) == MAP_FAILED) {
+		goto fail;
+	}
+
+	/* We walk through the file front to back exactly once */
+	(void) madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+
+	in->data = map;
+	in->size = (size_t) st.st_size;
+	in->kind = input_mapped;
+
+	return 0;
+
+fail:
+	/* keep errno of the failing call, close() may overwrite it */
+	err = errno;
+	(void) close(in->fd);
+	in->fd = -1;
+	errno = err;
+	return -1;
+}
+
+/* read straight into a growing arena. realloc moves large blocks by remapping, not by copying */
+int input_load(struct input *in)
+{
+	char *arena = NULL, *grown;
+	size_t cap = 0, size = 0;
+
+	if(in->kind != input_stream) {
+		return 0;
+	}
+
+	for(;;) {
+
+		ssize_t got;
+
+		if(size == cap) {
+
+			cap = cap ? 2 * cap : READER_BLOCK;
+
+			if((grown = realloc(arena, cap)) == NULL) {
+				free(arena);
+				errno = ENOMEM;
+				return -1;
+			}
+
+			arena = grown;
+		}
+
+		if((got = read(in->fd, arena + size, cap - size)) == -1) {
+
+			if(errno == EINTR) {
+				continue;
+			}
+
+			free(arena);
+			return -1;
+		}
+
+		if(got == 0) {
+			break;
+		}
+
+		size += (size_t) got;
+	}
+
+	in->data = size ? arena : "";
+	in->size = size;
+	in->kind = input_loaded;
+
+	if(!size) {
+		free(arena);
+	}
+
+	return 0;
+}
+
+/* a plain memcmp stops at the first difference, there's no need to hash both sides completely */
+int input_equal(const struct input *a, const struct input *b)
+{
+	if(a->kind == input_stream || b->kind == input_stream || a->size != b->size) {
+		return 0;
+	}
+
+	return memcmp(a->data, b->data, a->size) == 0;
+}
+
+void input_close(struct input *in)
+{
+	if(in->kind == input_mapped) {
+		(void) munmap((void *) in->data, in->size);
+	}
+
+	if(in->kind == input_loaded && in->size) {
+		free((void *) in->data);
+	}
+
+	if(in->fd != -1) {
+		(void) close(in->fd);
+	}
+
+	in->fd = -1;
+	in->data = "";
+	in->size = 0;
+	in->kind = input_closed;
+}
+
+/* memchr is way faster than walking char by char */
+const char *next_line(const char *p, const char *end)
+{
+	const char *nl = memchr(p, '\n', (size_t) (end - p));
+
+	return nl ? nl + 1 : end;
+}
@@ -0,0 +1,86 @@
+/**
+* @file input.h
+* @brief header file for mydiff's input handling (files mapped into memory, or streams like pipes and stdin)
+*/
+
+#ifndef INPUT_H
+#define INPUT_H
+#include <stddef.h> //needed for size_t
+
+/**
+* @brief where an input's data comes from
+*/
+typedef enum input_kind {
+	input_closed = 0,
+	input_mapped, /**< regular file, mapped into memory */
+	input_stream, /**< pipe, terminal, ...: data has to be read (by a reader, see reader.h, or input_load) */
+	input_loaded /**< stream read into memory completely by input_load */
+} input_kind_t;
+
+/**
+* @brief an input file
+*/
+struct input {
+
+	const char *name; /**< path as given on the command line */
+	int fd; /**< file descriptor, -1 if not open */
+	const char *data; /**< first byte of the file's contents (empty for streams, until loaded) */
+	size_t size; /**< number of bytes in data */
+	input_kind_t kind; /**< where data comes from */
+
+};
+
+/**
+* @brief initializer for a closed input
+*/
+#define INPUT_INIT { NULL, -1, "", 0, input_closed }
+
+/**
+* @brief open an input and map its whole content into memory if it is a regular file.
+* "-" stands for stdin, "/dev/fd/N" for the already open file descriptor N
+*
+* @param in input to initialize
+* @param path path of the file to open
+*
+* @return 0 on success, -1 else (errno is set)
+*/
+int input_open(struct input *in, const char *path);
+
+/**
+* @brief read a stream input completely into memory with large read(2) calls, so it can be accessed like a mapped one.
+* Does nothing for mapped inputs
+*
+* @param in input to load
+*
+* @return 0 on success, -1 else (errno is set)
+*/
+int input_load(struct input *in);
+
+/**
+* @brief check if two inputs have the same contents. Streams have to be loaded first, they never compare equal
+*
+* @param a first input
+* @param b second input
+*
+* @return nonzero if both inputs are in memory and their contents are equal, 0 else
+*/
+int input_equal(const struct input *a, const struct input *b);
+
+/**
+* @brief unmap and close an input previously opened by input_open. Calling it on a closed input is a no-op
+*
+* @param in input to close
+*/
+void input_close(struct input *in);
+
+/**
+* @brief find the start of the line following the one p points into
+*
+* @param p position within a line
+* @param end first byte past the data
+*
+* @return pointer to the first char after the next '\n', or end if there is none
+*/
+const char *next_line(const char *p, const char *end);
+
+#endif
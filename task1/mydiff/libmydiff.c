@@ -0,0 +1,631 @@
+/**
+* @file libmydiff.c
+* @brief what mydiff does, as a library call: checks the options, picks the comparison they ask for and runs it
+* on two files, two directory trees or a reference and its candidates
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "libmydiff.h"
+#include "input.h"
+#include "mismatch.h"
+#include "compare.h"
+#include "myers.h"
+#include "tree.h"
+#include "binary.h"
+#include "multi.h"
+#include "lines.h"
+#include "sidecar.h"
+#include "bitmap.h"
+#include "moved.h"
+#include "stats.h"
+#include "cluster.h"
+#include "utf8.h"
+
+/* === Constants === */
+
+/** Bytes of each input fed to the streaming comparator at once by -B */
+#define BITMAP_FEED (1 << 20)
+
+/* === Structures === */
+
+/**
+* @brief state of a run, shared by the callbacks of the directory and the one to many mode
+*/
+struct run {
+
+	const struct mydiff_options *o; /**< the options */
+	struct input ref; /**< first file, the reference in one to many mode */
+	struct lines lines; /**< line index of the reference in one to many mode, shared by all candidates */
+
+};
+
+/**
+* @brief where the streaming comparator of -B puts its records
+*/
+struct bitmap_sink {
+
+	struct bitmap_writer *w; /**< the bitmap */
+	unsigned long records; /**< number of records added */
+
+};
+
+/* === Implementation === */
+
+/* read a stream input into memory. Reports errors on stderr */
+static int load_input(const struct mydiff_options *o, struct input *in)
+{
+	if(input_load(in) == -1) {
+		(void) fprintf(stderr, "%s: Datei '%s' konnte nicht gelesen werden (%s)!\n", o->name, in->name, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* open and map a file. Reports errors on stderr */
+static int open_input(const struct mydiff_options *o, struct input *in, const char *path)
+{
+	if(input_open(in, path) == -1) {
+
+		if(errno != 0) {
+			(void) fprintf(stderr, "%s: Datei '%s' konnte nicht geöffnet werden (%s)!\n", o->name, path, strerror(errno));
+		} else {
+			(void) fprintf(stderr, "%s: Datei '%s' konnte nicht geöffnet werden!\n", o->name, path);
+		}
+
+		return -1;
+	}
+
+	return 0;
+}
+
+static int is_dir(const char *path)
+{
+	struct stat st;
+
+	return strcmp(path, "-") != 0 && stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/* what the hashed comparison prints for differing lines, as chosen by --hash-only and -e */
+static hashed_report_t hashed_report(const struct mydiff_options *o)
+{
+	return o->distance ? hashed_distance : o->hash == 2 ? hashed_line : hashed_chars;
+}
+
+/* compare two opened inputs by the line indexes kept in their sidecars (see sidecar.h) */
+static int compare_cached(FILE *out, const struct mydiff_options *o, struct input *a, struct input *b, unsigned int jobs)
+{
+
+	struct lines la, lb;
+	struct sidecar_change ca, cb;
+	int ret = -1;
+
+	la.off = lb.off = NULL;
+	la.hash = lb.hash = NULL;
+
+	stats_phase(stats_index);
+
+	if(lines_cached(&la, a, jobs, &ca) == 0 && lines_cached(&lb, b, jobs, &cb) == 0) {
+
+		stats_phase(stats_compare);
+
+		if(o->align) {
+			ret = compare_aligned_index(out, &la, &lb);
+		} else {
+			/* only the pairs with changed lines are compared, the others are printed like last time */
+			ret = compare_cached_hashed(out, a, &la, &ca, &lb, &cb, hashed_report(o), (o->icase ? MISMATCH_ICASE : 0) | (o->space ? MISMATCH_SPACE : 0));
+		}
+	}
+
+	if(ret == -1) {
+		(void) fprintf(stderr, "%s: Nicht genug Speicher für den Zeilenindex!\n", o->name);
+	}
+
+	lines_free(&la);
+	lines_free(&lb);
+
+	return ret;
+
+}
+
+static void bitmap_record(void *arg, const struct mydiff_record *rec)
+{
+	struct bitmap_sink *s = arg;
+
+	bitmap_add(s->w, rec->line, rec->count);
+	s->records++;
+}
+
+/* number of lines of an input in memory, a last line without '\n' counts as well */
+static unsigned long input_lines(const struct input *in)
+{
+	return (unsigned long) count_newlines(in->data, in->size) + (in->size && in->data[in->size - 1] != '\n');
+}
+
+/*
+* compare two inputs in memory with the streaming comparator, its records go into a bitmap file.
+* Both inputs are fed in steps of the same size, so the comparator copies no more than one input runs ahead of the other
+*/
+static int compare_bitmap(const struct mydiff_options *o, const struct input *a, const struct input *b)
+{
+	struct bitmap_sink s = { NULL, 0 };
+	struct mydiff *d = NULL;
+	size_t fa = 0, fb = 0;
+	int fd, ret = -1;
+
+	if((fd = open(o->bitmap, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
+		(void) fprintf(stderr, "%s: Datei '%s' konnte nicht angelegt werden (%s)!\n", o->name, o->bitmap, strerror(errno));
+		return -1;
+	}
+
+	if((s.w = bitmap_create(fd)) == NULL || (d = mydiff_new((o->icase ? MYDIFF_ICASE : 0) | (o->space ? MYDIFF_SPACE : 0), 0, bitmap_record, &s)) == NULL) {
+		(void) fprintf(stderr, "%s: Nicht genug Speicher für die Bitmap!\n", o->name);
+		goto out;
+	}
+
+	/* once either input ends, the comparison does as well */
+	while(fa < a->size && fb < b->size) {
+
+		size_t na = a->size - fa < BITMAP_FEED ? a->size - fa : BITMAP_FEED, nb = b->size - fb < BITMAP_FEED ? b->size - fb : BITMAP_FEED;
+
+		if(mydiff_feed(d, a->data + fa, na, b->data + fb, nb) == -1) {
+			(void) fprintf(stderr, "%s: Nicht genug Speicher für den Vergleich!\n", o->name);
+			goto out;
+		}
+
+		fa += na;
+		fb += nb;
+	}
+
+	mydiff_finish(d);
+	ret = 0;
+
+	/* the comparator doesn't count the lines it has passed, like compare_lines it stops at the end of the shorter input */
+	if(stats_on) {
+		unsigned long la = input_lines(a), lb = input_lines(b);
+		stats_lines(la < lb ? la : lb, s.records);
+	}
+
+out:
+	if(s.w != NULL && bitmap_finish(s.w) == -1 && ret == 0) {
+		(void) fprintf(stderr, "%s: Datei '%s' konnte nicht geschrieben werden (%s)!\n", o->name, o->bitmap, strerror(errno));
+		ret = -1;
+	}
+
+	mydiff_free(d);
+
+	if(close(fd) == -1 && ret == 0) {
+		(void) fprintf(stderr, "%s: Datei '%s' konnte nicht geschrieben werden (%s)!\n", o->name, o->bitmap, strerror(errno));
+		ret = -1;
+	}
+
+	return ret;
+}
+
+/* compare two opened inputs the way the options say. Errors are reported on stderr */
+static int compare_inputs(FILE *out, const struct mydiff_options *o, struct input *a, struct input *b, unsigned int jobs)
+{
+
+	/* c1 and c2 walk through the mapped files */
+	const char *c1, *c2;
+
+	/* all but the plain comparison need random access to the lines, so streams are read into memory first */
+	if(o->align || o->hash || o->distance || o->binary || o->index || o->bitmap != NULL || o->moved || o->utf8 || jobs > 1) {
+
+		stats_phase(stats_read);
+
+		if(load_input(o, a) == -1 || load_input(o, b) == -1) {
+			return -1;
+		}
+	}
+
+	/* streams (and files read through io_uring) get counted as they are read */
+	if(stats_on && !(a->kind == input_stream || b->kind == input_stream || o->uring)) {
+		stats_input(a->name, a->size);
+		stats_input(b->name, b->size);
+	}
+
+	stats_phase(stats_compare);
+
+	if(o->bitmap != NULL) {
+
+		/* the mismatching lines go into a compressed bitmap (see bitmap.h), not to out */
+		return compare_bitmap(o, a, b);
+	}
+
+	if(o->index) {
+
+		/* take both line indexes from the sidecars, as far as they are still valid */
+		return compare_cached(out, o, a, b, jobs);
+	}
+
+	if(o->moved) {
+
+		/* look for the blocks of a in b wherever they are, the blocks of a are hashed on jobs threads */
+		if(compare_moved(out, a, b, jobs) == -1) {
+			(void) fprintf(stderr, "%s: Nicht genug Speicher für den Blockindex!\n", o->name);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	if(o->binary) {
+
+		/* print the runs of differing bytes, scanned on jobs threads */
+		if(compare_binary(out, a, b, jobs) == -1) {
+			(void) fprintf(stderr, "%s: Binärer Vergleich fehlgeschlagen!\n", o->name);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	if(o->align) {
+
+		/* print inserted, deleted and changed lines along a shortest edit script */
+		if(compare_aligned(out, a, b, jobs) == -1) {
+			(void) fprintf(stderr, "%s: Nicht genug Speicher für den Zeilenabgleich!\n", o->name);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	if(o->hash || o->distance) {
+
+		/* pass over the equal lines in one scan, only compare the differing ones */
+		if(compare_scanned(out, a, b, hashed_report(o)) == -1) {
+			(void) fprintf(stderr, "%s: Nicht genug Speicher für den Vergleich!\n", o->name);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	if(o->utf8) {
+
+		/* count code points, the equal runs of both lines are validated 32 bytes at a time */
+		(void) compare_utf8(out, a, b);
+		return 0;
+	}
+
+	if(jobs > 1) {
+
+		/* split the files into ranges of lines, that are compared by jobs threads */
+		if(compare_parallel(out, a, b, jobs) == -1) {
+			(void) fprintf(stderr, "%s: Vergleich mit %u Threads fehlgeschlagen!\n", o->name, jobs);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	if(a->kind == input_stream || b->kind == input_stream || o->uring) {
+
+		/* compare the lines read so far, while the streams (and with -u the files) are being read */
+		if(compare_streams(out, a, b, o->uring ? STREAMS_URING : 0) == -1) {
+			(void) fprintf(stderr, "%s: Fehler beim Lesen der Eingabe (%s)!\n", o->name, strerror(errno));
+			return -1;
+		}
+
+		return 0;
+	}
+
+	/* compare all lines, until one of the files reaches EOF */
+	c1 = a->data;
+	c2 = b->data;
+	(void) compare_lines(out, &c1, a->data + a->size, &c2, b->data + b->size, 1, ULONG_MAX);
+
+	return 0;
+
+}
+
+/* open and compare a pair of files of the directory mode (see tree.h) */
+static int compare_files(FILE *out, const char *path1, const char *path2, void *arg)
+{
+
+	const struct run *r = arg;
+	struct input a = INPUT_INIT, b = INPUT_INIT;
+	int ret = -1;
+
+	if(input_open(&a, path1) == -1 || input_open(&b, path2) == -1) {
+		(void) fprintf(stderr, "%s: Datei '%s' konnte nicht geöffnet werden (%s)!\n", r->o->name, a.fd == -1 ? path1 : path2, strerror(errno));
+		input_close(&a);
+		return -1;
+	}
+
+	/* the pairs are compared one per thread already. Empty files count as streams, so load them to find them equal */
+	if(load_input(r->o, &a) == 0 && load_input(r->o, &b) == 0) {
+
+		if(input_equal(&a, &b)) {
+			if(stats_on) {
+				stats_input(a.name, a.size);
+				stats_input(b.name, b.size);
+			}
+			ret = 0;
+		} else {
+			ret = compare_inputs(out, r->o, &a, &b, 1) == -1 ? -1 : 1;
+		}
+	}
+
+	input_close(&a);
+	input_close(&b);
+
+	return ret;
+
+}
+
+/* open and compare a candidate against the reference of the one to many mode (see multi.h) */
+static int compare_candidate(FILE *out, const char *path, void *arg)
+{
+
+	const struct run *r = arg;
+	const struct mydiff_options *o = r->o;
+	struct input c = INPUT_INIT;
+	struct lines lc;
+	int ret = 0;
+
+	lc.off = NULL;
+	lc.hash = NULL;
+
+	if(input_open(&c, path) == -1) {
+		(void) fprintf(stderr, "%s: Datei '%s' konnte nicht geöffnet werden (%s)!\n", o->name, path, strerror(errno));
+		return -1;
+	}
+
+	if(load_input(o, &c) == -1) {
+		input_close(&c);
+		return -1;
+	}
+
+	if(stats_on) {
+		stats_input(c.name, c.size);
+	}
+
+	/* only the candidate has to be indexed (if at all), the reference's index is ready */
+	if(o->binary) {
+		ret = compare_binary(out, &r->ref, &c, 1);
+	} else if(o->align || o->hash || o->distance) {
+		if((ret = lines_index(&lc, &c, LINES_HASH, 1)) == 0) {
+			if(o->align) {
+				ret = compare_aligned_index(out, &r->lines, &lc);
+			} else {
+				ret = compare_hashed_index(out, &r->lines, &lc, hashed_report(o));
+			}
+		}
+	} else {
+		(void) compare_indexed(out, &r->lines, &c);
+	}
+
+	if(ret == -1) {
+		(void) fprintf(stderr, "%s: Nicht genug Speicher für den Vergleich mit '%s'!\n", o->name, path);
+	}
+
+	lines_free(&lc);
+	input_close(&c);
+
+	return ret;
+
+}
+
+/* open and sign a file of the cluster mode (see cluster.h) */
+static int sign_file(uint64_t *sig, const char *path, void *arg)
+{
+
+	const struct run *r = arg;
+	struct input in = INPUT_INIT;
+
+	if(open_input(r->o, &in, path) == -1) {
+		return -1;
+	}
+
+	if(load_input(r->o, &in) == -1) {
+		input_close(&in);
+		return -1;
+	}
+
+	if(stats_on) {
+		stats_input(in.name, in.size);
+	}
+
+	cluster_signature(sig, in.data, in.size);
+	input_close(&in);
+
+	return 0;
+
+}
+
+/* read and index the reference once, all candidates get compared against it, jobs at the same time */
+static int compare_candidates(FILE *out, struct run *r, char *const *paths, size_t n)
+{
+
+	const struct mydiff_options *o = r->o;
+	long failed;
+
+	stats_phase(stats_read);
+
+	if(load_input(o, &r->ref) == -1) {
+		return -1;
+	}
+
+	if(stats_on) {
+		stats_input(r->ref.name, r->ref.size);
+	}
+
+	stats_phase(stats_index);
+
+	if(!o->binary && lines_index(&r->lines, &r->ref, o->align || o->hash || o->distance ? LINES_HASH : 0, o->jobs) == -1) {
+		(void) fprintf(stderr, "%s: Nicht genug Speicher für den Zeilenindex!\n", o->name);
+		return -1;
+	}
+
+	/* the candidates are opened, read and compared on the worker threads, all of it counts as comparing */
+	stats_phase(stats_compare);
+
+	if((failed = compare_many(out, paths, n, o->jobs, compare_candidate, r)) == -1) {
+		(void) fprintf(stderr, "%s: Vergleich mit %u Threads fehlgeschlagen!\n", o->name, o->jobs);
+		return -1;
+	}
+
+	/* the failing candidates have been reported already */
+	return failed > 0 ? -1 : 0;
+
+}
+
+const char *mydiff_check(const struct mydiff_options *o, char *const *paths, size_t n)
+{
+	size_t i, stdin_args = 0;
+
+	for(i = 0; i < n; i++) {
+		stdin_args += strcmp(paths[i], "-") == 0;
+	}
+
+	if(stdin_args > 1) {
+		return "Die Standardeingabe kann nur einmal angegeben werden";
+	}
+
+	if(o->align && o->hash) {
+		return "Option -a kann nicht mit -H oder --hash-only kombiniert werden";
+	}
+
+	if(o->distance && (o->align || o->binary || o->hash == 2)) {
+		return "Option -e kann nicht mit -a, -b oder --hash-only kombiniert werden";
+	}
+
+	if((o->icase || o->space) && (o->align || o->binary || o->distance || o->hash == 2)) {
+		/* those take lines with different hashes (or bytes) as different, before any char is compared */
+		return "Optionen -i und -w können nicht mit -a, -b, -e oder --hash-only kombiniert werden";
+	}
+
+	if(o->binary && (o->align || o->hash)) {
+		return "Option -b kann nicht mit -a, -H oder --hash-only kombiniert werden";
+	}
+
+	if(o->index && (o->binary || n > 2 || (is_dir(paths[0]) && is_dir(paths[1])))) {
+		/* sidecars written into compared trees would show up as differences */
+		return "Option -I kann nur beim zeilenweisen Vergleich zweier Dateien verwendet werden";
+	}
+
+	if((o->hash || o->distance) && o->jobs > 1 && !o->index && n == 2 && !(is_dir(paths[0]) && is_dir(paths[1]))) {
+		/* the single scan runs on one thread, -j only spreads the files of two directories or the candidates, or hashes with -I */
+		return "Option -j kann beim Vergleich zweier Dateien nicht mit -H, --hash-only oder -e kombiniert werden";
+	}
+
+	if(o->uring && (o->align || o->hash || o->distance || o->binary || o->index || o->jobs > 1 || n > 2 || (is_dir(paths[0]) && is_dir(paths[1])))) {
+		/* the other comparisons need the whole files at hand, they are mapped (or loaded) anyway */
+		return "Option -u kann nur beim einfachen zeilenweisen Vergleich zweier Dateien verwendet werden";
+	}
+
+	if(o->moved && (o->align || o->hash || o->distance || o->binary || o->index || o->icase || o->space || o->uring || o->bitmap != NULL)) {
+		return "Option -m kann nicht mit -a, -H, --hash-only, -e, -b, -I, -i, -w, -u oder -B kombiniert werden";
+	}
+
+	if(o->moved && n > 2) {
+		/* the candidates are compared line by line against the reference's line index */
+		return "Option -m kann nur mit zwei Dateien oder Verzeichnissen verwendet werden";
+	}
+
+	if(o->cluster > 0 && (o->align || o->hash || o->distance || o->binary || o->index || o->icase || o->space || o->uring || o->bitmap != NULL || o->moved)) {
+		/* the signatures are taken over the lines as they are, the shortlisted pairs are compared line by line */
+		return "Option --cluster kann nicht mit -a, -H, --hash-only, -e, -b, -I, -i, -w, -u, -B oder -m kombiniert werden";
+	}
+
+	for(i = 0; o->cluster > 0 && i < n; i++) {
+		if(strcmp(paths[i], "-") == 0 || is_dir(paths[i])) {
+			/* every file is read twice: once to sign it, again if it is part of a shortlisted pair */
+			return "Option --cluster kann nur mit Dateien verwendet werden";
+		}
+	}
+
+	if(o->utf8 && (o->align || o->hash || o->distance || o->binary || o->index || o->icase || o->space || o->uring || o->bitmap != NULL || o->moved || o->cluster > 0)) {
+		/* the UTF-8 kernels compare code points as they are */
+		return "Option -U kann nicht mit -a, -H, --hash-only, -e, -b, -I, -i, -w, -u, -B, -m oder --cluster kombiniert werden";
+	}
+
+	if(o->utf8 && n > 2) {
+		return "Option -U kann nur mit zwei Dateien oder Verzeichnissen verwendet werden";
+	}
+
+	if(o->bitmap != NULL && (o->align || o->hash || o->distance || o->binary || o->index || o->uring || o->jobs > 1 || n > 2 || (is_dir(paths[0]) && is_dir(paths[1])))) {
+		/* the bitmap holds the line numbers of a plain comparison of two files, one stream of records in order */
+		return "Option -B kann nur beim einfachen zeilenweisen Vergleich zweier Dateien verwendet werden";
+	}
+
+	return NULL;
+}
+
+int mydiff_run(FILE *out, const struct mydiff_options *o, char *const *paths, size_t n)
+{
+	struct input init = INPUT_INIT, b = INPUT_INIT;
+	struct run r;
+	long failed;
+	int ret;
+
+	r.o = o;
+	r.ref = init;
+	r.lines.off = NULL;
+	r.lines.hash = NULL;
+
+	if(o->verbose) {
+		stats_start();
+	}
+
+	/* Select the widest comparison kernel the cpu supports */
+	(void) mismatch_init((o->icase ? MISMATCH_ICASE : 0) | (o->space ? MISMATCH_SPACE : 0));
+	(void) utf8_init();
+
+	if(o->cluster > 0) {
+
+		/* sign every file, then compare the pairs with similar signatures, jobs at the same time. Signing counts as indexing */
+		stats_phase(stats_index);
+
+		if((failed = compare_clusters(out, paths, n, o->jobs, o->cluster, sign_file, compare_files, &r)) == -1) {
+			(void) fprintf(stderr, "%s: Dateien konnten nicht verglichen werden (%s)!\n", o->name, strerror(errno));
+			ret = -1;
+		} else {
+			/* the failing files and pairs have been reported already */
+			ret = failed > 0 ? -1 : 0;
+		}
+
+	} else if(n == 2 && is_dir(paths[0]) && is_dir(paths[1])) {
+
+		/* compare the files both trees have in common, jobs pairs at the same time. Pairs are opened and read on the worker threads */
+		stats_phase(stats_compare);
+
+		if((failed = compare_trees(out, paths[0], paths[1], o->jobs, compare_files, &r)) == -1) {
+			(void) fprintf(stderr, "%s: Verzeichnisse konnten nicht verglichen werden (%s)!\n", o->name, strerror(errno));
+			ret = -1;
+		} else {
+			/* the failing pairs have been reported already */
+			ret = failed > 0 ? -1 : 0;
+		}
+
+	} else if(open_input(o, &r.ref, paths[0]) == -1) {
+		ret = -1;
+	} else if(n > 2) {
+		/* the candidates get opened one by one while comparing */
+		ret = compare_candidates(out, &r, paths + 1, n - 1);
+	} else if(open_input(o, &b, paths[1]) == -1) {
+		ret = -1;
+	} else {
+		ret = compare_inputs(out, o, &r.ref, &b, o->jobs);
+	}
+
+	lines_free(&r.lines);
+	input_close(&r.ref);
+	input_close(&b);
+
+	if(o->verbose) {
+		(void) fflush(out);
+		stats_report(stderr, o->name);
+	}
+
+	return ret;
+}
@@ -0,0 +1,161 @@
+/**
+* @file libmydiff.h
+* @brief public interface of libmydiff: all of mydiff's comparisons as library calls, and a streaming comparator
+* that is fed buffers of both sides and reports mismatching lines through a callback
+* @details Link with libmydiff.a and -pthread. mydiff itself is a thin wrapper around mydiff_check and mydiff_run.
+*/
+
+#ifndef LIBMYDIFF_H
+#define LIBMYDIFF_H
+#include <stdio.h> //needed for FILE
+#include <stddef.h> //needed for size_t
+
+/* === Comparing files === */
+
+/**
+* @brief how mydiff_run compares, one member per command line option of mydiff
+*/
+struct mydiff_options {
+
+	const char *name; /**< prefix of the error messages printed on stderr */
+	unsigned int jobs; /**< number of threads (-j), at least 1 */
+	int align; /**< align lines first (-a) */
+	int hash; /**< compare line hashes first (-H), 2 to compare hashes only (--hash-only) */
+	int distance; /**< print the edit distance of differing lines (-e) */
+	int binary; /**< compare byte by byte (-b) */
+	int index; /**< keep line indexes in sidecar files (-I) */
+	int icase; /**< ignore case (-i) */
+	int space; /**< ignore white space (-w) */
+	int uring; /**< read regular files through io_uring, several reads in flight on each (-u) */
+	const char *bitmap; /**< write the mismatching lines as a compressed bitmap to this file instead of printing them (-B), NULL else */
+	int moved; /**< report the blocks of the first file found in the second one, in place or moved, and what's new (-m) */
+	int verbose; /**< print the time taken per phase, the bytes read, the lines compared and the throughput on stderr at the end (-v) */
+	double cluster; /**< compare only the pairs of files with an estimated similarity of their sets of lines of at least this (--cluster), 0 to compare as usual */
+	int utf8; /**< count mismatching code points instead of bytes and report lines with invalid UTF-8 (-U) */
+
+};
+
+/**
+* @brief options of a plain comparison: line by line on one thread, errors reported as "mydiff: ..."
+*/
+#define MYDIFF_OPTIONS_INIT { "mydiff", 1, 0, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, 0, 0 }
+
+/**
+* @brief check that the options can be used together and with the given paths
+*
+* @param o options to check
+* @param paths paths as given to mydiff_run
+* @param n number of paths
+*
+* @return NULL if they can, else a message saying why not
+*/
+const char *mydiff_check(const struct mydiff_options *o, char *const *paths, size_t n);
+
+/**
+* @brief compare like mydiff does: two files (either may be "-"), two directory trees, or a reference (paths[0])
+* against candidates (paths[1] .. paths[n - 1]), or with cluster set the near-duplicate pairs among all files.
+* Differences are printed to out, errors to stderr.
+* Selects the comparison kernel for the whole process (see mismatch_init), so runs with different -i / -w
+* must not overlap, neither must runs with verbose set (the counters are process wide). The streaming comparator below has no such restriction
+*
+* @param out stream to print the differences to
+* @param o options, which have passed mydiff_check
+* @param paths paths to compare
+* @param n number of paths, at least 2
+*
+* @return 0 on success, -1 on errors
+*/
+int mydiff_run(FILE *out, const struct mydiff_options *o, char *const *paths, size_t n);
+
+/* === Streaming comparator === */
+
+/**
+* @brief flag for mydiff_new: ignore case (like -i)
+*/
+#define MYDIFF_ICASE 1
+
+/**
+* @brief flag for mydiff_new: ignore white space (like -w)
+*/
+#define MYDIFF_SPACE 2
+
+/**
+* @brief a pair of lines with mismatching chars
+*/
+struct mydiff_record {
+
+	unsigned long line; /**< number of the line pair, counting from 1 */
+	unsigned long count; /**< number of mismatching chars (like "Zeile: LINE Zeichen: COUNT") */
+
+};
+
+/**
+* @brief type definition of the callback receiving the records, in order of their lines
+*
+* @param arg argument given to mydiff_new
+* @param rec the record, only valid during the call
+*/
+typedef void (*mydiff_callback_t)(void *arg, const struct mydiff_record *rec);
+
+/**
+* @brief a streaming comparator, opaque
+*/
+struct mydiff;
+
+/**
+* @brief create a comparator. This is the only call (with mydiff_feed running far ahead on one side) that allocates
+*
+* @param flags MYDIFF_ICASE and / or MYDIFF_SPACE, 0 for none
+* @param lag number of bytes one side may be fed ahead of the other before the comparator has to grow its buffers, 0 for a default
+* @param cb callback receiving the records
+* @param arg passed on to cb
+*
+* @return the comparator, NULL if memory ran out
+*/
+struct mydiff *mydiff_new(int flags, size_t lag, mydiff_callback_t cb, void *arg);
+
+/**
+* @brief feed the next bytes of both sides. Either one may be empty, lines may be split anywhere.
+* Line pairs are compared as soon as both sides have them, right out of the given buffers;
+* only the part of a side that is ahead of the other one is copied. The buffers may be reused after the call
+*
+* @param d the comparator
+* @param a next bytes of side A
+* @param la number of bytes in a
+* @param b next bytes of side B
+* @param lb number of bytes in b
+*
+* @return 0 on success, -1 if a side ran more than lag bytes ahead and the buffer could not grow (errno is set)
+*/
+int mydiff_feed(struct mydiff *d, const char *a, size_t la, const char *b, size_t lb);
+
+/**
+* @brief end of input: one of the sides (or both) has ended, like mydiff the comparison stops there.
+* The last line pair gets reported if it has mismatches. Further feeding is ignored until mydiff_reset
+*
+* @param d the comparator
+*/
+void mydiff_finish(struct mydiff *d);
+
+/**
+* @brief prepare the comparator for the next pair of inputs, keeping its buffers
+*
+* @param d the comparator
+*/
+void mydiff_reset(struct mydiff *d);
+
+/**
+* @brief release a comparator
+*
+* @param d the comparator, may be NULL
+*/
+void mydiff_free(struct mydiff *d);
+
+/**
+* @brief check the comparator against compare_lines on random inputs, fed in random pieces. Reports on stdout
+*
+* @return 0 if all records agree, -1 else
+*/
+int mydiff_self_test(void);
+
+#endif
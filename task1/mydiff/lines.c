@@ -0,0 +1,144 @@
+/**
+* @file lines.c
+* @brief index the lines of an input, so they can be accessed by number
+* @details The input is cut into chunks at line boundaries. The lines of each chunk are counted first,
+* so the index can be allocated in one go, then offsets (and hashes) are filled in per chunk. Chunks are processed in parallel.
+*/
+#include <stdlib.h>
+#include "lines.h"
+#include "mismatch.h"
+#include "hash.h"
+#include "workpool.h"
+
+/* === Constants === */
+
+/** Number of chunks per thread */
+#define CHUNKS_PER_JOB 8
+
+/* === Structures === */
+
+/**
+* @brief state of an index being built
+*/
+struct indexer {
+
+	struct lines *l; /**< index to fill */
+	int flags; /**< LINES_HASH or 0 */
+	size_t nchunks; /**< number of chunks */
+	size_t *start; /**< start[i] is the offset of chunk i, start[nchunks] is the input's size */
+	size_t *first; /**< first[i] is the number of the first line in chunk i (nchunks + 1 entries) */
+
+};
+
+/* === Implementation === */
+
+/* chunks end at line boundaries, so every line in a chunk ends with a '\n', except for the input's last one */
+static void count_task(void *arg, size_t task)
+{
+	struct indexer *ix = arg;
+	const struct lines *l = ix->l;
+	size_t from = ix->start[task], to = ix->start[task + 1];
+
+	ix->first[task + 1] = count_newlines(l->data + from, to - from) + (to == l->size && to > from && l->data[to - 1] != '\n');
+}
+
+static void fill_task(void *arg, size_t task)
+{
+	struct indexer *ix = arg;
+	struct lines *l = ix->l;
+	const char *p = l->data + ix->start[task], *end = l->data + ix->start[task + 1], *eof = l->data + l->size;
+	size_t i = ix->first[task];
+
+	while(p < end) {
+
+		const char *next = next_line(p, eof);
+
+		l->off[i] = (size_t) (p - l->data);
+
+		if(ix->flags & LINES_HASH) {
+			l->hash[i] = line_hash(p, (size_t) (next - p) - (next[-1] == '\n'));
+		}
+
+		i++;
+		p = next;
+	}
+}
+
+int lines_index(struct lines *l, const struct input *in, int flags, unsigned int jobs)
+{
+	struct indexer ix;
+	const char *end = in->data + in->size;
+	size_t i;
+	int ret = -1;
+
+	l->data = in->data;
+	l->size = in->size;
+	l->n = 0;
+	l->off = NULL;
+	l->hash = NULL;
+
+	ix.l = l;
+	ix.flags = flags;
+	ix.nchunks = (size_t) (jobs ? jobs : 1) * CHUNKS_PER_JOB;
+	ix.start = malloc((ix.nchunks + 1) * sizeof(*ix.start));
+	ix.first = calloc(ix.nchunks + 1, sizeof(*ix.first));
+
+	if(ix.start == NULL || ix.first == NULL) {
+		goto out;
+	}
+
+	/* move each cut to the start of the next line */
+	ix.start[0] = 0;
+	for(i = 1; i < ix.nchunks; i++) {
+
+		size_t cut = (size_t) ((unsigned long long) in->size * i / ix.nchunks);
+
+		ix.start[i] = cut == 0 ? 0 : (size_t) (next_line(in->data + cut - 1, end) - in->data);
+		if(ix.start[i] < ix.start[i - 1]) {
+			ix.start[i] = ix.start[i - 1];
+		}
+	}
+	ix.start[ix.nchunks] = in->size;
+
+	if(workpool_run(jobs, ix.nchunks, count_task, &ix) == -1) {
+		goto out;
+	}
+
+	for(i = 0; i < ix.nchunks; i++) {
+		ix.first[i + 1] += ix.first[i];
+	}
+	l->n = ix.first[ix.nchunks];
+
+	if((l->off = malloc((l->n + 1) * sizeof(*l->off))) == NULL) {
+		goto out;
+	}
+	if((flags & LINES_HASH) && (l->hash = malloc((l->n + 1) * sizeof(*l->hash))) == NULL) {
+		goto out;
+	}
+
+	if(workpool_run(jobs, ix.nchunks, fill_task, &ix) == -1) {
+		goto out;
+	}
+
+	l->off[l->n] = in->size;
+	ret = 0;
+
+out:
+	if(ret == -1) {
+		lines_free(l);
+	}
+
+	free(ix.start);
+	free(ix.first);
+
+	return ret;
+}
+
+void lines_free(struct lines *l)
+{
+	free(l->off);
+	free(l->hash);
+	l->off = NULL;
+	l->hash = NULL;
+	l->n = 0;
+}
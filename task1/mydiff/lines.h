@@ -0,0 +1,59 @@
+/**
+* @file lines.h
+* @brief header file for the line index of an input (where every line starts, and optionally a hash per line)
+*/
+
+#ifndef LINES_H
+#define LINES_H
+#include <stddef.h> //needed for size_t
+#include <stdint.h>
+#include "input.h"
+
+/**
+* @brief flag for lines_index: also compute a hash per line
+*/
+#define LINES_HASH 1
+
+/**
+* @brief offsets of all lines of an input
+*/
+struct lines {
+
+	const char *data; /**< first char of the input */
+	size_t size; /**< number of chars in data */
+	size_t n; /**< number of lines */
+	size_t *off; /**< off[i] is the offset of line i, off[n] is size (n + 1 entries) */
+	uint64_t *hash; /**< hash[i] is the line_hash of line i without its '\n', NULL if not requested */
+
+};
+
+/**
+* @brief number of chars in line i, without its '\n'
+*/
+#define LINE_LEN(l, i) ((l)->off[(i) + 1] - (l)->off[(i)] - ((l)->data[(l)->off[(i) + 1] - 1] == '\n'))
+
+/**
+* @brief first char of line i
+*/
+#define LINE_PTR(l, i) ((l)->data + (l)->off[(i)])
+
+/**
+* @brief find all lines of an input. A last line without '\n' counts as well
+*
+* @param l index to fill
+* @param in input to index
+* @param flags LINES_HASH to hash every line, 0 else
+* @param jobs number of threads to index with
+*
+* @return 0 on success, -1 if the index could not be allocated
+*/
+int lines_index(struct lines *l, const struct input *in, int flags, unsigned int jobs);
+
+/**
+* @brief release a line index
+*
+* @param l index to release
+*/
+void lines_free(struct lines *l);
+
+#endif
@@ -0,0 +1,109 @@
+/**
+ * @file mdquery.c
+ * @author Georg Hubinger (9947673) <georg.hubinger@tuwien.ac.at>
+ * @brief Query a bitmap of mismatching lines written by mydiff -B
+ * @details Prints the lines from FROM to TO (both included, default: all lines) that differ, in mydiff's format
+ * (Zeile: LINENO Zeichen: COUNT). With -n just the number of those lines is printed.
+ * Only the containers overlapping the range are read (see bitmap.h), the rest of the file is never touched.
+ * @date 16.10.2013
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "bitmap.h"
+
+/** Bailout with formatted error message */
+#define exit_error(fmt, ...) \
+	do {\
+		(void) fprintf(stderr, fmt, __VA_ARGS__);\
+		exit(EXIT_FAILURE); \
+	} while(0);
+
+/** True global for storing the programm's path */
+char *pname = NULL;
+
+/** Print out usage message */
+static void usage(void);
+
+/* a line number as given on the command line */
+static unsigned long parse_line(const char *arg)
+{
+	char *end;
+	unsigned long line;
+
+	errno = 0;
+	line = strtoul(arg, &end, 10);
+
+	if(*arg == '\0' || *arg == '-' || *end != '\0' || errno != 0) {
+		exit_error("%s: Ungültige Zeilennummer '%s'!\n", pname, arg);
+	}
+
+	return line;
+}
+
+static void print_line(void *arg, unsigned long line, unsigned long count)
+{
+	(void) fprintf(arg, "Zeile: %lu Zeichen: %lu\n", line, count);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long from = 1, to = ULONG_MAX, found;
+	struct bitmap b;
+	int c, fd, only_count = 0;
+
+	if(argc) pname = argv[0];
+
+	while((c = getopt(argc, argv, "n")) != -1) {
+		switch(c) {
+			case 'n': only_count = 1; break;
+			default: usage(); break;
+		}
+	}
+
+	if(argc - optind < 1 || argc - optind > 3) {
+		usage();
+	}
+
+	if(argc - optind > 1) {
+		from = parse_line(argv[optind + 1]);
+	}
+	if(argc - optind > 2) {
+		to = parse_line(argv[optind + 2]);
+	}
+
+	if((fd = open(argv[optind], O_RDONLY)) == -1) {
+		exit_error("%s: Datei '%s' konnte nicht geöffnet werden (%s)!\n", pname, argv[optind], strerror(errno));
+	}
+
+	if(bitmap_open(&b, fd) == -1) {
+		if(errno != 0) {
+			exit_error("%s: Datei '%s' konnte nicht gelesen werden (%s)!\n", pname, argv[optind], strerror(errno));
+		}
+		exit_error("%s: Datei '%s' ist keine Bitmap von mydiff -B!\n", pname, argv[optind]);
+	}
+
+	(void) close(fd);
+
+	if((found = bitmap_query(&b, from, to, only_count ? NULL : print_line, stdout)) == (unsigned long) -1) {
+		exit_error("%s: Datei '%s' ist beschädigt!\n", pname, argv[optind]);
+	}
+
+	if(only_count) {
+		(void) printf("%lu\n", found);
+	}
+
+	bitmap_close(&b);
+
+	return 0;
+}
+
+static void usage(void)
+{
+	exit_error("Usage: %s [-n] BITMAP [FROM [TO]]\n", pname);
+}
@@ -0,0 +1,791 @@
+/**
+* @file mismatch.c
+* @brief count mismatching chars of two lines. Vectorized kernels compare 16 (SSE2), 32 (AVX2) or 64 (AVX-512) chars at once.
+* Scan kernels find where runs of (mis)matching bytes end, for the binary comparison
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "mismatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* === Normalization === */
+
+/** chars -w skips: blanks and the other ASCII white space, except '\n' which ends the line */
+#define IS_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\v' || (c) == '\f')
+
+/** ASCII lower case of c, for -i */
+#define FOLD(c) ((c) >= 'A' && (c) <= 'Z' ? (c) + ('a' - 'A') : (c))
+
+/* === Kernels === */
+
+/* reference implementation, also used for the tails of the vectorized kernels */
+static inline size_t positional_scalar(const char *a, const char *b, size_t n, size_t *stop, int icase)
+{
+	size_t i, count = 0;
+
+	for(i = 0; i < n && !(STOP_COMPARE_CHAR(a[i]) || STOP_COMPARE_CHAR(b[i])); i++) {
+		if(icase ? FOLD(a[i]) != FOLD(b[i]) : a[i] != b[i]) {
+			count++;
+		}
+	}
+
+	*stop = i;
+	return count;
+}
+
+/*
+* -w: white space is skipped on both sides, the remaining chars are compared pairwise until one side reaches a stop char or its end.
+* Compares at most limit pairs (so the vector kernels can take over again), *done is set once the lines have ended
+*/
+static inline size_t spaces_scalar(const char *a, size_t na, const char *b, size_t nb, size_t *i, size_t *j, size_t limit, int icase, int *done)
+{
+	size_t x = *i, y = *j, count = 0;
+
+	for(; limit; limit--, x++, y++) {
+
+		for(; x < na && IS_SPACE(a[x]); x++);
+		for(; y < nb && IS_SPACE(b[y]); y++);
+
+		if(x >= na || y >= nb || STOP_COMPARE_CHAR(a[x]) || STOP_COMPARE_CHAR(b[y])) {
+			*done = 1;
+			break;
+		}
+
+		if(icase ? FOLD(a[x]) != FOLD(b[y]) : a[x] != b[y]) {
+			count++;
+		}
+	}
+
+	*i = x;
+	*j = y;
+	return count;
+}
+
+static size_t mismatch_scalar(const char *a, size_t na, const char *b, size_t nb, size_t *stop_a, size_t *stop_b)
+{
+	size_t count = positional_scalar(a, b, na < nb ? na : nb, stop_a, 0);
+
+	*stop_b = *stop_a;
+	return count;
+}
+
+static size_t mismatch_scalar_i(const char *a, size_t na, const char *b, size_t nb, size_t *stop_a, size_t *stop_b)
+{
+	size_t count = positional_scalar(a, b, na < nb ? na : nb, stop_a, 1);
+
+	*stop_b = *stop_a;
+	return count;
+}
+
+static size_t mismatch_scalar_w(const char *a, size_t na, const char *b, size_t nb, size_t *stop_a, size_t *stop_b)
+{
+	int done = 0;
+
+	*stop_a = *stop_b = 0;
+	return spaces_scalar(a, na, b, nb, stop_a, stop_b, SIZE_MAX, 0, &done);
+}
+
+static size_t mismatch_scalar_iw(const char *a, size_t na, const char *b, size_t nb, size_t *stop_a, size_t *stop_b)
+{
+	int done = 0;
+
+	*stop_a = *stop_b = 0;
+	return spaces_scalar(a, na, b, nb, stop_a, stop_b, SIZE_MAX, 1, &done);
+}
+
+static size_t scan_scalar(const char *a, const char *b, size_t n, int differ)
+{
+	size_t i;
+
+	for(i = 0; i < n && (a[i] != b[i]) != differ; i++);
+
+	return i;
+}
+
+#ifdef HAVE_X86
+
+/*
+* All vector kernels work the same way: one compare gives the mismatch mask, four compares give the mask of stop chars in a or b.
+* Mismatches are counted by popcount, masked to the chars in front of the first stop char once there is one.
+* -i folds both vectors to lower case before comparing them (A-Z is found by one unsigned range check).
+* -w also builds the white space mask of both vectors. As long as white space sits at the same places in a and b, the chars
+* in between line up and are counted like above, with the white space masked out. Where it doesn't, the scalar code
+* skips it for a vector's worth of pairs and the vectors take over again from there.
+* Each kernel is written once and inlined into its four variants (plain, -i, -w, -i -w).
+*/
+
+__attribute__((target("sse2")))
+static inline __m128i fold_sse2(__m128i v)
+{
+	__m128i t = _mm_sub_epi8(v, _mm_set1_epi8('A'));
+	__m128i upper = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8('Z' - 'A')), t);
+
+	return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A')));
+}
+
+__attribute__((target("sse2")))
+static inline unsigned int ends_sse2(__m128i va, __m128i vb)
+{
+	const __m128i nl = _mm_set1_epi8('\n'), zero = _mm_setzero_si128();
+
+	return (unsigned int) _mm_movemask_epi8(_mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(va, nl), _mm_cmpeq_epi8(va, zero)),
+			_mm_or_si128(_mm_cmpeq_epi8(vb, nl), _mm_cmpeq_epi8(vb, zero))));
+}
+
+/* '\t' .. '\r' but '\n', and ' ' */
+__attribute__((target("sse2")))
+static inline unsigned int spaces_sse2(__m128i v)
+{
+	__m128i t = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+	__m128i ctl = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8('\r' - '\t')), t));
+
+	return (unsigned int) _mm_movemask_epi8(_mm_or_si128(ctl, _mm_cmpeq_epi8(v, _mm_set1_epi8(' '))));
+}
+
+__attribute__((always_inline, target("sse2")))
+static inline size_t positional_sse2(const char *a, const char *b, size_t n, size_t *stop, int icase)
+{
+	size_t i, count = 0, tail;
+
+	for(i = 0; i + 16 <= n; i += 16) {
+
+		__m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+		unsigned int end = ends_sse2(va, vb), diff;
+
+		if(icase) {
+			va = fold_sse2(va);
+			vb = fold_sse2(vb);
+		}
+
+		diff = ~_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) & 0xffff;
+
+		if(end) {
+			unsigned int pos = __builtin_ctz(end);
+			*stop = i + pos;
+			return count + __builtin_popcount(diff & ((1u << pos) - 1));
+		}
+
+		count += __builtin_popcount(diff);
+	}
+
+	count += positional_scalar(a + i, b + i, n - i, &tail, icase);
+	*stop = i + tail;
+	return count;
+}
+
+__attribute__((always_inline, target("sse2")))
+static inline size_t skipping_sse2(const char *a, size_t na, const char *b, size_t nb, size_t *stop_a, size_t *stop_b, int icase)
+{
+	size_t i = 0, j = 0, count = 0;
+	int done = 0;
+
+	while(!done && na - i >= 16 && nb - j >= 16) {
+
+		__m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *) (b + j));
+		unsigned int end = ends_sse2(va, vb), ws = spaces_sse2(va), valid = end ? (1u << __builtin_ctz(end)) - 1 : 0xffff, diff;
+
+		if((ws ^ spaces_sse2(vb)) & valid) {
+			count += spaces_scalar(a, na, b, nb, &i, &j, 16, icase, &done);
+			continue;
+		}
+
+		if(icase) {
+			va = fold_sse2(va);
+			vb = fold_sse2(vb);
+		}
+
+		diff = ~_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) & ~ws & valid;
+		count += __builtin_popcount(diff);
+
+		if(end) {
+			i += __builtin_ctz(end);
+			j += __builtin_ctz(end);
+			break;
+		}
+
+		i += 16;
+		j += 16;
+	}
+
+	if(!done) {
+		count += spaces_scalar(a, na, b, nb, &i, &j, SIZE_MAX, icase, &done);
+	}
+
+	*stop_a = i;
+	*stop_b = j;
+	return count;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i fold_avx2(__m256i v)
+{
+	__m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('A'));
+	__m256i upper = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8('Z' - 'A')), t);
+
+	return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8('a' - 'A')));
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t ends_avx2(__m256i va, __m256i vb)
+{
+	const __m256i nl = _mm256_set1_epi8('\n'), zero = _mm256_setzero_si256();
+
+	return (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(va, nl), _mm256_cmpeq_epi8(va, zero)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(vb, nl), _mm256_cmpeq_epi8(vb, zero))));
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t spaces_avx2(__m256i v)
+{
+	__m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+	__m256i ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+			_mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8('\r' - '\t')), t));
+
+	return (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '))));
+}
+
+__attribute__((always_inline, target("avx2,popcnt,bmi")))
+static inline size_t positional_avx2(const char *a, const char *b, size_t n, size_t *stop, int icase)
+{
+	size_t i, count = 0, tail;
+
+	for(i = 0; i + 32 <= n; i += 32) {
+
+		__m256i va = _mm256_loadu_si256((const __m256i *) (a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i *) (b + i));
+		uint32_t end = ends_avx2(va, vb), diff;
+
+		if(icase) {
+			va = fold_avx2(va);
+			vb = fold_avx2(vb);
+		}
+
+		diff = ~(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+
+		if(end) {
+			unsigned int pos = __builtin_ctz(end);
+			*stop = i + pos;
+			return count + __builtin_popcount(diff & ((1u << pos) - 1));
+		}
+
+		count += __builtin_popcount(diff);
+	}
+
+	count += positional_scalar(a + i, b + i, n - i, &tail, icase);
+	*stop = i + tail;
+	return count;
+}
+
+__attribute__((always_inline, target("avx2,popcnt,bmi")))
+static inline size_t skipping_avx2(const char *a, size_t na, const char *b, size_t nb, size_t *stop_a, size_t *stop_b, int icase)
+{
+	size_t i = 0, j = 0, count = 0;
+	int done = 0;
+
+	while(!done && na - i >= 32 && nb - j >= 32) {
+
+		__m256i va = _mm256_loadu_si256((const __m256i *) (a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i *) (b + j));
+		uint32_t end = ends_avx2(va, vb), ws = spaces_avx2(va), valid = end ? (1u << __builtin_ctz(end)) - 1 : ~(uint32_t) 0, diff;
+
+		if((ws ^ spaces_avx2(vb)) & valid) {
+			count += spaces_scalar(a, na, b, nb, &i, &j, 32, icase, &done);
+			continue;
+		}
+
+		if(icase) {
+			va = fold_avx2(va);
+			vb = fold_avx2(vb);
+		}
+
+		diff = ~(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)) & ~ws & valid;
+		count += __builtin_popcount(diff);
+
+		if(end) {
+			i += __builtin_ctz(end);
+			j += __builtin_ctz(end);
+			break;
+		}
+
+		i += 32;
+		j += 32;
+	}
+
+	if(!done) {
+		count += spaces_scalar(a, na, b, nb, &i, &j, SIZE_MAX, icase, &done);
+	}
+
+	*stop_a = i;
+	*stop_b = j;
+	return count;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i fold_avx512(__m512i v)
+{
+	__mmask64 upper = _mm512_cmple_epu8_mask(_mm512_sub_epi8(v, _mm512_set1_epi8('A')), _mm512_set1_epi8('Z' - 'A'));
+
+	return _mm512_mask_add_epi8(v, upper, v, _mm512_set1_epi8('a' - 'A'));
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __mmask64 ends_avx512(__mmask64 valid, __m512i va, __m512i vb)
+{
+	const __m512i nl = _mm512_set1_epi8('\n'), zero = _mm512_setzero_si512();
+
+	return _mm512_mask_cmpeq_epi8_mask(valid, va, nl) | _mm512_mask_cmpeq_epi8_mask(valid, va, zero)
+			| _mm512_mask_cmpeq_epi8_mask(valid, vb, nl) | _mm512_mask_cmpeq_epi8_mask(valid, vb, zero);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __mmask64 spaces_avx512(__m512i v)
+{
+	__mmask64 ctl = _mm512_cmple_epu8_mask(_mm512_sub_epi8(v, _mm512_set1_epi8('\t')), _mm512_set1_epi8('\r' - '\t'));
+
+	return (ctl & ~_mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\n'))) | _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(' '));
+}
+
+__attribute__((always_inline, target("avx512f,avx512bw,popcnt,bmi")))
+static inline size_t positional_avx512(const char *a, const char *b, size_t n, size_t *stop, int icase)
+{
+	size_t i, count = 0;
+
+	/* The tail is done with a masked load, which does not fault on the bytes that are masked out */
+	for(i = 0; i < n; i += 64) {
+
+		__mmask64 valid = n - i >= 64 ? ~(__mmask64) 0 : ((__mmask64) 1 << (n - i)) - 1;
+		__m512i va = _mm512_maskz_loadu_epi8(valid, a + i);
+		__m512i vb = _mm512_maskz_loadu_epi8(valid, b + i);
+		__mmask64 end = ends_avx512(valid, va, vb), diff;
+
+		if(icase) {
+			va = fold_avx512(va);
+			vb = fold_avx512(vb);
+		}
+
+		diff = _mm512_mask_cmpneq_epi8_mask(valid, va, vb);
+
+		if(end) {
+			unsigned int pos = __builtin_ctzll(end);
+			*stop = i + pos;
+			return count + __builtin_popcountll(diff & (((__mmask64) 1 << pos) - 1));
+		}
+
+		count += __builtin_popcountll(diff);
+	}
+
+	*stop = n;
+	return count;
+}
+
+__attribute__((always_inline, target("avx512f,avx512bw,popcnt,bmi")))
+static inline size_t skipping_avx512(const char *a, size_t na, const char *b, size_t nb, size_t *stop_a, size_t *stop_b, int icase)
+{
+	size_t i = 0, j = 0, count = 0;
+	int done = 0;
+
+	while(!done && na - i >= 64 && nb - j >= 64) {
+
+		__m512i va = _mm512_loadu_si512((const void *) (a + i));
+		__m512i vb = _mm512_loadu_si512((const void *) (b + j));
+		__mmask64 end = ends_avx512(~(__mmask64) 0, va, vb), ws = spaces_avx512(va), diff;
+		__mmask64 valid = end ? ((__mmask64) 1 << __builtin_ctzll(end)) - 1 : ~(__mmask64) 0;
+
+		if((ws ^ spaces_avx512(vb)) & valid) {
+			count += spaces_scalar(a, na, b, nb, &i, &j, 64, icase, &done);
+			continue;
+		}
+
+		if(icase) {
+			va = fold_avx512(va);
+			vb = fold_avx512(vb);
+		}
+
+		diff = _mm512_cmpneq_epi8_mask(va, vb) & ~ws & valid;
+		count += __builtin_popcountll(diff);
+
+		if(end) {
+			i += __builtin_ctzll(end);
+			j += __builtin_ctzll(end);
+			break;
+		}
+
+		i += 64;
+		j += 64;
+	}
+
+	if(!done) {
+		count += spaces_scalar(a, na, b, nb, &i, &j, SIZE_MAX, icase, &done);
+	}
+
+	*stop_a = i;
+	*stop_b = j;
+	return count;
+}
+
+/* the four variants of a kernel: plain, -i, -w and -i -w */
+#define VARIANTS(width, isa) \
+	__attribute__((target(isa))) \
+	static size_t mismatch_##width(const char *a, size_t na, const char *b, size_t nb, size_t *stop_a, size_t *stop_b) \
+	{ \
+		size_t count = positional_##width(a, b, na < nb ? na : nb, stop_a, 0); \
+		*stop_b = *stop_a; \
+		return count; \
+	} \
+	__attribute__((target(isa))) \
+	static size_t mismatch_##width##_i(const char *a, size_t na, const char *b, size_t nb, size_t *stop_a, size_t *stop_b) \
+	{ \
+		size_t count = positional_##width(a, b, na < nb ? na : nb, stop_a, 1); \
+		*stop_b = *stop_a; \
+		return count; \
+	} \
+	__attribute__((target(isa))) \
+	static size_t mismatch_##width##_w(const char *a, size_t na, const char *b, size_t nb, size_t *stop_a, size_t *stop_b) \
+	{ \
+		return skipping_##width(a, na, b, nb, stop_a, stop_b, 0); \
+	} \
+	__attribute__((target(isa))) \
+	static size_t mismatch_##width##_iw(const char *a, size_t na, const char *b, size_t nb, size_t *stop_a, size_t *stop_b) \
+	{ \
+		return skipping_##width(a, na, b, nb, stop_a, stop_b, 1); \
+	}
+
+VARIANTS(sse2, "sse2")
+VARIANTS(avx2, "avx2,popcnt,bmi")
+VARIANTS(avx512, "avx512f,avx512bw,popcnt,bmi")
+
+/* The scan kernels only need the compare mask. Flipping it turns "first equal byte" into "first differing byte" */
+
+__attribute__((target("sse2")))
+static size_t scan_sse2(const char *a, const char *b, size_t n, int differ)
+{
+	const unsigned int flip = differ ? 0xffff : 0;
+	size_t i;
+
+	for(i = 0; i + 16 <= n; i += 16) {
+
+		unsigned int eq = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (a + i)),
+				_mm_loadu_si128((const __m128i *) (b + i))));
+
+		if(eq ^ flip) {
+			return i + (size_t) __builtin_ctz(eq ^ flip);
+		}
+	}
+
+	return i + scan_scalar(a + i, b + i, n - i, differ);
+}
+
+__attribute__((target("avx2,bmi")))
+static size_t scan_avx2(const char *a, const char *b, size_t n, int differ)
+{
+	const uint32_t flip = differ ? ~(uint32_t) 0 : 0;
+	size_t i;
+
+	for(i = 0; i + 32 <= n; i += 32) {
+
+		uint32_t eq = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (a + i)),
+				_mm256_loadu_si256((const __m256i *) (b + i))));
+
+		if(eq ^ flip) {
+			return i + (size_t) __builtin_ctz(eq ^ flip);
+		}
+	}
+
+	return i + scan_scalar(a + i, b + i, n - i, differ);
+}
+
+__attribute__((target("avx512f,avx512bw,bmi")))
+static size_t scan_avx512(const char *a, const char *b, size_t n, int differ)
+{
+	size_t i;
+
+	for(i = 0; i < n; i += 64) {
+
+		__mmask64 valid = n - i >= 64 ? ~(__mmask64) 0 : ((__mmask64) 1 << (n - i)) - 1;
+		__m512i va = _mm512_maskz_loadu_epi8(valid, a + i);
+		__m512i vb = _mm512_maskz_loadu_epi8(valid, b + i);
+		__mmask64 hit = differ ? _mm512_mask_cmpneq_epi8_mask(valid, va, vb) : _mm512_mask_cmpeq_epi8_mask(valid, va, vb);
+
+		if(hit) {
+			return i + (size_t) __builtin_ctzll(hit);
+		}
+	}
+
+	return n;
+}
+
+#endif
+
+/* === Line counting === */
+
+/* SSE2 is part of x86_64, so no dispatch is needed here */
+size_t count_newlines(const char *p, size_t n)
+{
+	size_t i = 0, count = 0;
+
+#ifdef __SSE2__
+	const __m128i nl = _mm_set1_epi8('\n');
+
+	while(i + 16 <= n) {
+
+		/* a byte counter per lane (cmpeq gives -1 for every match), flushed before it can overflow */
+		__m128i acc = _mm_setzero_si128();
+		size_t rounds = 0;
+
+		for(; i + 16 <= n && rounds < 255; i += 16, rounds++) {
+			acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (p + i)), nl));
+		}
+
+		acc = _mm_sad_epu8(acc, _mm_setzero_si128());
+		count += (size_t) _mm_cvtsi128_si32(acc) + (size_t) _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc));
+	}
+#endif
+
+	for(; i < n; i++) {
+		count += p[i] == '\n';
+	}
+
+	return count;
+}
+
+/* === Dispatch === */
+
+/**
+* @brief a kernel together with its name and a check whether the cpu can run it
+*/
+struct kernel {
+
+	const char *name; /**< name as used in MYDIFF_KERNEL */
+	mismatch_kernel_t func[4]; /**< the kernel, indexed by the MISMATCH_ICASE and MISMATCH_SPACE flags */
+	scan_kernel_t scan; /**< the scan kernel of the same width */
+	int (*supported)(void); /**< returns nonzero if the cpu supports the kernel */
+
+};
+
+static int always(void)
+{
+	return 1;
+}
+
+#ifdef HAVE_X86
+static int have_sse2(void)
+{
+	return __builtin_cpu_supports("sse2");
+}
+
+static int have_avx2(void)
+{
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt") && __builtin_cpu_supports("bmi");
+}
+
+static int have_avx512(void)
+{
+	return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("popcnt") && __builtin_cpu_supports("bmi");
+}
+#endif
+
+/** all kernels, narrowest first */
+static const struct kernel kernels[] = {
+	{ "scalar", { mismatch_scalar, mismatch_scalar_i, mismatch_scalar_w, mismatch_scalar_iw }, scan_scalar, always },
+#ifdef HAVE_X86
+	{ "sse2", { mismatch_sse2, mismatch_sse2_i, mismatch_sse2_w, mismatch_sse2_iw }, scan_sse2, have_sse2 },
+	{ "avx2", { mismatch_avx2, mismatch_avx2_i, mismatch_avx2_w, mismatch_avx2_iw }, scan_avx2, have_avx2 },
+	{ "avx512", { mismatch_avx512, mismatch_avx512_i, mismatch_avx512_w, mismatch_avx512_iw }, scan_avx512, have_avx512 },
+#endif
+};
+
+#define NKERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+mismatch_kernel_t count_mismatch = mismatch_scalar;
+
+scan_kernel_t scan_bytes = scan_scalar;
+
+/* pick the last (widest) supported kernel, or the one named by MYDIFF_KERNEL if it is supported */
+static size_t pick_kernel(void)
+{
+	const char *force = getenv("MYDIFF_KERNEL");
+	size_t i, pick = 0;
+
+#ifdef HAVE_X86
+	__builtin_cpu_init();
+#endif
+
+	for(i = 0; i < NKERNELS; i++) {
+
+		if(!kernels[i].supported()) {
+			continue;
+		}
+
+		if(force == NULL || strcmp(force, kernels[i].name) == 0) {
+			pick = i;
+		}
+
+	}
+
+	return pick;
+}
+
+const char *mismatch_init(int flags)
+{
+	size_t pick = pick_kernel();
+
+	count_mismatch = kernels[pick].func[flags & (MISMATCH_ICASE | MISMATCH_SPACE)];
+	scan_bytes = kernels[pick].scan;
+	return kernels[pick].name;
+}
+
+mismatch_kernel_t mismatch_select(int flags)
+{
+	return kernels[pick_kernel()].func[flags & (MISMATCH_ICASE | MISMATCH_SPACE)];
+}
+
+/* === Self test === */
+
+/** number of random lines each kernel has to agree on */
+#define TEST_ROUNDS 200000
+/** maximum length of a random test line */
+#define TEST_MAX_LEN 300
+
+/* xorshift, we want the same test data on every run */
+static uint32_t test_rand(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/* fill line with chars out of a small alphabet (so mismatches are frequent), with an occasional stop char. Upper case and white space for -i and -w */
+static void test_fill(char *line, size_t n, uint32_t *state)
+{
+	size_t i;
+
+	for(i = 0; i < n; i++) {
+
+		uint32_t r = test_rand(state) % 1024;
+
+		line[i] = r == 0 ? '\n' : r == 1 ? '\0' : "ababAB \t"[r & 7];
+	}
+}
+
+/* copy a into b, with some chars changed and some white space inserted and removed. Returns the length of b */
+static size_t test_edit(const char *a, size_t n, char *b, uint32_t *state)
+{
+	size_t i, len = 0, rate = 1 + test_rand(state) % 64;
+
+	for(i = 0; i < n && len < TEST_MAX_LEN; i++) {
+
+		size_t r = test_rand(state) % (rate * 4);
+
+		if(r == 0 && (a[i] == ' ' || a[i] == '\t')) {
+			continue;
+		}
+		if(r == 1 && len + 1 < TEST_MAX_LEN) {
+			b[len++] = " \t\r"[test_rand(state) % 3];
+		}
+
+		b[len++] = r == 2 ? "abcA\n"[test_rand(state) % 5] : a[i];
+	}
+
+	return len;
+}
+
+/*
+* Both lines are placed right in front of a page that can't be read, so a kernel reading past their ends crashes the test.
+* Each round uses random lengths, alignments and contents. Line b is a copy of a with some chars and some white space changed.
+* Every variant of a kernel (plain, -i, -w, -i -w) has to agree with the same variant of the scalar kernel.
+*/
+int mismatch_self_test(void)
+{
+	static const char *variants[] = { "", " -i", " -w", " -i -w" };
+	size_t page = (size_t) sysconf(_SC_PAGESIZE), region = 2 * ((TEST_MAX_LEN + page - 1) / page) * page;
+	char *mem, *end_a, *end_b, line[TEST_MAX_LEN];
+	uint32_t state = 2463534242u;
+	size_t i, k, v;
+	int ret = 0;
+
+	if((mem = mmap(NULL, 2 * region, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+		(void) fprintf(stdout, "self test: could not map test pages\n");
+		return -1;
+	}
+
+	/* each half of the mapping: data pages followed by an inaccessible guard page */
+	if(mprotect(mem + region - page, page, PROT_NONE) == -1 || mprotect(mem + 2 * region - page, page, PROT_NONE) == -1) {
+		(void) fprintf(stdout, "self test: could not protect guard pages\n");
+		(void) munmap(mem, 2 * region);
+		return -1;
+	}
+
+	end_a = mem + region - page;
+	end_b = mem + 2 * region - page;
+
+	for(k = 0; k < NKERNELS; k++) {
+
+		uint32_t seed = state;
+		size_t failed = 0;
+
+		if(!kernels[k].supported()) {
+			(void) fprintf(stdout, "kernel %s: not supported by cpu, skipped\n", kernels[k].name);
+			continue;
+		}
+
+		for(i = 0; i < TEST_ROUNDS && !failed; i++) {
+
+			size_t na = test_rand(&seed) % TEST_MAX_LEN, nb, n;
+			char *a = end_a - na, *b;
+			size_t ref_a, ref_b, stop_a, stop_b, ref, count;
+			int differ;
+
+			test_fill(a, na, &seed);
+			nb = test_edit(a, na, line, &seed);
+			b = end_b - nb;
+			memcpy(b, line, nb);
+
+			for(v = 0; v < 4 && !failed; v++) {
+
+				ref = kernels[0].func[v](a, na, b, nb, &ref_a, &ref_b);
+				count = kernels[k].func[v](a, na, b, nb, &stop_a, &stop_b);
+
+				if(count != ref || stop_a != ref_a || stop_b != ref_b) {
+					(void) fprintf(stdout, "kernel %s%s: FAILED (lengths %lu/%lu: counted %lu up to %lu/%lu, expected %lu up to %lu/%lu)\n",
+							kernels[k].name, variants[v], (unsigned long) na, (unsigned long) nb, (unsigned long) count,
+							(unsigned long) stop_a, (unsigned long) stop_b, (unsigned long) ref, (unsigned long) ref_a, (unsigned long) ref_b);
+					failed = 1;
+					ret = -1;
+				}
+			}
+
+			/* the same data serves the scan kernel, for both directions */
+			n = na < nb ? na : nb;
+			differ = (int) (test_rand(&seed) & 1);
+			ref = scan_scalar(a, b, n, differ);
+			count = kernels[k].scan(a, b, n, differ);
+
+			if(!failed && count != ref) {
+				(void) fprintf(stdout, "kernel %s: FAILED (length %lu: scan for %s bytes gave %lu, expected %lu)\n",
+						kernels[k].name, (unsigned long) n, differ ? "differing" : "equal", (unsigned long) count, (unsigned long) ref);
+				failed = 1;
+				ret = -1;
+			}
+		}
+
+		if(!failed) {
+			(void) fprintf(stdout, "kernel %s: ok\n", kernels[k].name);
+		}
+	}
+
+	(void) munmap(mem, 2 * region);
+	return ret;
+}
@@ -0,0 +1,101 @@
+/**
+* @file mismatch.h
+* @brief header file for the mismatch counting and byte scanning kernels (scalar, SSE2, AVX2, AVX-512), optionally ignoring case and white space
+*/
+
+#ifndef MISMATCH_H
+#define MISMATCH_H
+#include <stddef.h> //needed for size_t
+
+/**
+* @brief Does given char signal EOL. NULL char means end of comparable line content
+*/
+#define STOP_COMPARE_CHAR(c) ((c) == 0 || (c) == '\n')
+
+/**
+* @brief flag for mismatch_init: ASCII letters are compared without regard to case (-i)
+*/
+#define MISMATCH_ICASE 1
+
+/**
+* @brief flag for mismatch_init: white space other than '\n' is skipped in both lines, the remaining chars are compared pairwise (-w)
+*/
+#define MISMATCH_SPACE 2
+
+/**
+* @brief type definition of a mismatch counting kernel.
+* Compares a and b char by char until one of them holds a STOP_COMPARE_CHAR or its end is reached.
+* Without MISMATCH_SPACE both lines advance in step, so *stop_a and *stop_b are the same
+*
+* @param a chars of the first line
+* @param na number of chars that may be read from a
+* @param b chars of the second line
+* @param nb number of chars that may be read from b
+* @param stop_a receives the index in a where comparing stopped (at a STOP_COMPARE_CHAR of a or b, or at the end)
+* @param stop_b receives the index in b where comparing stopped
+*
+* @return number of mismatching chars in front of the stops
+*/
+typedef size_t (*mismatch_kernel_t)(const char *a, size_t na, const char *b, size_t nb, size_t *stop_a, size_t *stop_b);
+
+/**
+* @brief the kernel selected by mismatch_init(). Defaults to the scalar kernel
+*/
+extern mismatch_kernel_t count_mismatch;
+
+/**
+* @brief type definition of a byte scanning kernel. Unlike the mismatch kernels it doesn't care about line ends
+*
+* @param a first buffer
+* @param b second buffer
+* @param n number of bytes that may be read from both a and b
+* @param differ 1 to find the first differing byte, 0 to find the first equal one
+*
+* @return index of the first byte i with (a[i] != b[i]) == differ, n if there is none
+*/
+typedef size_t (*scan_kernel_t)(const char *a, const char *b, size_t n, int differ);
+
+/**
+* @brief the scan kernel selected by mismatch_init(), same width as count_mismatch. It never normalizes
+*/
+extern scan_kernel_t scan_bytes;
+
+/**
+* @brief select the widest kernel the cpu supports. The environment variable MYDIFF_KERNEL
+* (scalar, sse2, avx2, avx512) may be used to force a specific one
+*
+* @param flags MISMATCH_ICASE and / or MISMATCH_SPACE to select a normalizing variant of the kernel, 0 else
+*
+* @return name of the selected kernel
+*/
+const char *mismatch_init(int flags);
+
+/**
+* @brief the kernel mismatch_init would select, without touching count_mismatch and scan_bytes.
+* For users that need kernels with different flags at the same time
+*
+* @param flags MISMATCH_ICASE and / or MISMATCH_SPACE to select a normalizing variant of the kernel, 0 else
+*
+* @return the kernel
+*/
+mismatch_kernel_t mismatch_select(int flags);
+
+/**
+* @brief count the '\n' chars in a buffer, 16 chars at once where SSE2 is available
+*
+* @param p first char of the buffer
+* @param n number of chars in the buffer
+*
+* @return number of '\n' chars in p[0] .. p[n - 1]
+*/
+size_t count_newlines(const char *p, size_t n);
+
+/**
+* @brief check that every kernel supported by the cpu gives the same results as the scalar one
+* on random lines of various lengths, alignments and stop char positions, in all normalizing variants. The scan kernels are checked on the same lines. Reports on stdout
+*
+* @return 0 if all kernels agree, -1 else
+*/
+int mismatch_self_test(void);
+
+#endif
@@ -0,0 +1,342 @@
+/**
+* @file moved.c
+* @brief find the blocks of one input in the other one, wherever they have been moved to
+* @details Like rsync: the first input is cut into blocks of MOVED_BLOCK bytes, each one gets a hash, the hashes go into a table.
+* A window of MOVED_BLOCK bytes slides over the second input, its hash is rolled along a byte at a time. Whenever it is found
+* in the table (and the bytes really are equal), the window jumps past the block. So every byte of the second input is looked at
+* a constant number of times. rsync's checksum (two 16 bit sums) clusters badly on text, so the rolling hash is a Karp-Rabin
+* polynomial modulo 2^64. Found blocks that continue each other are joined into runs. The runs that keep the order of the first input
+* are picked by a longest increasing sequence weighted by their lengths (a Fenwick tree over the block numbers), the others have moved.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "moved.h"
+#include "workpool.h"
+#include "stats.h"
+
+/* === Constants === */
+
+/** Base of the polynomial hash, odd and with its bits spread out */
+#define HASH_BASE 0x9e3779b97f4a7c15ULL
+
+/** Number of blocks hashed per task */
+#define BLOCKS_PER_TASK 4096
+
+/** No block */
+#define NONE ((size_t) -1)
+
+/* === Structures === */
+
+/**
+* @brief hashes of the blocks of the first input and a table to look them up
+*/
+struct index {
+
+	const char *data; /**< the first input */
+	size_t n; /**< number of whole blocks in it */
+	uint64_t *hash; /**< hash of every block */
+	size_t *table; /**< open addressing table of block numbers + 1, 0 for empty slots. Holds the first of equal blocks only */
+	unsigned int bits; /**< the table has 2^bits slots */
+
+};
+
+/**
+* @brief bytes of the second input found in the first one
+*/
+struct run {
+
+	size_t b; /**< offset in the second input */
+	size_t a; /**< offset in the first input */
+	size_t len; /**< length of the run */
+	size_t pred; /**< run in front of it in the heaviest increasing sequence ending with it, NONE if none */
+	int moved; /**< nonzero if it is out of order */
+
+};
+
+/**
+* @brief runs found so far
+*/
+struct runs {
+
+	struct run *r; /**< the runs, in the order of the second input */
+	size_t n; /**< number of runs */
+	size_t cap; /**< allocated runs */
+
+};
+
+/**
+* @brief a node of the Fenwick tree: the heaviest increasing sequence of runs ending at a block up to the node's
+*/
+struct best {
+
+	uint64_t weight; /**< bytes in the sequence */
+	size_t run; /**< its last run, NONE if it is empty */
+
+};
+
+/* === Implementation === */
+
+/* hash of a window of MOVED_BLOCK bytes: x0 * B^(L - 1) + x1 * B^(L - 2) + ... + x(L - 1) */
+static uint64_t block_hash(const char *p)
+{
+	uint64_t h = 0;
+	size_t i;
+
+	for(i = 0; i < MOVED_BLOCK; i++) {
+		h = h * HASH_BASE + (unsigned char) p[i];
+	}
+
+	return h;
+}
+
+static void block_task(void *arg, size_t task)
+{
+	struct index *x = arg;
+	size_t k, last = (task + 1) * BLOCKS_PER_TASK < x->n ? (task + 1) * BLOCKS_PER_TASK : x->n;
+
+	for(k = task * BLOCKS_PER_TASK; k < last; k++) {
+		x->hash[k] = block_hash(x->data + k * MOVED_BLOCK);
+	}
+}
+
+/* the high bits of the hash depend on all bytes of the window, the low ones on the last few only */
+static size_t slot(const struct index *x, uint64_t h)
+{
+	return (size_t) (h >> (64 - x->bits));
+}
+
+static int index_build(struct index *x, const struct input *a, unsigned int jobs)
+{
+	size_t k, mask;
+
+	x->data = a->data;
+	x->n = a->size / MOVED_BLOCK;
+	x->hash = NULL;
+	x->table = NULL;
+
+	for(x->bits = 1; ((size_t) 1 << x->bits) < 2 * x->n; x->bits++);
+	mask = ((size_t) 1 << x->bits) - 1;
+
+	if((x->hash = malloc(x->n * sizeof(*x->hash) + 1)) == NULL || (x->table = calloc(mask + 1, sizeof(*x->table))) == NULL) {
+		return -1;
+	}
+
+	if(workpool_run(jobs, (x->n + BLOCKS_PER_TASK - 1) / BLOCKS_PER_TASK, block_task, x) == -1) {
+		return -1;
+	}
+
+	for(k = 0; k < x->n; k++) {
+
+		size_t s = slot(x, x->hash[k]);
+
+		while(x->table[s] && x->hash[x->table[s] - 1] != x->hash[k]) {
+			s = (s + 1) & mask;
+		}
+
+		if(!x->table[s]) {
+			x->table[s] = k + 1;
+		}
+	}
+
+	return 0;
+}
+
+/* block of a equal to the window p with hash h. The block following the previous one found comes first, so runs stay together */
+static size_t index_find(const struct index *x, uint64_t h, const char *p, size_t prev)
+{
+	size_t mask = ((size_t) 1 << x->bits) - 1, s, k;
+
+	if(prev != NONE && prev + 1 < x->n && x->hash[prev + 1] == h && memcmp(p, x->data + (prev + 1) * MOVED_BLOCK, MOVED_BLOCK) == 0) {
+		return prev + 1;
+	}
+
+	for(s = slot(x, h); x->table[s]; s = (s + 1) & mask) {
+
+		k = x->table[s] - 1;
+
+		if(x->hash[k] == h) {
+			return memcmp(p, x->data + k * MOVED_BLOCK, MOVED_BLOCK) == 0 ? k : NONE;
+		}
+	}
+
+	return NONE;
+}
+
+/* append a found block (or the tail of a), joined with the run in front if both continue it */
+static int add_run(struct runs *rs, size_t b, size_t a, size_t len)
+{
+	struct run *last = rs->n ? &rs->r[rs->n - 1] : NULL;
+
+	if(last != NULL && last->b + last->len == b && last->a + last->len == a) {
+		last->len += len;
+		return 0;
+	}
+
+	if(rs->n == rs->cap) {
+
+		size_t cap = rs->cap ? 2 * rs->cap : 256;
+		struct run *r = realloc(rs->r, cap * sizeof(*r));
+
+		if(r == NULL) {
+			return -1;
+		}
+
+		rs->r = r;
+		rs->cap = cap;
+	}
+
+	rs->r[rs->n].b = b;
+	rs->r[rs->n].a = a;
+	rs->r[rs->n].len = len;
+	rs->r[rs->n].pred = NONE;
+	rs->r[rs->n].moved = 1;
+	rs->n++;
+
+	return 0;
+}
+
+/* slide the window over b, jump past every block found */
+static int scan(struct runs *rs, const struct index *x, const struct input *a, const struct input *b)
+{
+	const unsigned char *p = (const unsigned char *) b->data;
+	uint64_t h = 0, top = 1;
+	size_t pos = 0, prev = NONE, i, tail = a->size - x->n * MOVED_BLOCK, free_from = 0;
+	int have = 0;
+
+	/* B^(L - 1), the weight of the byte leaving the window */
+	for(i = 1; i < MOVED_BLOCK; i++) {
+		top *= HASH_BASE;
+	}
+
+	while(x->n && pos + MOVED_BLOCK <= b->size) {
+
+		size_t k;
+
+		if(!have) {
+			h = block_hash(b->data + pos);
+			have = 1;
+		}
+
+		if((k = index_find(x, h, b->data + pos, prev)) != NONE) {
+
+			if(add_run(rs, pos, k * MOVED_BLOCK, MOVED_BLOCK) == -1) {
+				return -1;
+			}
+
+			prev = k;
+			pos += MOVED_BLOCK;
+			free_from = pos;
+			have = 0;
+			continue;
+		}
+
+		if(pos + MOVED_BLOCK == b->size) {
+			break;
+		}
+
+		h = (h - p[pos] * top) * HASH_BASE + p[pos + MOVED_BLOCK];
+		pos++;
+	}
+
+	/* the tail of a is shorter than a block, it can only be found at the very end of b */
+	if(tail && b->size - free_from >= tail && memcmp(b->data + b->size - tail, a->data + x->n * MOVED_BLOCK, tail) == 0) {
+		return add_run(rs, b->size - tail, x->n * MOVED_BLOCK, tail);
+	}
+
+	return 0;
+}
+
+/* keep the heaviest sequence of runs in increasing order of their blocks in a, the rest has moved */
+static int pick_order(struct runs *rs, size_t nblocks)
+{
+	struct best *tree, top = { 0, NONE };
+	size_t j, i, run;
+
+	/* keys are block numbers + 1 (the tail of a being block nblocks), key 0 is the empty sequence */
+	if((tree = calloc(nblocks + 2, sizeof(*tree))) == NULL) {
+		return -1;
+	}
+	for(i = 0; i < nblocks + 2; i++) {
+		tree[i].run = NONE;
+	}
+
+	for(j = 0; j < rs->n; j++) {
+
+		struct best b = { 0, NONE };
+		size_t key = rs->r[j].a / MOVED_BLOCK + 1;
+
+		/* heaviest sequence ending at a block in front of this run's first one */
+		for(i = key - 1; i > 0; i -= i & -i) {
+			if(tree[i].weight > b.weight) {
+				b = tree[i];
+			}
+		}
+
+		rs->r[j].pred = b.run;
+		b.weight += rs->r[j].len;
+		b.run = j;
+
+		if(b.weight > top.weight) {
+			top = b;
+		}
+
+		for(i = key; i < nblocks + 2; i += i & -i) {
+			if(b.weight > tree[i].weight) {
+				tree[i] = b;
+			}
+		}
+	}
+
+	for(run = top.run; run != NONE; run = rs->r[run].pred) {
+		rs->r[run].moved = 0;
+	}
+
+	free(tree);
+	return 0;
+}
+
+int compare_moved(FILE *out, const struct input *a, const struct input *b, unsigned int jobs)
+{
+	struct runs rs = { NULL, 0, 0 };
+	struct index x;
+	size_t j, end = 0;
+	int ret = -1;
+
+	stats_phase(stats_index);
+
+	if(index_build(&x, a, jobs) == -1) {
+		goto out;
+	}
+
+	stats_phase(stats_compare);
+
+	if(scan(&rs, &x, a, b) == -1 || pick_order(&rs, x.n) == -1) {
+		goto out;
+	}
+
+	for(j = 0; j < rs.n; j++) {
+
+		const struct run *r = &rs.r[j];
+
+		if(r->b > end) {
+			(void) fprintf(out, "Neu: %lu Länge: %lu\n", (unsigned long) end, (unsigned long) (r->b - end));
+		}
+
+		(void) fprintf(out, "%s: %lu Länge: %lu Quelle: %lu\n", r->moved ? "Verschoben" : "Gleich", (unsigned long) r->b, (unsigned long) r->len, (unsigned long) r->a);
+		end = r->b + r->len;
+	}
+
+	if(b->size > end) {
+		(void) fprintf(out, "Neu: %lu Länge: %lu\n", (unsigned long) end, (unsigned long) (b->size - end));
+	}
+
+	ret = 0;
+
+out:
+	free(x.hash);
+	free(x.table);
+	free(rs.r);
+
+	return ret;
+}
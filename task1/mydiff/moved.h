@@ -0,0 +1,34 @@
+/**
+* @file moved.h
+* @brief header file for the detection of moved blocks (rsync style: an index of block hashes of one input, a rolling hash over the other)
+*/
+
+#ifndef MOVED_H
+#define MOVED_H
+#include <stdio.h> //needed for FILE
+#include "input.h"
+
+/**
+* @brief size of the blocks of the first input, that are looked for in the second one
+*/
+#define MOVED_BLOCK 1024
+
+/**
+* @brief find the blocks of a in b, wherever they are, and report b as runs of bytes in its order:
+* "Gleich: OFFSET Länge: LENGTH Quelle: OFFSET_A" for runs found in the same order as in a,
+* "Verschoben: OFFSET Länge: LENGTH Quelle: OFFSET_A" for runs found, but out of that order (moved),
+* "Neu: OFFSET Länge: LENGTH" for runs not found in a. Offsets count from 0.
+* The order is the one keeping most bytes in place (a longest increasing sequence of the runs, weighted by their lengths).
+* Runs in the same order as in a are kept together, so an insertion doesn't make the rest of b look moved.
+* The time taken is linear in the size of the inputs
+*
+* @param out stream to print the runs to
+* @param a first input (in memory, i.e. mapped or loaded)
+* @param b second input (in memory)
+* @param jobs number of threads to hash the blocks of a with
+*
+* @return 0 on success, -1 if memory or threads could not be allocated
+*/
+int compare_moved(FILE *out, const struct input *a, const struct input *b, unsigned int jobs);
+
+#endif
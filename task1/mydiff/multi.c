@@ -0,0 +1,103 @@
+/**
+* @file multi.c
+* @brief compare a reference against many candidates on a pool of threads
+* @details Every candidate is a task of a work pool and gets compared into its own memory stream.
+* The calling thread prints the streams in order of the candidates as soon as they are ready.
+* Whatever the callback needs of the reference (mapping, line index) is set up once by the caller and shared read-only by all tasks.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "multi.h"
+#include "workpool.h"
+
+/* === Structures === */
+
+/**
+* @brief output of a candidate
+*/
+struct result {
+
+	int ret; /**< return value of the comparison, -2 if the output buffer could not be allocated */
+	char *buf; /**< output of the comparison */
+	size_t len; /**< length of the output */
+
+};
+
+/**
+* @brief state shared by all tasks of a one to many comparison
+*/
+struct multi {
+
+	char *const *paths; /**< paths of the candidates */
+	struct result *results; /**< result per candidate */
+	multi_compare_t cmp; /**< callback comparing a candidate */
+	void *arg; /**< argument of cmp */
+
+};
+
+/* === Implementation === */
+
+static void candidate_task(void *arg, size_t task)
+{
+	struct multi *m = arg;
+	struct result *r = &m->results[task];
+	FILE *out;
+
+	if((out = open_memstream(&r->buf, &r->len)) == NULL) {
+		r->ret = -2;
+		return;
+	}
+
+	r->ret = m->cmp(out, m->paths[task], m->arg);
+
+	if(fclose(out) != 0) {
+		r->ret = -2;
+	}
+}
+
+long compare_many(FILE *out, char *const *paths, size_t n, unsigned int jobs, multi_compare_t cmp, void *arg)
+{
+	struct multi m;
+	struct workpool wp;
+	size_t i;
+	long failed = 0;
+	int nomem = 0;
+
+	m.paths = paths;
+	m.cmp = cmp;
+	m.arg = arg;
+
+	if((m.results = calloc(n, sizeof(*m.results))) == NULL) {
+		return -1;
+	}
+
+	if(workpool_start(&wp, jobs, n, candidate_task, &m) == -1) {
+		free(m.results);
+		return -1;
+	}
+
+	/* print the candidates in order, as soon as they are ready */
+	for(i = 0; i < n; i++) {
+
+		struct result *r = &m.results[i];
+
+		workpool_wait(&wp, i);
+
+		if(r->ret == 0) {
+			(void) fprintf(out, "Datei: %s\n", paths[i]);
+			(void) fwrite(r->buf, 1, r->len, out);
+		} else if(r->ret == -1) {
+			failed++;
+		} else {
+			nomem = 1;
+		}
+
+		free(r->buf);
+		r->buf = NULL;
+	}
+
+	workpool_join(&wp);
+	free(m.results);
+
+	return nomem ? -1 : failed;
+}
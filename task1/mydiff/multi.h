@@ -0,0 +1,37 @@
+/**
+* @file multi.h
+* @brief header file for mydiff's one to many comparison: a reference file against any number of candidates
+*/
+
+#ifndef MULTI_H
+#define MULTI_H
+#include <stdio.h> //needed for FILE
+#include <stddef.h> //needed for size_t
+
+/**
+* @brief type definition of the callback comparing a single candidate against the reference.
+*
+* @param out stream to print the differences to
+* @param path path of the candidate
+* @param arg argument given to compare_many
+*
+* @return 0 on success, -1 if the candidate could not be compared (the callback reports why)
+*/
+typedef int (*multi_compare_t)(FILE *out, const char *path, void *arg);
+
+/**
+* @brief compare the candidates on a pool of jobs threads. The results are printed in order of the candidates,
+* each one as "Datei: PATH" followed by the output of cmp
+*
+* @param out stream to print the results to
+* @param paths paths of the candidates
+* @param n number of candidates
+* @param jobs number of candidates compared at the same time
+* @param cmp callback comparing a single candidate (called on the pool's threads)
+* @param arg passed on to cmp
+*
+* @return number of candidates cmp failed on, -1 if memory or threads could not be allocated
+*/
+long compare_many(FILE *out, char *const *paths, size_t n, unsigned int jobs, multi_compare_t cmp, void *arg);
+
+#endif
@@ -2,19 +2,27 @@
  * @file mydiff.c
  * @author Georg Hubinger (9947673) <georg.hubinger@tuwien.ac.at>
  * @brief Compare two text files
- * @details Reads two text files line by line and compares the lines char by char.
+ * @details Maps two text files into memory and compares them line by line, char by char.
+ * Lines may be of any length, they are compared in place without copying, 16 to 64 chars at once (see mismatch.h).
+ * FILE may also be '-' (stdin) or /dev/fd/N. Such streams are read on a separate thread while being compared.
  * If one of the files reaches EOF, comparisson will stop. If one line is shorter than the other one, comparisson will stop.
+ * The options and what each of them prints are listed by the usage text.
  * Outputs the line number where mismatches occured followed by the number of mismatches (Zeile: LINENO Zeichen: COUNT)
+ * All of the comparing is done by libmydiff (see libmydiff.h), this is just its command line.
  * @date 16.10.2013
  */
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <errno.h>
-
-/** Maximum line length to compare  */
-#define MAX_LEN	20
+#include <unistd.h>
+#include <getopt.h>
+#include "libmydiff.h"
+#include "mismatch.h"
+#include "distance.h"
+#include "bitmap.h"
+#include "cluster.h"
+#include "utf8.h"
 
 /** Bailout with formatted error message */
 #define exit_error(fmt, ...) \
@@ -29,10 +37,14 @@ char *pname = NULL;
 /** Gives the argv index of the first positional argument. Visibility: global. Defined in stdio.h */
 extern int optind;
 
-/** FILE pointer for first files to compare */
-FILE *f1 = NULL;
-/** FILE pointer for second first files to compare */
-FILE *f2 = NULL; 
+/** Options as given on the command line */
+struct mydiff_options opts = MYDIFF_OPTIONS_INIT;
+
+/** getopt_long value of --hash-only, which has no short option */
+#define OPT_HASH_ONLY 256
+
+/** getopt_long value of --cluster, which has no short option */
+#define OPT_CLUSTER 257
 
 /** Print out usage message */
 static void usage(void);
@@ -44,11 +56,11 @@ static void usage(void);
 */
 static void parse_args(int argc, char **argv);
 
-/** Compare the two given files. Outputs line number and number of mismatches to stdout */
-static void compare(void);
-
-/** close FILE pointers f1 and f2 */
-static void cleanup(void);
+/** Bail out if an option is given twice
+* @param seen nonzero if the option has been given before
+* @param opt the option as printed
+*/
+static void once(int seen, const char *opt);
 
 /**
  * Programm's main entry point
@@ -62,103 +74,175 @@ int main(int argc, char **argv)
 
 	if(argc) pname = argv[0]; /* assume argv[0] holds programm name */
 	
-	parse_args(argc, argv); /* This bails out on wrong/unknown arguments or inexistant file. */
-
-	compare(); /* Compare the two files. Prints out differences to stdout. */
+	parse_args(argc, argv); /* This bails out on wrong/unknown arguments. */
 
-	cleanup(); /* Close previously opened FILE pointers */
+	/* Compare the files. Prints out differences to stdout, errors have been reported on stderr */
+	if(mydiff_run(stdout, &opts, argv + optind, (size_t) (argc - optind)) == -1) {
+		exit(EXIT_FAILURE);
+	}
 
 	/* quit */
 	return 0;
 	
 }
 
-/** Does given char signal EOL. NULL char means either end of last line in file or line size exceeded buffer size */
-#define STOP_COMPARE_CHAR(c) ((c) == 0 || (c) == '\n') 
-static void compare(void)
-{
-
-	char buf1[MAX_LEN], buf2[MAX_LEN]; /* char buffers of size MAX_LEN */
-	int line = 1; /* currently compared line */
-
-	/* if f1 reaches EOF, quit comparing */
-	while(fgets(buf1, MAX_LEN, f1) != NULL) {
-
-		int n = 0; /* init mismatching char counter */
-
-		/* if f2 to reaches EOF, quit comparing */
-		if(fgets(buf2, MAX_LEN, f2) == NULL) {
-			break;
-		}
-		/* 
-		* point c1 and c2 to the beginning of buf1 and buf2.
-		* check if we need to continue comparison.
-		* move to next chars.
-		*/
-		for(char *c1 = buf1, *c2 = buf2; !(STOP_COMPARE_CHAR(*c1) || STOP_COMPARE_CHAR(*c2)); c1++, c2++) {
-
-			if(*c1 != *c2) {
-				n++; /* increment mismatching char counter */
-			}			
-
-		}
-	
-		if(n) {
-			fprintf(stdout, "Zeile: %d Zeichen: %d\n", line, n); /* if we had any mismatch, print out line number and number of mismatching chars */
-		}
-
-		line++; /* increment line number */
-	
-	}	
-
-}
-
-static void cleanup(void)
+static void once(int seen, const char *opt)
 {
-
-	if(f1) (void) fclose(f1);
-	if(f2) (void) fclose(f2);
-
-	f1 = f2 = NULL;
-
+	if(seen) {
+		(void) fprintf(stderr, "Option %s darf nur einmal angegeben werden\n", opt);
+		usage();
+	}
 }
 
 static void parse_args(int argc, char **argv)
 {
 
-	char *fmt = "%s: Datei '%s' konnte nicht geöffnet werden%s!\n", *err = "";
-
-	/* we don't want any POSIX style options and we expect exactly 2 positional args */
-	if(getopt(argc, argv, "") != -1 || (argc - optind) != 2) {
-		usage();
+	static const struct option longopts[] = {
+		{ "hash", no_argument, NULL, 'H' },
+		{ "hash-only", no_argument, NULL, OPT_HASH_ONLY },
+		{ "index", no_argument, NULL, 'I' },
+		{ "distance", no_argument, NULL, 'e' },
+		{ "ignore-case", no_argument, NULL, 'i' },
+		{ "ignore-all-space", no_argument, NULL, 'w' },
+		{ "io-uring", no_argument, NULL, 'u' },
+		{ "bitmap", required_argument, NULL, 'B' },
+		{ "moved", no_argument, NULL, 'm' },
+		{ "verbose", no_argument, NULL, 'v' },
+		{ "cluster", optional_argument, NULL, OPT_CLUSTER },
+		{ "utf8", no_argument, NULL, 'U' },
+		{ NULL, 0, NULL, 0 }
+	};
+	int c, seen_j = 0;
+	const char *conflict;
+	char *end;
+	long jobs;
+	double similarity;
+
+	opts.name = pname;
+
+	/* -t runs the self tests, without it we expect at least 2 positional args */
+	while((c = getopt_long(argc, argv, "taHIbeiwumvUj:B:", longopts, NULL)) != -1) {
+		switch(c) {
+			case 't':
+				(void) mismatch_init(0);
+				exit(mismatch_self_test() == 0 && distance_self_test() == 0 && mydiff_self_test() == 0 && bitmap_self_test() == 0 && cluster_self_test() == 0 && utf8_self_test() == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+			break;
+			case 'a':
+				once(opts.align, "-a");
+				opts.align = 1;
+			break;
+			case 'I':
+				once(opts.index, "-I");
+				opts.index = 1;
+			break;
+			case 'b':
+				once(opts.binary, "-b");
+				opts.binary = 1;
+			break;
+			case 'i':
+				once(opts.icase, "-i");
+				opts.icase = 1;
+			break;
+			case 'w':
+				once(opts.space, "-w");
+				opts.space = 1;
+			break;
+			case 'u':
+				once(opts.uring, "-u");
+				opts.uring = 1;
+			break;
+			case 'm':
+				once(opts.moved, "-m");
+				opts.moved = 1;
+			break;
+			case 'U':
+				once(opts.utf8, "-U");
+				opts.utf8 = 1;
+			break;
+			case 'v':
+				once(opts.verbose, "-v");
+				opts.verbose = 1;
+			break;
+			case 'B':
+				once(opts.bitmap != NULL, "-B");
+				opts.bitmap = optarg;
+			break;
+			case 'e':
+				once(opts.distance, "-e");
+				opts.distance = 1;
+			break;
+			case 'H':
+			case OPT_HASH_ONLY:
+				if(opts.hash) {
+					(void) fprintf(stderr, "Optionen -H und --hash-only dürfen nur einmal angegeben werden\n");
+					usage();
+				}
+				opts.hash = c == 'H' ? 1 : 2;
+			break;
+			case OPT_CLUSTER:
+				once(opts.cluster > 0, "--cluster");
+
+				similarity = CLUSTER_THRESHOLD;
+				if(optarg != NULL) {
+					similarity = strtod(optarg, &end);
+					if(*optarg == '\0' || *end != '\0' || !(similarity > 0 && similarity <= 1)) {
+						exit_error("%s: Ungültige Ähnlichkeit '%s' (0 - 1)!\n", pname, optarg);
+					}
+				}
+				opts.cluster = similarity;
+			break;
+			case 'j':
+				once(seen_j, "-j");
+				seen_j = 1;
+
+				jobs = strtol(optarg, &end, 10);
+				if(*optarg == '\0' || *end != '\0' || jobs < 1 || jobs > 1024) {
+					exit_error("%s: Ungültige Anzahl an Threads '%s' (1 - 1024)!\n", pname, optarg);
+				}
+				opts.jobs = (unsigned int) jobs;
+			break;
+			default:
+				usage();
+			break;
+		}
 	}
 
-	/* test if first file exists */
-	if((f1 = fopen(argv[optind], "r")) == NULL) {
-
-		if (errno != 0) {
-			fmt = "%s: Datei '%s' konnte nicht geöffnet werden (%s)!\n";
-			err = strerror(errno);
-		} 
-
-		exit_error(fmt, pname, argv[optind], err); /* bailout */
+	if((argc - optind) < 2) {
+		usage();
 	}
 
-	/* test if second file exists */
-	if((f2 = fopen(argv[optind + 1], "r")) == NULL) {
-
-		cleanup();
-
-		if (errno != 0) {
-			fmt = "%s: Datei '%s' konnte nicht geöffnet werden (%s)!\n";
-			err = strerror(errno);
-		} 
-
-		exit_error(fmt, pname, argv[optind + 1], err); /* bailout */
+	if((conflict = mydiff_check(&opts, argv + optind, (size_t) (argc - optind))) != NULL) {
+		(void) fprintf(stderr, "%s\n", conflict);
+		usage();
 	}
 }
 
 static void usage(void) 
 {
-	exit_error("Usage: %s FILE1 FILE2\n", pname);
+	exit_error("Usage: %s [-v] [-j N] [-I] [-i] [-w] [-u | -B BITMAP] [-a | -H | --hash-only | -e | -b | -m | -U] FILE1|- FILE2|-\n       %s [-v] [-j N] [-i] [-w] [-a | -H | --hash-only | -e | -b | -m | -U] DIR1 DIR2\n       %s [-v] [-j N] [-i] [-w] [-a | -H | --hash-only | -e | -b] REF CAND1 CAND2 ...\n       %s [-v] [-j N] --cluster[=SIMILARITY] FILE1 FILE2 ...\n       %s -t\n"
+		"Optionen:\n"
+		"  -v, --verbose          Zeiten, Bytes, Zeilen, Durchsatz und Seitenfehler auf stderr ausgeben\n"
+		"  -j N                   Zeilenbereiche zweier Dateien auf N Threads verteilt vergleichen, die Ausgabe bleibt gleich;\n"
+		"                         bei zwei Verzeichnissen N Dateien gleichzeitig, bei mehreren Kandidaten N Kandidaten gleichzeitig\n"
+		"  -I, --index            Zeilenindex neben jeder Datei halten (FILE.mdx), das Ausgegebene neben der ersten (FILE1.mdr);\n"
+		"                         nach einer Änderung werden nur die Paare mit geänderten Zeilen neu verglichen\n"
+		"  -i                     Groß- und Kleinbuchstaben als gleich ansehen\n"
+		"  -w                     Leerraum in beiden Zeilen überspringen, die übrigen Zeichen paarweise vergleichen\n"
+		"  -u, --io-uring         Dateien über io_uring lesen statt sie einzublenden, hält eine kalte Platte beschäftigt\n"
+		"  -B BITMAP, --bitmap    nichts ausgeben, die abweichenden Zeilen als komprimierte Bitmap nach BITMAP schreiben (lesbar mit mdquery)\n"
+		"  -a                     Zeilen zuerst abgleichen (Myers' O(ND)), eingefügte oder gelöschte Zeilen verschieben den Rest nicht\n"
+		"  -H, --hash             gleiche Zeilen in einem Durchlauf über beide Dateien überspringen, ohne Hash-Vorlauf,\n"
+		"                         nur abweichende Zeilen Zeichen für Zeichen vergleichen; zwei Dateien auf einem Thread, also ohne -j (außer mit -I)\n"
+		"  --hash-only            wie -H, aber nur die Nummern abweichender Zeilen ausgeben (Zeile: LINENO)\n"
+		"  -e, --distance         wie -H, aber die Levenshtein-Distanz abweichender Zeilen ausgeben (Zeile: LINENO Distanz: DISTANCE)\n"
+		"  -b                     binär vergleichen, NUL und '\\n' sind gewöhnliche Bytes (Offset: OFFSET Länge: LENGTH)\n"
+		"  -m, --moved            verschobene Blöcke von 1 KiB finden, die zweite Datei wird als\n"
+		"                         Gleich:/Verschoben:/Neu: OFFSET Länge: LENGTH ausgegeben\n"
+		"  -U, --utf8             nach Code Points statt Bytes vergleichen, ungültiges UTF-8 als Zeile: LINENO Ungültiges UTF-8: FILE melden\n"
+		"  --cluster[=SIMILARITY] nahezu gleiche Dateien per MinHash suchen, nur Paare ab SIMILARITY (Standard 0.8) vergleichen\n"
+		"                         (Paar: FILE1 FILE2 Ähnlichkeit: ESTIMATE)\n"
+		"  -t                     Selbsttests ausführen\n"
+		"Ausgabe: Zeile: LINENO Zeichen: COUNT je Zeilenpaar mit abweichenden Zeichen\n"
+		"Bei DIR1 DIR2: Datei: PATH vor den Unterschieden jeder Datei, Nur in DIR: PATH für fehlende Dateien\n"
+		"Bei REF CAND1 CAND2 ...: Datei: CAND vor den Unterschieden jedes Kandidaten\n", pname, pname, pname, pname, pname);
 }
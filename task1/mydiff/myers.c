@@ -0,0 +1,326 @@
+/**
+* @file myers.c
+* @brief align two inputs line by line with Myers' O(ND) difference algorithm (linear space variant) and print the edit script
+* @details The inputs are split recursively at the middle of a shortest edit path, which is found by searching
+* forward from the start and backward from the end at the same time. Lines that are not part of the common subsequence
+* get marked in a bitmap, the edit script is printed by walking both bitmaps afterwards.
+* If the search takes too many steps, the furthest reaching point found so far is used as split point instead (like GNU diff does),
+* which bounds both time and memory at the cost of an edit script, that may not be minimal.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "myers.h"
+#include "lines.h"
+#include "mismatch.h"
+#include "stats.h"
+
+/* === Macros === */
+
+/** Mark bit i in bitmap m */
+#define BIT_SET(m, i) ((m)[(i) >> 3] |= (unsigned char) (1 << ((i) & 7)))
+
+/** Test bit i in bitmap m */
+#define BIT_TEST(m, i) ((m)[(i) >> 3] & (1 << ((i) & 7)))
+
+/** Furthest reaching x on forward diagonal d (relative to the diagonal the search started on) */
+#define FD(d) (m->fd[(d) - fmid + m->cap + 2])
+
+/** Furthest reaching x on backward diagonal d (relative to the diagonal the search started on) */
+#define BD(d) (m->bd[(d) - bmid + m->cap + 2])
+
+/* === Structures === */
+
+/**
+* @brief state of an alignment
+*/
+struct myers {
+
+	const struct lines *a; /**< lines of the first input (x axis) */
+	const struct lines *b; /**< lines of the second input (y axis) */
+	unsigned char *del; /**< bit i set if line i of a is not part of the common subsequence */
+	unsigned char *ins; /**< bit i set if line i of b is not part of the common subsequence */
+	long cap; /**< number of steps after which the search for the middle of the path gives up */
+	long *fd; /**< forward search: furthest reaching x per diagonal */
+	long *bd; /**< backward search: furthest reaching x per diagonal */
+
+};
+
+/* === Implementation === */
+
+/* the hashes settle most pairs within the (sequentially laid out) hash arrays, equal ones are confirmed on the lines themselves */
+static int line_equal(const struct myers *m, long x, long y)
+{
+	size_t len;
+
+	if(m->a->hash[x] != m->b->hash[y] || (len = LINE_LEN(m->a, x)) != LINE_LEN(m->b, y)) {
+		return 0;
+	}
+
+	return memcmp(LINE_PTR(m->a, x), LINE_PTR(m->b, y), len) == 0;
+}
+
+/*
+* Find the point (*xmid, *ymid) a shortest edit path from (xoff, yoff) to (xlim, ylim) passes through in its middle.
+* Diagonal d holds the points with x - y = d. The forward search starts on diagonal xoff - yoff, the backward one on xlim - ylim.
+* After c steps, FD(d) is the furthest x on diagonal d reachable from the start with c edits, BD(d) the lowest x from which the end is reachable.
+*/
+static void middle(struct myers *m, long xoff, long xlim, long yoff, long ylim, long *xmid, long *ymid)
+{
+	const long dmin = xoff - ylim, dmax = xlim - yoff;
+	const long fmid = xoff - yoff, bmid = xlim - ylim;
+	long fmin = fmid, fmax = fmid, bmin = bmid, bmax = bmid, c, d;
+	const int odd = (fmid - bmid) & 1;
+
+	FD(fmid) = xoff;
+	BD(bmid) = xlim;
+
+	for(c = 1; ; c++) {
+
+		/* extend the forward search by one edit on each diagonal, diagonals outside the grid are fenced off */
+		if(fmin > dmin) {
+			FD(--fmin - 1) = -1;
+		} else {
+			++fmin;
+		}
+		if(fmax < dmax) {
+			FD(++fmax + 1) = -1;
+		} else {
+			--fmax;
+		}
+
+		for(d = fmax; d >= fmin; d -= 2) {
+
+			long x, y, tlo = FD(d - 1), thi = FD(d + 1);
+
+			/* follow the snake of equal lines */
+			for(x = tlo < thi ? thi : tlo + 1, y = x - d; x < xlim && y < ylim && line_equal(m, x, y); x++, y++);
+
+			FD(d) = x;
+
+			if(odd && bmin <= d && d <= bmax && BD(d) <= x) {
+				*xmid = x;
+				*ymid = y;
+				return;
+			}
+		}
+
+		/* same for the backward search */
+		if(bmin > dmin) {
+			BD(--bmin - 1) = LONG_MAX;
+		} else {
+			++bmin;
+		}
+		if(bmax < dmax) {
+			BD(++bmax + 1) = LONG_MAX;
+		} else {
+			--bmax;
+		}
+
+		for(d = bmax; d >= bmin; d -= 2) {
+
+			long x, y, tlo = BD(d - 1), thi = BD(d + 1);
+
+			for(x = tlo < thi ? tlo : thi - 1, y = x - d; xoff < x && yoff < y && line_equal(m, x - 1, y - 1); x--, y--);
+
+			BD(d) = x;
+
+			if(!odd && fmin <= d && d <= fmax && x <= FD(d)) {
+				*xmid = x;
+				*ymid = y;
+				return;
+			}
+		}
+
+		/* too expensive: split at the point that got furthest, either from the start or from the end */
+		if(c >= m->cap) {
+
+			long fxy = -1, fx = xoff, bxy = LONG_MAX, bx = xlim;
+
+			for(d = fmax; d >= fmin; d -= 2) {
+
+				long x = FD(d) < xlim ? FD(d) : xlim, y = x - d;
+
+				if(y > ylim) {
+					x = ylim + d;
+					y = ylim;
+				}
+				if(x + y > fxy) {
+					fxy = x + y;
+					fx = x;
+				}
+			}
+
+			for(d = bmax; d >= bmin; d -= 2) {
+
+				long x = BD(d) > xoff ? BD(d) : xoff, y = x - d;
+
+				if(y < yoff) {
+					x = yoff + d;
+					y = yoff;
+				}
+				if(x + y < bxy) {
+					bxy = x + y;
+					bx = x;
+				}
+			}
+
+			if((xlim + ylim) - bxy < fxy - (xoff + yoff)) {
+				*xmid = fx;
+				*ymid = fxy - fx;
+			} else {
+				*xmid = bx;
+				*ymid = bxy - bx;
+			}
+			return;
+		}
+	}
+}
+
+/* mark the lines of a[xoff, xlim) and b[yoff, ylim) that are not part of the common subsequence */
+static void align(struct myers *m, long xoff, long xlim, long yoff, long ylim)
+{
+	for(;;) {
+
+		long xmid, ymid;
+
+		/* common lines at the start and at the end are part of any shortest path */
+		while(xoff < xlim && yoff < ylim && line_equal(m, xoff, yoff)) {
+			xoff++;
+			yoff++;
+		}
+		while(xoff < xlim && yoff < ylim && line_equal(m, xlim - 1, ylim - 1)) {
+			xlim--;
+			ylim--;
+		}
+
+		if(xoff == xlim) {
+			for(; yoff < ylim; yoff++) {
+				BIT_SET(m->ins, yoff);
+			}
+			return;
+		}
+
+		if(yoff == ylim) {
+			for(; xoff < xlim; xoff++) {
+				BIT_SET(m->del, xoff);
+			}
+			return;
+		}
+
+		middle(m, xoff, xlim, yoff, ylim, &xmid, &ymid);
+
+		/* recurse into the first half, loop on the second one */
+		align(m, xoff, xmid, yoff, ymid);
+		xoff = xmid;
+		yoff = ymid;
+	}
+}
+
+/* walk both bitmaps in parallel. Each run of changed lines pairs deleted with inserted lines as long as there are both */
+static void report(FILE *out, const struct myers *m)
+{
+	const struct lines *a = m->a, *b = m->b;
+	size_t x = 0, y = 0;
+	unsigned long same = 0, changed = 0;
+
+	while(x < a->n || y < b->n) {
+
+		size_t x0 = x, y0 = y, pairs, k;
+
+		if(x < a->n && y < b->n && !BIT_TEST(m->del, x) && !BIT_TEST(m->ins, y)) {
+			x++;
+			y++;
+			same++;
+			continue;
+		}
+
+		for(; x < a->n && BIT_TEST(m->del, x); x++);
+		for(; y < b->n && BIT_TEST(m->ins, y); y++);
+
+		pairs = x - x0 < y - y0 ? x - x0 : y - y0;
+		changed += pairs;
+
+		for(k = 0; k < pairs; k++) {
+
+			size_t stop1, stop2;
+			unsigned long n = count_mismatch(LINE_PTR(a, x0 + k), LINE_LEN(a, x0 + k), LINE_PTR(b, y0 + k), LINE_LEN(b, y0 + k), &stop1, &stop2);
+
+			(void) fprintf(out, "Geändert: Zeile: %lu/%lu Zeichen: %lu\n", (unsigned long) (x0 + k + 1), (unsigned long) (y0 + k + 1), n);
+		}
+
+		for(k = x0 + pairs; k < x; k++) {
+			(void) fprintf(out, "Gelöscht: Zeile: %lu\n", (unsigned long) (k + 1));
+		}
+
+		for(k = y0 + pairs; k < y; k++) {
+			(void) fprintf(out, "Eingefügt: Zeile: %lu\n", (unsigned long) (k + 1));
+		}
+	}
+
+	if(stats_on) {
+		stats_lines(same + changed, changed);
+	}
+}
+
+int compare_aligned(FILE *out, const struct input *a, const struct input *b, unsigned int jobs)
+{
+	struct lines la, lb;
+	int ret = -1;
+
+	la.off = lb.off = NULL;
+	la.hash = lb.hash = NULL;
+
+	stats_phase(stats_index);
+
+	if(lines_index(&la, a, LINES_HASH, jobs) == 0 && lines_index(&lb, b, LINES_HASH, jobs) == 0) {
+		stats_phase(stats_compare);
+		ret = compare_aligned_index(out, &la, &lb);
+	}
+
+	lines_free(&la);
+	lines_free(&lb);
+
+	return ret;
+}
+
+/* the search gives up after about sqrt(la->n + lb->n) steps (but no less than 4096), that's what the diagonal arrays are sized for */
+int compare_aligned_index(FILE *out, const struct lines *la, const struct lines *lb)
+{
+	struct myers m;
+	unsigned long total;
+	int ret = -1;
+
+	memset(&m, 0, sizeof(m));
+	m.a = la;
+	m.b = lb;
+
+	for(m.cap = 1, total = (unsigned long) (la->n + lb->n); total; total >>= 2) {
+		m.cap <<= 1;
+	}
+	if(m.cap < 4096) {
+		m.cap = 4096;
+	}
+
+	m.del = calloc(la->n / 8 + 1, 1);
+	m.ins = calloc(lb->n / 8 + 1, 1);
+	m.fd = malloc((2 * (size_t) m.cap + 5) * sizeof(*m.fd));
+	m.bd = malloc((2 * (size_t) m.cap + 5) * sizeof(*m.bd));
+
+	if(m.del == NULL || m.ins == NULL || m.fd == NULL || m.bd == NULL) {
+		goto out;
+	}
+
+	align(&m, 0, (long) la->n, 0, (long) lb->n);
+	report(out, &m);
+
+	ret = 0;
+
+out:
+	free(m.del);
+	free(m.ins);
+	free(m.fd);
+	free(m.bd);
+
+	return ret;
+}
@@ -0,0 +1,39 @@
+/**
+* @file myers.h
+* @brief header file for the aligning comparison, based upon Myers' O(ND) difference algorithm
+*/
+
+#ifndef MYERS_H
+#define MYERS_H
+#include <stdio.h> //needed for FILE
+#include "input.h"
+#include "lines.h"
+
+/**
+* @brief align the lines of two inputs by a shortest edit script and print it:
+* "Geändert: Zeile: N/M Zeichen: COUNT" for line N of a that got replaced by line M of b (COUNT mismatching chars),
+* "Gelöscht: Zeile: N" for line N of a that is missing in b,
+* "Eingefügt: Zeile: M" for line M of b that is missing in a.
+* Lines are taken as equal if their hashes are equal. Memory used on top of the line index is bounded by the square root of the number of lines
+*
+* @param out stream to print the edit script to
+* @param a first input
+* @param b second input
+* @param jobs number of threads to index the inputs with
+*
+* @return 0 on success, -1 if memory could not be allocated
+*/
+int compare_aligned(FILE *out, const struct input *a, const struct input *b, unsigned int jobs);
+
+/**
+* @brief compare_aligned on inputs that are indexed already, so an index can be aligned with several others
+*
+* @param out stream to print the edit script to
+* @param la index of the first input (with hashes)
+* @param lb index of the second input (with hashes)
+*
+* @return 0 on success, -1 if memory could not be allocated
+*/
+int compare_aligned_index(FILE *out, const struct lines *la, const struct lines *lb);
+
+#endif
@@ -0,0 +1,265 @@
+/**
+* @file reader.c
+* @brief read a stream on a separate thread into two alternately used buffers, handing out blocks of whole lines
+* @details The reading thread fills one buffer while the caller works on the other one. A buffer is handed out up to its last '\n',
+* the rest (the start of a line) is moved to the front of the next buffer. If a buffer holds no '\n' at all, it grows,
+* so lines of any length end up in one piece.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "reader.h"
+
+/* === Structures === */
+
+/**
+* @brief one of the two buffers of a reader
+*/
+struct buffer {
+
+	char *data; /**< the buffer */
+	size_t cap; /**< allocated size of data */
+	size_t len; /**< length of the block (whole lines) handed out */
+	int full; /**< nonzero while the block waits for or is held by the caller */
+
+};
+
+struct reader {
+
+	int fd; /**< file descriptor to read from */
+	pthread_t thread; /**< the reading thread */
+	pthread_mutex_t lock; /**< protects the flags below */
+	pthread_cond_t cond; /**< signaled whenever a flag changes */
+	struct buffer buf[2]; /**< the two buffers */
+	int current; /**< buffer held by the caller, -1 if none */
+	int next; /**< buffer the caller gets next */
+	int eof; /**< nonzero once the last block has been marked full */
+	int error; /**< errno of a failed read, 0 else */
+	int stop; /**< nonzero if the thread shall quit */
+
+};
+
+/* === Implementation === */
+
+/* find the last '\n' in p[0] .. p[n - 1] */
+static const char *last_newline(const char *p, size_t n)
+{
+	while(n--) {
+		if(p[n] == '\n') {
+			return p + n;
+		}
+	}
+
+	return NULL;
+}
+
+/* make room for at least need chars, the contents are kept */
+static int grow(struct buffer *b, size_t need)
+{
+	size_t cap = b->cap ? b->cap : READER_BLOCK;
+	char *data;
+
+	while(cap < need) {
+		cap *= 2;
+	}
+
+	if(cap == b->cap) {
+		return 0;
+	}
+
+	if((data = realloc(b->data, cap)) == NULL) {
+		return -1;
+	}
+
+	b->data = data;
+	b->cap = cap;
+	return 0;
+}
+
+/* read(2) with cancellation enabled, so reader_stop can end a read that blocks forever */
+static ssize_t read_cancelable(int fd, char *p, size_t n)
+{
+	ssize_t got;
+	int old;
+
+	(void) pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old);
+	got = read(fd, p, n);
+	(void) pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old);
+
+	return got;
+}
+
+static void *reading(void *param)
+{
+	struct reader *r = param;
+	const char *carry = NULL;
+	size_t carry_len = 0;
+	int i = 0, old, eof = 0, err = 0;
+
+	(void) pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old);
+
+	while(!eof && !err) {
+
+		struct buffer *b = &r->buf[i];
+		size_t fill;
+		const char *nl = NULL;
+
+		/* wait for the caller to hand this buffer back */
+		(void) pthread_mutex_lock(&r->lock);
+		while(b->full && !r->stop) {
+			(void) pthread_cond_wait(&r->cond, &r->lock);
+		}
+		(void) pthread_mutex_unlock(&r->lock);
+
+		if(r->stop) {
+			break;
+		}
+
+		/* the incomplete line at the end of the other buffer goes first. The caller doesn't touch that part */
+		if(grow(b, carry_len + READER_BLOCK / 2) == -1) {
+			err = ENOMEM;
+			break;
+		}
+		memcpy(b->data, carry, carry_len);
+		fill = carry_len;
+
+		/* fill the buffer completely, grow it as long as it holds no line end */
+		while(!eof && !err) {
+
+			ssize_t got;
+
+			if(fill == b->cap) {
+
+				if((nl = last_newline(b->data, fill)) != NULL) {
+					break;
+				}
+
+				if(grow(b, 2 * b->cap) == -1) {
+					err = ENOMEM;
+					break;
+				}
+			}
+
+			if((got = read_cancelable(r->fd, b->data + fill, b->cap - fill)) == -1) {
+				if(errno != EINTR) {
+					err = errno;
+				}
+			} else if(got == 0) {
+				eof = 1;
+			} else {
+				fill += (size_t) got;
+			}
+		}
+
+		if(eof) {
+			/* the very last line may lack its '\n' */
+			b->len = fill;
+			carry_len = 0;
+		} else if(!err) {
+			b->len = (size_t) (nl - b->data) + 1;
+			carry = b->data + b->len;
+			carry_len = fill - b->len;
+		}
+
+		(void) pthread_mutex_lock(&r->lock);
+		if(!err && b->len) {
+			b->full = 1;
+		}
+		r->eof = eof;
+		r->error = err;
+		(void) pthread_cond_broadcast(&r->cond);
+		(void) pthread_mutex_unlock(&r->lock);
+
+		i ^= 1;
+	}
+
+	if(err) {
+		(void) pthread_mutex_lock(&r->lock);
+		r->error = err;
+		(void) pthread_cond_broadcast(&r->cond);
+		(void) pthread_mutex_unlock(&r->lock);
+	}
+
+	return NULL;
+}
+
+struct reader *reader_start(int fd)
+{
+	struct reader *r;
+
+	if((r = calloc(1, sizeof(*r))) == NULL) {
+		return NULL;
+	}
+
+	r->fd = fd;
+	r->current = -1;
+
+	(void) pthread_mutex_init(&r->lock, NULL);
+	(void) pthread_cond_init(&r->cond, NULL);
+
+	if(pthread_create(&r->thread, NULL, reading, r) != 0) {
+		(void) pthread_cond_destroy(&r->cond);
+		(void) pthread_mutex_destroy(&r->lock);
+		free(r);
+		return NULL;
+	}
+
+	return r;
+}
+
+int reader_next(struct reader *r, const char **data, size_t *len)
+{
+	struct buffer *b = &r->buf[r->next];
+	int ret;
+
+	(void) pthread_mutex_lock(&r->lock);
+
+	if(r->current != -1) {
+		r->buf[r->current].full = 0;
+		r->current = -1;
+		(void) pthread_cond_broadcast(&r->cond);
+	}
+
+	/* blocks are marked full before eof or error are set, so no block gets lost */
+	while(!b->full && !r->eof && !r->error) {
+		(void) pthread_cond_wait(&r->cond, &r->lock);
+	}
+
+	if(b->full) {
+		*data = b->data;
+		*len = b->len;
+		r->current = r->next;
+		r->next ^= 1;
+		ret = 1;
+	} else if(r->error) {
+		errno = r->error;
+		ret = -1;
+	} else {
+		ret = 0;
+	}
+
+	(void) pthread_mutex_unlock(&r->lock);
+
+	return ret;
+}
+
+void reader_stop(struct reader *r)
+{
+	(void) pthread_mutex_lock(&r->lock);
+	r->stop = 1;
+	(void) pthread_cond_broadcast(&r->cond);
+	(void) pthread_mutex_unlock(&r->lock);
+
+	/* only takes effect while the thread is blocked in read(2) */
+	(void) pthread_cancel(r->thread);
+	(void) pthread_join(r->thread, NULL);
+
+	(void) pthread_cond_destroy(&r->cond);
+	(void) pthread_mutex_destroy(&r->lock);
+
+	free(r->buf[0].data);
+	free(r->buf[1].data);
+	free(r);
+}
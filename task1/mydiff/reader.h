@@ -0,0 +1,49 @@
+/**
+* @file reader.h
+* @brief header file for the double buffered stream reader (pipes, stdin, ...)
+*/
+
+#ifndef READER_H
+#define READER_H
+#include <stddef.h> //needed for size_t
+
+/**
+* @brief size of a reader's buffers. A buffer grows if a single line doesn't fit into it
+*/
+#define READER_BLOCK (4 << 20)
+
+/**
+* @brief opaque type of a stream reader
+*/
+struct reader;
+
+/**
+* @brief start a thread that reads fd with large read(2) calls into two buffers, alternately.
+* While the caller works on the lines in one buffer, the other one gets filled
+*
+* @param fd file descriptor to read from (not closed by the reader)
+*
+* @return the reader, NULL if memory or the thread could not be allocated
+*/
+struct reader *reader_start(int fd);
+
+/**
+* @brief hand the current block back to the reader and get the next one.
+* A block holds whole lines only, just the very last one of the stream may lack its '\n'
+*
+* @param r reader to get the block from
+* @param data receives the block's first char
+* @param len receives the block's length
+*
+* @return 1 if a block was returned, 0 at the end of the stream, -1 on read errors (errno is set)
+*/
+int reader_next(struct reader *r, const char **data, size_t *len);
+
+/**
+* @brief stop the reading thread (even if it is blocked in read(2)) and release the reader
+*
+* @param r reader to stop
+*/
+void reader_stop(struct reader *r);
+
+#endif
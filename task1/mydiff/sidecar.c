@@ -0,0 +1,727 @@
+/**
+* @file sidecar.c
+* @brief keep the line index of an input in a file next to it and bring it up to date cheaply after the input has been edited
+* @details The sidecar holds the input's size and mtime, a hash per SIDECAR_BLOCK sized block, the line offsets and the line hashes.
+* After an edit, the blocks in front of the first changed one are still the same, and so are the blocks behind the last changed one,
+* just moved by the difference in size. Block hashes are found at memory speed, so finding both ends costs a fraction of hashing every line.
+* Only the lines in between get indexed again. Finding the changed blocks still takes hashing all of the input once.
+* Next to the first input of a comparison, the pairs it printed are kept with the versions of both inputs they were found for.
+* A rerun compares only the pairs that hold a line indexed again, the others are printed as they were.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "sidecar.h"
+#include "hash.h"
+#include "workpool.h"
+#include "stats.h"
+
+/* === Constants === */
+
+/** First bytes of every sidecar */
+#define SIDECAR_MAGIC "MYDIFFIX"
+
+/** Layout version, sidecars of other versions are ignored */
+#define SIDECAR_VERSION 1
+
+/** Number of blocks hashed per task */
+#define BLOCKS_PER_TASK 64
+
+/** First bytes of every result file */
+#define RESULT_MAGIC "MYDIFFRS"
+
+/** Layout version of the result files */
+#define RESULT_VERSION 1
+
+/* === Structures === */
+
+/**
+* @brief start of a sidecar. It's followed by nblocks block hashes, nlines + 1 line offsets and nlines line hashes (all 64 bit, host byte order)
+*/
+struct header {
+
+	char magic[8]; /**< SIDECAR_MAGIC */
+	uint32_t version; /**< SIDECAR_VERSION */
+	uint32_t block; /**< SIDECAR_BLOCK */
+	uint64_t size; /**< size of the input */
+	int64_t sec; /**< mtime of the input, seconds */
+	int64_t nsec; /**< mtime of the input, nanoseconds */
+	uint64_t nlines; /**< number of lines */
+	uint64_t nblocks; /**< number of blocks (the last one may be shorter) */
+
+};
+
+/**
+* @brief a sidecar read into memory
+*/
+struct sidecar {
+
+	struct header h; /**< the header */
+	uint64_t *blocks; /**< block hashes */
+	size_t *off; /**< line offsets (nlines + 1) */
+	uint64_t *hash; /**< line hashes */
+
+};
+
+/**
+* @brief block hashes of an input being computed
+*/
+struct blocks {
+
+	const char *data; /**< first char of the input */
+	size_t size; /**< size of the input */
+	size_t n; /**< number of blocks */
+	uint64_t *hash; /**< block hashes */
+
+};
+
+/**
+* @brief start of a result file. It's followed by n entries (all 64 bit, host byte order)
+*/
+struct result_header {
+
+	char magic[8]; /**< RESULT_MAGIC */
+	uint32_t version; /**< RESULT_VERSION */
+	uint32_t report; /**< what has been printed per pair */
+	uint32_t flags; /**< flags of the comparison kernel */
+	uint32_t reserved; /**< 0 */
+	struct sidecar_stamp a; /**< version of the first input compared */
+	struct sidecar_stamp b; /**< version of the second input compared */
+	uint64_t n; /**< number of printed pairs */
+
+};
+
+/**
+* @brief line pairs from .. to - 1 that are the same as the old pairs old ..
+*/
+struct segment {
+
+	size_t from; /**< first pair */
+	size_t to; /**< end of the pairs */
+	size_t old; /**< old index of the first pair */
+
+};
+
+/* === Implementation === */
+
+static char *suffixed_path(const char *name, const char *suffix)
+{
+	size_t len = strlen(name), slen = strlen(suffix);
+	char *path;
+
+	if((path = malloc(len + slen + 1)) != NULL) {
+		memcpy(path, name, len);
+		memcpy(path + len, suffix, slen + 1);
+	}
+
+	return path;
+}
+
+static int read_all(int fd, void *buf, size_t n)
+{
+	char *p = buf;
+
+	while(n) {
+
+		ssize_t got = read(fd, p, n);
+
+		if(got <= 0) {
+			if(got == -1 && errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+
+		p += got;
+		n -= (size_t) got;
+	}
+
+	return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t n)
+{
+	const char *p = buf;
+
+	while(n) {
+
+		ssize_t put = write(fd, p, n);
+
+		if(put == -1) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+
+		p += put;
+		n -= (size_t) put;
+	}
+
+	return 0;
+}
+
+static void sidecar_free(struct sidecar *sc)
+{
+	free(sc->blocks);
+	free(sc->off);
+	free(sc->hash);
+	sc->blocks = NULL;
+	sc->off = NULL;
+	sc->hash = NULL;
+}
+
+/* read a sidecar. Everything that doesn't look exactly like one we wrote is rejected, the offsets are used to access the input later */
+static int load(const char *path, struct sidecar *sc)
+{
+	struct stat st;
+	uint64_t i, n;
+	int fd, ret = -1;
+
+	if((fd = open(path, O_RDONLY)) == -1) {
+		return -1;
+	}
+
+	if(fstat(fd, &st) == -1 || read_all(fd, &sc->h, sizeof(sc->h)) == -1) {
+		goto out;
+	}
+
+	n = sc->h.nlines;
+
+	if(memcmp(sc->h.magic, SIDECAR_MAGIC, sizeof(sc->h.magic)) != 0 || sc->h.version != SIDECAR_VERSION || sc->h.block != SIDECAR_BLOCK
+			|| sc->h.nblocks != (sc->h.size + SIDECAR_BLOCK - 1) / SIDECAR_BLOCK || n > sc->h.size
+			|| (uint64_t) st.st_size != sizeof(sc->h) + 8 * (sc->h.nblocks + 2 * n + 1)) {
+		goto out;
+	}
+
+	sc->blocks = malloc((size_t) sc->h.nblocks * sizeof(*sc->blocks) + 1);
+	sc->off = malloc(((size_t) n + 1) * sizeof(*sc->off));
+	sc->hash = malloc(((size_t) n + 1) * sizeof(*sc->hash));
+
+	if(sc->blocks == NULL || sc->off == NULL || sc->hash == NULL
+			|| read_all(fd, sc->blocks, (size_t) sc->h.nblocks * sizeof(*sc->blocks)) == -1
+			|| read_all(fd, sc->off, ((size_t) n + 1) * sizeof(*sc->off)) == -1
+			|| read_all(fd, sc->hash, (size_t) n * sizeof(*sc->hash)) == -1) {
+		goto out;
+	}
+
+	if(sc->off[0] != 0 || sc->off[n] != sc->h.size) {
+		goto out;
+	}
+	for(i = 0; i < n; i++) {
+		if(sc->off[i] >= sc->off[i + 1]) {
+			goto out;
+		}
+	}
+
+	ret = 0;
+
+out:
+	if(ret == -1) {
+		sidecar_free(sc);
+	}
+
+	(void) close(fd);
+	return ret;
+}
+
+/* write n parts to a temporary file first and move it to path, so readers never see half a file */
+static int replace(const char *path, const void *const *parts, const size_t *lens, int n)
+{
+	size_t len = strlen(path);
+	char *tmp;
+	int fd, i, ret = 0;
+
+	if((tmp = malloc(len + 8)) == NULL) {
+		return -1;
+	}
+	memcpy(tmp, path, len);
+	memcpy(tmp + len, ".XXXXXX", 8);
+
+	if((fd = mkstemp(tmp)) == -1) {
+		free(tmp);
+		return -1;
+	}
+
+	for(i = 0; i < n && ret == 0; i++) {
+		ret = write_all(fd, parts[i], lens[i]);
+	}
+
+	if(close(fd) == -1 || ret == -1 || rename(tmp, path) == -1) {
+		(void) unlink(tmp);
+		ret = -1;
+	}
+
+	free(tmp);
+	return ret;
+}
+
+static int save(const char *path, const struct stat *st, const struct lines *l, const struct blocks *b)
+{
+	struct header h;
+	const void *parts[4];
+	size_t lens[4];
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SIDECAR_MAGIC, sizeof(h.magic));
+	h.version = SIDECAR_VERSION;
+	h.block = SIDECAR_BLOCK;
+	h.size = l->size;
+	h.sec = (int64_t) st->st_mtim.tv_sec;
+	h.nsec = (int64_t) st->st_mtim.tv_nsec;
+	h.nlines = l->n;
+	h.nblocks = b->n;
+
+	parts[0] = &h;
+	lens[0] = sizeof(h);
+	parts[1] = b->hash;
+	lens[1] = b->n * sizeof(*b->hash);
+	parts[2] = l->off;
+	lens[2] = (l->n + 1) * sizeof(*l->off);
+	parts[3] = l->hash;
+	lens[3] = l->n * sizeof(*l->hash);
+
+	return replace(path, parts, lens, 4);
+}
+
+static void block_task(void *arg, size_t task)
+{
+	struct blocks *b = arg;
+	size_t k, last = (task + 1) * BLOCKS_PER_TASK < b->n ? (task + 1) * BLOCKS_PER_TASK : b->n;
+
+	for(k = task * BLOCKS_PER_TASK; k < last; k++) {
+
+		size_t from = k * SIDECAR_BLOCK, len = b->size - from < SIDECAR_BLOCK ? b->size - from : SIDECAR_BLOCK;
+
+		b->hash[k] = line_hash(b->data + from, len);
+	}
+}
+
+/* number of entries of off[0] .. off[n] that are <= pos */
+static size_t upper_bound(const size_t *off, size_t n, size_t pos)
+{
+	size_t lo = 0, hi = n + 1;
+
+	while(lo < hi) {
+
+		size_t mid = lo + (hi - lo) / 2;
+
+		if(off[mid] <= pos) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/*
+* Merge the old index with a new one of the changed part. Old lines are kept if they lie within the equal blocks at the start
+* (ending with a '\n' there), or if the '\n' in front of them lies within the equal blocks at the end.
+*/
+static int update(struct lines *l, const struct input *in, struct sidecar *old, const struct blocks *b, unsigned int jobs, struct sidecar_change *c)
+{
+	const size_t so = (size_t) old->h.size, sn = in->size, n = (size_t) old->h.nlines;
+	size_t full = (so < sn ? so : sn) / SIDECAR_BLOCK, head, tail = so, k, i0, j, m0, m1, i;
+	int aligned = (sn > so ? sn - so : so - sn) % SIDECAR_BLOCK == 0;
+	struct input mid;
+	struct lines lm;
+
+	/* equal blocks at the start */
+	for(head = 0; head < full && old->blocks[head] == b->hash[head]; head++);
+	head *= SIDECAR_BLOCK;
+
+	/* equal blocks at the end, block k of the old input has moved by sn - so. If that's a multiple of the block size, its hash is known already */
+	for(k = (size_t) old->h.nblocks; k-- > 0; ) {
+
+		size_t from = k * SIDECAR_BLOCK, to = from + SIDECAR_BLOCK < so ? from + SIDECAR_BLOCK : so, moved;
+		uint64_t h;
+
+		if(from < head || from + sn < head + so) {
+			break;
+		}
+
+		moved = from + sn - so;
+		h = aligned ? b->hash[moved / SIDECAR_BLOCK] : line_hash(in->data + moved, to - from);
+
+		if(h != old->blocks[k]) {
+			break;
+		}
+
+		tail = from;
+	}
+
+	/* lines 0 .. i0 - 1 stay, so do lines j .. n - 1 (moved). m0 .. m1 is what's left to index */
+	i0 = upper_bound(old->off, n, head) - 1;
+	if(i0 == n && n && in->data[so - 1] != '\n') {
+		i0--;
+	}
+
+	j = upper_bound(old->off, n, tail);
+	if(j > n) {
+		j = n;
+	}
+
+	m0 = old->off[i0];
+	m1 = old->off[j] + sn - so;
+
+	mid.name = in->name;
+	mid.fd = -1;
+	mid.data = in->data + m0;
+	mid.size = m1 - m0;
+	mid.kind = input_mapped;
+
+	if(lines_index(&lm, &mid, LINES_HASH, jobs) == -1) {
+		return -1;
+	}
+
+	l->n = i0 + lm.n + (n - j);
+
+	if(l->n == n) {
+
+		/* as many lines as before, the old index is patched where it is */
+		l->off = old->off;
+		l->hash = old->hash;
+		old->off = NULL;
+		old->hash = NULL;
+
+		for(i = j; sn != so && i < n; i++) {
+			l->off[i] += sn - so;
+		}
+
+	} else {
+
+		l->off = malloc((l->n + 1) * sizeof(*l->off));
+		l->hash = malloc((l->n + 1) * sizeof(*l->hash));
+
+		if(l->off == NULL || l->hash == NULL) {
+			lines_free(&lm);
+			lines_free(l);
+			return -1;
+		}
+
+		memcpy(l->off, old->off, i0 * sizeof(*l->off));
+		memcpy(l->hash, old->hash, i0 * sizeof(*l->hash));
+
+		for(i = j; i < n; i++) {
+			l->off[i0 + lm.n + i - j] = old->off[i] + sn - so;
+			l->hash[i0 + lm.n + i - j] = old->hash[i];
+		}
+	}
+
+	for(i = 0; i < lm.n; i++) {
+		l->off[i0 + i] = m0 + lm.off[i];
+		l->hash[i0 + i] = lm.hash[i];
+	}
+
+	l->off[l->n] = sn;
+
+	c->from = i0;
+	c->to = i0 + lm.n;
+	c->to_old = j;
+
+	lines_free(&lm);
+	return 0;
+}
+
+static void stamp(struct sidecar_stamp *s, const struct stat *st)
+{
+	s->dev = (uint64_t) st->st_dev;
+	s->ino = (uint64_t) st->st_ino;
+	s->size = (uint64_t) st->st_size;
+	s->sec = (int64_t) st->st_mtim.tv_sec;
+	s->nsec = (int64_t) st->st_mtim.tv_nsec;
+}
+
+static int stamp_equal(const struct sidecar_stamp *s, const struct sidecar_stamp *t)
+{
+	return s->dev == t->dev && s->ino == t->ino && s->size == t->size && s->sec == t->sec && s->nsec == t->nsec;
+}
+
+int lines_cached(struct lines *l, const struct input *in, unsigned int jobs, struct sidecar_change *c)
+{
+	struct sidecar old;
+	struct blocks b;
+	struct stat st;
+	char *path;
+	int have_old, ret = -1;
+
+	memset(&old, 0, sizeof(old));
+	memset(&b, 0, sizeof(b));
+	memset(c, 0, sizeof(*c));
+
+	/* the sidecar holds offsets as 64 bit values, which are read straight into the index */
+	if(sizeof(size_t) != sizeof(uint64_t) || in->kind != input_mapped || fstat(in->fd, &st) == -1 || (path = suffixed_path(in->name, SIDECAR_SUFFIX)) == NULL) {
+		return lines_index(l, in, LINES_HASH, jobs);
+	}
+
+	c->stamped = 1;
+	stamp(&c->now, &st);
+
+	l->data = in->data;
+	l->size = in->size;
+	l->n = 0;
+	l->off = NULL;
+	l->hash = NULL;
+
+	have_old = load(path, &old) == 0;
+
+	if(have_old) {
+		c->known = 1;
+		c->was = c->now;
+		c->was.size = old.h.size;
+		c->was.sec = old.h.sec;
+		c->was.nsec = old.h.nsec;
+	}
+
+	/* unchanged since the sidecar was written, take the index as it is */
+	if(have_old && old.h.size == in->size && old.h.sec == (int64_t) st.st_mtim.tv_sec && old.h.nsec == (int64_t) st.st_mtim.tv_nsec) {
+		l->n = (size_t) old.h.nlines;
+		l->off = old.off;
+		l->hash = old.hash;
+		c->from = c->to = c->to_old = l->n;
+		free(old.blocks);
+		free(path);
+		return 0;
+	}
+
+	b.data = in->data;
+	b.size = in->size;
+	b.n = (in->size + SIDECAR_BLOCK - 1) / SIDECAR_BLOCK;
+
+	if((b.hash = malloc(b.n * sizeof(*b.hash) + 1)) == NULL || workpool_run(jobs, (b.n + BLOCKS_PER_TASK - 1) / BLOCKS_PER_TASK, block_task, &b) == -1) {
+		goto out;
+	}
+
+	ret = have_old ? update(l, in, &old, &b, jobs, c) : lines_index(l, in, LINES_HASH, jobs);
+
+	/* a sidecar that can't be written just means the next run has to index everything again */
+	if(ret == 0) {
+		(void) save(path, &st, l, &b);
+	}
+
+out:
+	sidecar_free(&old);
+	free(b.hash);
+	free(path);
+
+	return ret;
+}
+
+/* read the result of the last comparison, if it has been made like the one described by want */
+static int load_result(const char *path, const struct result_header *want, struct hashed_result *res)
+{
+	struct result_header h;
+	struct stat st;
+	size_t i;
+	int fd, ret = -1;
+
+	if((fd = open(path, O_RDONLY)) == -1) {
+		return -1;
+	}
+
+	if(fstat(fd, &st) == -1 || read_all(fd, &h, sizeof(h)) == -1) {
+		goto out;
+	}
+
+	if(memcmp(h.magic, RESULT_MAGIC, sizeof(h.magic)) != 0 || h.version != RESULT_VERSION || h.report != want->report || h.flags != want->flags
+			|| !stamp_equal(&h.a, &want->a) || !stamp_equal(&h.b, &want->b)
+			|| h.n > (uint64_t) st.st_size || (uint64_t) st.st_size != sizeof(h) + h.n * sizeof(*res->e)) {
+		goto out;
+	}
+
+	if(h.n > 0 && ((res->e = malloc((size_t) h.n * sizeof(*res->e))) == NULL || read_all(fd, res->e, (size_t) h.n * sizeof(*res->e)) == -1)) {
+		goto out;
+	}
+
+	res->n = res->cap = (size_t) h.n;
+
+	/* the pairs are looked up by binary search */
+	for(i = 1; i < res->n; i++) {
+		if(res->e[i - 1].line >= res->e[i].line) {
+			goto out;
+		}
+	}
+
+	ret = 0;
+
+out:
+	if(ret == -1) {
+		free(res->e);
+		memset(res, 0, sizeof(*res));
+	}
+
+	(void) close(fd);
+	return ret;
+}
+
+/* the lines of an input that are the same as before, as segments: the lines in front of the changed ones, and the ones behind them */
+static size_t kept_lines(const struct sidecar_change *c, size_t n, struct segment *s)
+{
+	if(!c->known) {
+		return 0;
+	}
+
+	s[0].from = 0;
+	s[0].to = c->from;
+	s[0].old = 0;
+
+	s[1].from = c->to;
+	s[1].to = n;
+	s[1].old = c->to_old;
+
+	return 2;
+}
+
+/* the pairs of lines that are the same as before: both lines are kept and have moved by the same number of lines. Ordered by from */
+static size_t kept_pairs(const struct sidecar_change *ca, size_t na, const struct sidecar_change *cb, size_t nb, struct segment *s)
+{
+	struct segment sa[2], sb[2];
+	size_t ka = kept_lines(ca, na, sa), kb = kept_lines(cb, nb, sb), n = na < nb ? na : nb, i, j, k = 0;
+
+	for(i = 0; i < ka; i++) {
+		for(j = 0; j < kb; j++) {
+
+			size_t from = sa[i].from > sb[j].from ? sa[i].from : sb[j].from, to = sa[i].to < sb[j].to ? sa[i].to : sb[j].to, m;
+
+			if(to > n) {
+				to = n;
+			}
+
+			if(sa[i].old + sb[j].from != sb[j].old + sa[i].from || from >= to) {
+				continue;
+			}
+
+			/* both lists are ordered, so are the overlaps per segment of a. Insert in order */
+			for(m = k++; m > 0 && s[m - 1].from > from; m--) {
+				s[m] = s[m - 1];
+			}
+
+			s[m].from = from;
+			s[m].to = to;
+			s[m].old = sa[i].old + from - sa[i].from;
+		}
+	}
+
+	return k;
+}
+
+/* print the old pairs of a segment under their new line numbers */
+static int print_kept(FILE *out, const struct hashed_result *prev, const struct segment *s, hashed_report_t report, struct hashed_result *res)
+{
+	size_t lo = 0, hi = prev->n, k;
+
+	while(lo < hi) {
+
+		size_t mid = lo + (hi - lo) / 2;
+
+		if(prev->e[mid].line < s->old) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	for(k = lo; k < prev->n && prev->e[k].line < s->old + (s->to - s->from); k++) {
+
+		size_t line = (size_t) prev->e[k].line - s->old + s->from;
+
+		hashed_print(out, (unsigned long) (line + 1), (unsigned long) prev->e[k].value, report);
+
+		if(hashed_result_add(res, line, (unsigned long) prev->e[k].value) == -1) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int compare_cached_hashed(FILE *out, const struct input *a, const struct lines *la, const struct sidecar_change *ca,
+		const struct lines *lb, const struct sidecar_change *cb, hashed_report_t report, unsigned int flags)
+{
+	struct result_header h;
+	struct hashed_result prev, res;
+	struct segment kept[4];
+	const void *parts[2];
+	size_t lens[2], n = la->n < lb->n ? la->n : lb->n, nk = 0, pos = 0, k;
+	long slow = 0, s;
+	char *path = NULL;
+	int ret = -1;
+
+	memset(&prev, 0, sizeof(prev));
+	memset(&res, 0, sizeof(res));
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, RESULT_MAGIC, sizeof(h.magic));
+	h.version = RESULT_VERSION;
+	h.report = (uint32_t) report;
+	h.flags = (uint32_t) flags;
+
+	/* without stamps there is nothing to tell the versions apart, every pair is compared and nothing is kept */
+	if(ca->stamped && cb->stamped && (path = suffixed_path(a->name, SIDECAR_RESULT_SUFFIX)) != NULL) {
+
+		h.a = ca->was;
+		h.b = cb->was;
+
+		if(ca->known && cb->known && load_result(path, &h, &prev) == 0) {
+			nk = kept_pairs(ca, la->n, cb, lb->n, kept);
+		}
+	}
+
+	/* compare the pairs in front of each kept segment, print the segment as it was */
+	for(k = 0; k <= nk; k++) {
+
+		size_t to = k < nk ? kept[k].from : n;
+
+		if((s = compare_hashed_range(out, la, lb, pos, to, report, &res)) == -1) {
+			goto out;
+		}
+
+		slow += s;
+
+		if(k < nk) {
+
+			if(print_kept(out, &prev, &kept[k], report, &res) == -1) {
+				goto out;
+			}
+
+			pos = kept[k].to;
+		}
+	}
+
+	if(stats_on) {
+		stats_lines((unsigned long) n, (unsigned long) slow);
+	}
+
+	ret = 0;
+
+	/* nothing to write if the result is the one read */
+	if(path != NULL && !(nk == 1 && kept[0].from == 0 && kept[0].to == n && stamp_equal(&ca->was, &ca->now) && stamp_equal(&cb->was, &cb->now))) {
+
+		h.a = ca->now;
+		h.b = cb->now;
+		h.n = res.n;
+
+		parts[0] = &h;
+		lens[0] = sizeof(h);
+		parts[1] = res.e;
+		lens[1] = res.n * sizeof(*res.e);
+
+		/* a result that can't be written just means the next run has to compare every pair again */
+		(void) replace(path, parts, lens, res.n > 0 ? 2 : 1);
+	}
+
+out:
+	free(prev.e);
+	free(res.e);
+	free(path);
+
+	return ret;
+}
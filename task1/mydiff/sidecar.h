@@ -0,0 +1,96 @@
+/**
+* @file sidecar.h
+* @brief header file for the persistent line index ("sidecar" file next to an input), which makes reruns on (almost) unchanged inputs cheap
+*/
+
+#ifndef SIDECAR_H
+#define SIDECAR_H
+#include <stdio.h> //needed for FILE
+#include <stdint.h> //needed for uint64_t
+#include "input.h"
+#include "lines.h"
+#include "compare.h"
+
+/**
+* @brief appended to an input's path to get the path of its sidecar
+*/
+#define SIDECAR_SUFFIX ".mdx"
+
+/**
+* @brief appended to the path of the first input to get the path of the result of its last comparison
+*/
+#define SIDECAR_RESULT_SUFFIX ".mdr"
+
+/**
+* @brief size of the blocks the sidecar keeps a hash of
+*/
+#define SIDECAR_BLOCK (64 << 10)
+
+/**
+* @brief what identifies a version of an input: the file and its size and mtime
+*/
+struct sidecar_stamp {
+
+	uint64_t dev; /**< device of the file */
+	uint64_t ino; /**< inode of the file */
+	uint64_t size; /**< size of the file */
+	int64_t sec; /**< mtime, seconds */
+	int64_t nsec; /**< mtime, nanoseconds */
+
+};
+
+/**
+* @brief how an input has changed since its sidecar was written, as found by lines_cached
+*/
+struct sidecar_change {
+
+	int stamped; /**< 1 if the input is a file that can have a sidecar, 0 else (the other members are unset then) */
+	int known; /**< 1 if its sidecar could be used, 0 if all lines have been indexed anew */
+	struct sidecar_stamp was; /**< the version the sidecar was written for */
+	struct sidecar_stamp now; /**< the version indexed now */
+	size_t from; /**< first line indexed anew */
+	size_t to; /**< end of the lines indexed anew. Lines behind it are old line to_old and up */
+	size_t to_old; /**< old line the line at to was */
+
+};
+
+/**
+* @brief index the lines of a mapped input (with hashes, like lines_index with LINES_HASH does) with help of its sidecar.
+* If size and mtime of the input match the sidecar, the index is taken from it as is.
+* Else the blocks at the start and at the end, that are still the same (the end may have moved), keep their lines,
+* only the lines in between get indexed again. The sidecar is written anew then. Failing to read or write the sidecar is no error,
+* the input just gets indexed completely.
+* This bounds the work after an edit, it doesn't make it proportional to the edit: finding the blocks that are still the same takes
+* hashing all blocks of a changed input, and its sidecar is rewritten in full (to a temporary file that is renamed over it).
+* What is saved is splitting and hashing the lines of the unchanged blocks
+*
+* @param l index to fill
+* @param in input to index, has to be a mapped file
+* @param jobs number of threads to hash with
+* @param c receives the lines that have changed since the sidecar was written
+*
+* @return 0 on success, -1 if the index could not be allocated
+*/
+int lines_cached(struct lines *l, const struct input *in, unsigned int jobs, struct sidecar_change *c);
+
+/**
+* @brief compare_hashed_index for two inputs indexed by lines_cached, which prints the same. The pairs printed by the last comparison
+* of the first input are kept in a file next to it. If that comparison was made against the same versions of both inputs
+* the sidecars have been written for, only the pairs with a changed line are compared again. The others are printed from the file.
+* Failing to read or write the file is no error, all pairs are compared then
+*
+* @param out stream to print the mismatches to
+* @param a first input
+* @param la index of the first input
+* @param ca changes of the first input as found by lines_cached
+* @param lb index of the second input
+* @param cb changes of the second input as found by lines_cached
+* @param report what to print for a pair of differing lines
+* @param flags flags the comparison kernel was selected with (see mismatch_init), the printed counts depend on them
+*
+* @return 0 on success, -1 if memory for a distance or for the result could not be allocated
+*/
+int compare_cached_hashed(FILE *out, const struct input *a, const struct lines *la, const struct sidecar_change *ca,
+		const struct lines *lb, const struct sidecar_change *cb, hashed_report_t report, unsigned int flags);
+
+#endif
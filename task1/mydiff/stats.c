@@ -0,0 +1,198 @@
+/**
+* @file stats.c
+* @brief timing and I/O counters of a run (-v). The clocks are read at phase switches only, the counters are
+* handed over once per call of the comparing functions
+* @details CPU time is the one of the whole process (CLOCK_PROCESS_CPUTIME_ID), so with several threads a phase may take
+* more CPU than wall time. Page faults with I/O are those that had to wait for the disk: for mapped inputs they are
+* where reading happens, inside the comparison.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "stats.h"
+
+/* === Constants === */
+
+/** Number of inputs listed by name, the others are only counted */
+#define STATS_NAMED 4
+
+/** Names of the phases as printed */
+static const char *const phase_names[STATS_PHASES] = { "Öffnen", "Lesen", "Zeilenindex", "Vergleich" };
+
+/* === Structures === */
+
+/**
+* @brief a point in time, or a span of it
+*/
+struct clocks {
+
+	double wall; /**< seconds of CLOCK_MONOTONIC */
+	double cpu; /**< seconds of CPU time of the process */
+
+};
+
+/**
+* @brief everything collected by a run
+*/
+struct stats {
+
+	pthread_t owner; /**< thread that called stats_start, the only one switching phases */
+	stats_phase_t phase; /**< current phase */
+	struct clocks start; /**< clocks at stats_start */
+	struct clocks since; /**< clocks when the current phase was entered */
+	struct clocks spent[STATS_PHASES]; /**< time spent per phase */
+	char *names[STATS_NAMED]; /**< names of the first inputs */
+	unsigned long long bytes[STATS_NAMED]; /**< bytes of the first inputs */
+	unsigned long ninputs; /**< number of inputs */
+	unsigned long long total; /**< bytes of all inputs */
+	unsigned long long lines; /**< compared line pairs */
+	unsigned long long slow; /**< line pairs on the slow path */
+	long majflt; /**< page faults with I/O at stats_start */
+	long minflt; /**< page faults without I/O at stats_start */
+
+};
+
+/* === Implementation === */
+
+int stats_on = 0;
+
+/** The counters of the run, the ones updated by all threads are protected by lock */
+static struct stats st;
+
+/** Protects the input and line counters */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double seconds(clockid_t id)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(id, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static struct clocks now(void)
+{
+	struct clocks c;
+
+	c.wall = seconds(CLOCK_MONOTONIC);
+	c.cpu = seconds(CLOCK_PROCESS_CPUTIME_ID);
+
+	return c;
+}
+
+/* add the time since the current phase was entered to it */
+static void phase_end(void)
+{
+	struct clocks c = now();
+
+	st.spent[st.phase].wall += c.wall - st.since.wall;
+	st.spent[st.phase].cpu += c.cpu - st.since.cpu;
+	st.since = c;
+}
+
+void stats_start(void)
+{
+	struct rusage ru;
+
+	memset(&st, 0, sizeof(st));
+
+	if(getrusage(RUSAGE_SELF, &ru) == 0) {
+		st.majflt = ru.ru_majflt;
+		st.minflt = ru.ru_minflt;
+	}
+
+	st.owner = pthread_self();
+	st.phase = stats_open;
+	st.start = st.since = now();
+	stats_on = 1;
+}
+
+void stats_phase(stats_phase_t phase)
+{
+	if(!stats_on || !pthread_equal(pthread_self(), st.owner) || phase == st.phase) {
+		return;
+	}
+
+	phase_end();
+	st.phase = phase;
+}
+
+void stats_input(const char *name, unsigned long long bytes)
+{
+	if(!stats_on) {
+		return;
+	}
+
+	(void) pthread_mutex_lock(&lock);
+
+	if(st.ninputs < STATS_NAMED) {
+		/* without the name the input is still counted */
+		st.names[st.ninputs] = strdup(name);
+		st.bytes[st.ninputs] = bytes;
+	}
+
+	st.ninputs++;
+	st.total += bytes;
+
+	(void) pthread_mutex_unlock(&lock);
+}
+
+void stats_lines(unsigned long lines, unsigned long slow)
+{
+	if(!stats_on) {
+		return;
+	}
+
+	(void) pthread_mutex_lock(&lock);
+	st.lines += lines;
+	st.slow += slow;
+	(void) pthread_mutex_unlock(&lock);
+}
+
+void stats_report(FILE *out, const char *name)
+{
+	struct clocks total;
+	struct rusage ru;
+	unsigned long i;
+	int p;
+
+	if(!stats_on) {
+		return;
+	}
+
+	phase_end();
+	stats_on = 0;
+
+	total.wall = st.since.wall - st.start.wall;
+	total.cpu = st.since.cpu - st.start.cpu;
+
+	for(p = 0; p < STATS_PHASES; p++) {
+		(void) fprintf(out, "%s: Phase: %s Zeit: %.6f s CPU: %.6f s\n", name, phase_names[p], st.spent[p].wall, st.spent[p].cpu);
+	}
+	(void) fprintf(out, "%s: Gesamt: Zeit: %.6f s CPU: %.6f s\n", name, total.wall, total.cpu);
+
+	for(i = 0; i < st.ninputs && i < STATS_NAMED; i++) {
+		(void) fprintf(out, "%s: Eingabe: %s Bytes: %llu\n", name, st.names[i] != NULL ? st.names[i] : "?", st.bytes[i]);
+		free(st.names[i]);
+	}
+	(void) fprintf(out, "%s: Eingaben: %lu Bytes: %llu\n", name, st.ninputs, st.total);
+
+	/* -b and -m don't compare lines */
+	if(st.lines) {
+		(void) fprintf(out, "%s: Zeilen: %llu Schnell: %llu Langsam: %llu\n", name, st.lines, st.lines - st.slow, st.slow);
+	}
+
+	if(total.wall > 0 && st.lines) {
+		(void) fprintf(out, "%s: Durchsatz: %.1f MB/s %.0f Zeilen/s\n", name, (double) st.total / 1e6 / total.wall, (double) st.lines / total.wall);
+	} else if(total.wall > 0) {
+		(void) fprintf(out, "%s: Durchsatz: %.1f MB/s\n", name, (double) st.total / 1e6 / total.wall);
+	}
+
+	if(getrusage(RUSAGE_SELF, &ru) == 0) {
+		(void) fprintf(out, "%s: Seitenfehler: %ld Mit I/O: %ld\n", name, ru.ru_minflt - st.minflt + ru.ru_majflt - st.majflt, ru.ru_majflt - st.majflt);
+	}
+}
@@ -0,0 +1,73 @@
+/**
+* @file stats.h
+* @brief header file for the timing and I/O counters of a run (-v): wall and CPU time per phase, bytes per input, compared lines
+* @details Collecting is off unless stats_start has been called. The hot loops only ever check stats_on,
+* they keep their counts in locals and hand them over once per call, so a run without -v pays nothing for the counters.
+* Phases are switched by the thread that called stats_start only, phase switches on worker threads (directory and
+* one to many mode) are ignored, their time goes to the phase the starting thread is in.
+*/
+
+#ifndef STATS_H
+#define STATS_H
+#include <stdio.h> //needed for FILE
+
+/**
+* @brief the phases of a run, each gets its wall and CPU time
+*/
+typedef enum stats_phase {
+	stats_open = 0, /**< opening and mapping the inputs */
+	stats_read, /**< reading streams into memory, or waiting for the readers while comparing */
+	stats_index, /**< finding the lines: line indexes and hashes, the newline pre-pass of -j, the block index of -m */
+	stats_compare /**< comparing and printing the differences */
+} stats_phase_t;
+
+/**
+* @brief number of phases
+*/
+#define STATS_PHASES 4
+
+/**
+* @brief nonzero while collecting. Hot paths check it before calling any of the functions below
+*/
+extern int stats_on;
+
+/**
+* @brief start collecting: reset all counters and clocks, the current thread enters stats_open
+*/
+void stats_start(void);
+
+/**
+* @brief end the current phase and enter another one. Does nothing unless collecting, or if called by another thread
+* than the one that called stats_start
+*
+* @param phase the phase to enter
+*/
+void stats_phase(stats_phase_t phase);
+
+/**
+* @brief count an input. Safe to call from any thread
+*
+* @param name name of the input as given on the command line (copied)
+* @param bytes number of bytes read from it (or mapped)
+*/
+void stats_input(const char *name, unsigned long long bytes);
+
+/**
+* @brief count compared line pairs. Safe to call from any thread
+*
+* @param lines number of line pairs compared
+* @param slow how many of them took the slow path: pairs with mismatching chars, that got counted and printed,
+* or with -H / -e / -a pairs with different hashes, that got compared char by char. The others were settled by the kernel
+* (or their hashes) alone
+*/
+void stats_lines(unsigned long lines, unsigned long slow);
+
+/**
+* @brief end the current phase, print the times, counters, throughput and page faults of the run and stop collecting
+*
+* @param out stream to print to
+* @param name prefix of every line
+*/
+void stats_report(FILE *out, const char *name);
+
+#endif
@@ -0,0 +1,315 @@
+/**
+* @file tree.c
+* @brief compare two directory trees file by file on a pool of threads
+* @details Both trees are walked first, collecting the relative paths of their regular files. The sorted lists get merged,
+* every entry becomes a task of a work pool. A task compares its pair into a memory stream, the calling thread prints the streams
+* in order of the entries as soon as they are ready, so the output doesn't depend on the number of threads.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "tree.h"
+#include "workpool.h"
+
+/* === Structures === */
+
+/**
+* @brief relative paths of the regular files within a tree
+*/
+struct tree {
+
+	const char *root; /**< the tree's root as given */
+	char **paths; /**< relative paths */
+	size_t n; /**< number of paths */
+	size_t cap; /**< allocated number of paths */
+
+};
+
+/**
+* @brief a relative path and the result of comparing the files it names
+*/
+struct entry {
+
+	const char *path; /**< relative path (owned by one of the trees) */
+	int in; /**< 1 or 2 if the path exists in the first or second tree only, 0 if in both */
+	int ret; /**< return value of the comparison */
+	char *buf; /**< output of the comparison */
+	size_t len; /**< length of the output */
+
+};
+
+/**
+* @brief state shared by all tasks of a tree comparison
+*/
+struct trees {
+
+	const struct tree *a; /**< first tree */
+	const struct tree *b; /**< second tree */
+	struct entry *entries; /**< merged paths of both trees */
+	tree_compare_t cmp; /**< callback comparing a pair of files */
+	void *arg; /**< argument of cmp */
+
+};
+
+/* === Implementation === */
+
+/* concatenate "dir/name", NULL if out of memory */
+static char *join(const char *dir, const char *name)
+{
+	size_t ld = strlen(dir), ln = strlen(name);
+	char *p;
+
+	if((p = malloc(ld + ln + 2)) == NULL) {
+		return NULL;
+	}
+
+	memcpy(p, dir, ld);
+	p[ld] = '/';
+	memcpy(p + ld + 1, name, ln + 1);
+
+	return p;
+}
+
+static int add_path(struct tree *t, char *path)
+{
+	char **grown;
+
+	if(t->n == t->cap) {
+
+		t->cap = t->cap ? 2 * t->cap : 256;
+
+		if((grown = realloc(t->paths, t->cap * sizeof(*t->paths))) == NULL) {
+			return -1;
+		}
+
+		t->paths = grown;
+	}
+
+	t->paths[t->n++] = path;
+	return 0;
+}
+
+/* collect the regular files below root/rel (rel is NULL for the root itself). Symbolic links to directories are not followed, so there are no cycles */
+static int walk(struct tree *t, const char *rel)
+{
+	char *dir = rel ? join(t->root, rel) : (char *) t->root;
+	struct dirent *de;
+	DIR *d;
+	int ret = 0, err = 0;
+
+	if(dir == NULL || (d = opendir(dir)) == NULL) {
+		err = dir ? errno : ENOMEM;
+		if(rel) {
+			free(dir);
+		}
+		errno = err;
+		return -1;
+	}
+
+	while(ret == 0 && (errno = 0, de = readdir(d)) != NULL) {
+
+		char *path, *full;
+		struct stat st;
+
+		if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+			continue;
+		}
+
+		path = rel ? join(rel, de->d_name) : strdup(de->d_name);
+		full = path ? join(t->root, path) : NULL;
+
+		if(full == NULL) {
+			free(path);
+			err = ENOMEM;
+			ret = -1;
+			break;
+		}
+
+		if(lstat(full, &st) == -1 || (S_ISLNK(st.st_mode) && (stat(full, &st) == -1 || S_ISDIR(st.st_mode)))) {
+			/* dangling links and links to directories are skipped, like anything else that's not a file or a directory */
+			st.st_mode = 0;
+		}
+
+		free(full);
+
+		if(S_ISDIR(st.st_mode)) {
+			if((ret = walk(t, path)) == -1) {
+				err = errno;
+			}
+			free(path);
+		} else if(S_ISREG(st.st_mode)) {
+			if((ret = add_path(t, path)) == -1) {
+				err = ENOMEM;
+				free(path);
+			}
+		} else {
+			free(path);
+		}
+	}
+
+	if(ret == 0 && errno != 0) {
+		err = errno;
+		ret = -1;
+	}
+
+	(void) closedir(d);
+	if(rel) {
+		free(dir);
+	}
+
+	errno = err;
+	return ret;
+}
+
+static int cmp_paths(const void *p1, const void *p2)
+{
+	return strcmp(*(char * const *) p1, *(char * const *) p2);
+}
+
+static void tree_free(struct tree *t)
+{
+	size_t i;
+
+	for(i = 0; i < t->n; i++) {
+		free(t->paths[i]);
+	}
+
+	free(t->paths);
+}
+
+/* compare a pair of files into a memory stream */
+static void pair_task(void *arg, size_t task)
+{
+	struct trees *ts = arg;
+	struct entry *e = &ts->entries[task];
+	char *p1, *p2;
+	FILE *out;
+
+	if(e->in != 0) {
+		return;
+	}
+
+	p1 = join(ts->a->root, e->path);
+	p2 = join(ts->b->root, e->path);
+
+	if(p1 == NULL || p2 == NULL || (out = open_memstream(&e->buf, &e->len)) == NULL) {
+		e->ret = -2;
+	} else {
+		e->ret = ts->cmp(out, p1, p2, ts->arg);
+		if(fclose(out) != 0) {
+			e->ret = -2;
+		}
+	}
+
+	free(p1);
+	free(p2);
+}
+
+/* the paths are sorted, so pairs are found by merging both lists */
+static size_t merge(struct entry *e, const struct tree *a, const struct tree *b)
+{
+	size_t i = 0, j = 0, n = 0;
+
+	while(i < a->n || j < b->n) {
+
+		int c = i == a->n ? 1 : j == b->n ? -1 : strcmp(a->paths[i], b->paths[j]);
+
+		e[n].in = c < 0 ? 1 : c > 0 ? 2 : 0;
+		e[n].path = c <= 0 ? a->paths[i++] : b->paths[j++];
+		if(c == 0) {
+			j++;
+		}
+		n++;
+	}
+
+	return n;
+}
+
+long compare_trees(FILE *out, const char *dir1, const char *dir2, unsigned int jobs, tree_compare_t cmp, void *arg)
+{
+	struct tree a, b;
+	struct trees ts;
+	struct workpool wp;
+	size_t i, n;
+	long failed = 0;
+	int nomem = 0, err = 0;
+
+	memset(&a, 0, sizeof(a));
+	memset(&b, 0, sizeof(b));
+	memset(&ts, 0, sizeof(ts));
+	a.root = dir1;
+	b.root = dir2;
+
+	if(walk(&a, NULL) == -1 || walk(&b, NULL) == -1) {
+		err = errno;
+		failed = -1;
+		goto out;
+	}
+
+	qsort(a.paths, a.n, sizeof(*a.paths), cmp_paths);
+	qsort(b.paths, b.n, sizeof(*b.paths), cmp_paths);
+
+	if(a.n + b.n == 0) {
+		goto out;
+	}
+
+	if((ts.entries = calloc(a.n + b.n, sizeof(*ts.entries))) == NULL) {
+		err = ENOMEM;
+		failed = -1;
+		goto out;
+	}
+
+	ts.a = &a;
+	ts.b = &b;
+	ts.cmp = cmp;
+	ts.arg = arg;
+	n = merge(ts.entries, &a, &b);
+
+	if(workpool_start(&wp, jobs, n, pair_task, &ts) == -1) {
+		err = ENOMEM;
+		failed = -1;
+		goto out;
+	}
+
+	/* print the entries in order, as soon as they are ready */
+	for(i = 0; i < n; i++) {
+
+		struct entry *e = &ts.entries[i];
+
+		workpool_wait(&wp, i);
+
+		if(e->in != 0) {
+			(void) fprintf(out, "Nur in %s: %s\n", e->in == 1 ? dir1 : dir2, e->path);
+		} else if(e->ret == 1 && e->len > 0) {
+			/* pairs differing only beyond the end of the shorter file have nothing to show, as with two files */
+			(void) fprintf(out, "Datei: %s\n", e->path);
+			(void) fwrite(e->buf, 1, e->len, out);
+		} else if(e->ret == -1) {
+			failed++;
+		} else if(e->ret == -2) {
+			nomem = 1;
+		}
+
+		free(e->buf);
+		e->buf = NULL;
+	}
+
+	workpool_join(&wp);
+
+	if(nomem) {
+		err = ENOMEM;
+		failed = -1;
+	}
+
+out:
+	free(ts.entries);
+	tree_free(&a);
+	tree_free(&b);
+
+	errno = err;
+	return failed;
+}
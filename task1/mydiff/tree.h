@@ -0,0 +1,38 @@
+/**
+* @file tree.h
+* @brief header file for mydiff's directory mode: compare all files of two directory trees that share the same relative path
+*/
+
+#ifndef TREE_H
+#define TREE_H
+#include <stdio.h> //needed for FILE
+
+/**
+* @brief type definition of the callback comparing a single pair of files.
+*
+* @param out stream to print the differences to
+* @param path1 path of the file in the first tree
+* @param path2 path of the file in the second tree
+* @param arg argument given to compare_trees
+*
+* @return 0 if the files are equal, 1 if they differ, -1 if they could not be compared (the callback reports why)
+*/
+typedef int (*tree_compare_t)(FILE *out, const char *path1, const char *path2, void *arg);
+
+/**
+* @brief walk both trees, pair their regular files by relative path and compare the pairs on a pool of jobs threads.
+* Results are printed in order of the relative paths: "Datei: PATH" followed by the output of cmp for pairs that differ,
+* "Nur in DIR: PATH" for files that exist in one of the trees only. Equal pairs, and pairs for which cmp printed nothing, print nothing
+*
+* @param out stream to print the results to
+* @param dir1 root of the first tree
+* @param dir2 root of the second tree
+* @param jobs number of file pairs compared at the same time
+* @param cmp callback comparing a single pair of files (called on the pool's threads)
+* @param arg passed on to cmp
+*
+* @return number of pairs cmp failed on, -1 if a tree could not be read or memory ran out (errno is set)
+*/
+long compare_trees(FILE *out, const char *dir1, const char *dir2, unsigned int jobs, tree_compare_t cmp, void *arg);
+
+#endif
@@ -0,0 +1,543 @@
+/**
+* @file uring.c
+* @brief read a regular file through an io_uring of its own, URING_DEPTH reads of URING_BLOCK bytes in flight, handing out blocks of whole lines
+* @details The ring is set up with the raw system calls, there is no liburing. Every buffer (slot) holds one chunk of the file,
+* chunk i goes into slot i % URING_DEPTH. A chunk is handed out in place up to its last '\n', its incomplete last line is copied
+* into a carry buffer, completed by the head of the next chunk and handed out on its own. Once the caller is done with a chunk,
+* its slot is queued for the chunk URING_DEPTH further on, so reading runs ahead of the comparison on both files at once.
+* Where the file system allows it, the file is read with O_DIRECT: the disk fills the buffers itself, instead of the page cache
+* being filled first and copied on the comparing thread. Reads O_DIRECT refuses are repeated through the page cache.
+*/
+#define _GNU_SOURCE /* O_DIRECT */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "uring.h"
+
+/* === Constants === */
+
+/** Alignment of O_DIRECT buffers, offsets and lengths, a page covers the block size of any disk */
+#define DIRECT_ALIGN 4096
+
+/* === Structures === */
+
+/**
+* @brief a buffer and the read filling it
+*/
+struct slot {
+
+	char *data; /**< URING_BLOCK bytes */
+	struct iovec iov; /**< what the read in flight still has to fill */
+	size_t off; /**< offset of the chunk in the file */
+	size_t want; /**< length of the chunk */
+	size_t got; /**< bytes read so far */
+	int busy; /**< nonzero while a read is in flight */
+	int err; /**< errno of a failed read, 0 else */
+
+};
+
+struct uring {
+
+	int ring; /**< file descriptor of the io_uring */
+	int fd; /**< file descriptor the reads go to: direct, or file once O_DIRECT failed */
+	int file; /**< file to read, as given to uring_start */
+	int direct; /**< file opened again with O_DIRECT, -1 if that is not possible */
+	size_t size; /**< size of the file, less if it shrank while being read */
+
+	void *sq_map; /**< mapped submission queue ring */
+	size_t sq_len; /**< length of sq_map */
+	void *cq_map; /**< mapped completion queue ring, the same as sq_map with IORING_FEAT_SINGLE_MMAP */
+	size_t cq_len; /**< length of cq_map */
+	struct io_uring_sqe *sqes; /**< mapped submission queue entries */
+	size_t sqes_len; /**< length of sqes */
+	unsigned *sq_tail, *sq_mask, *sq_array; /**< submission queue ring */
+	unsigned *cq_head, *cq_tail, *cq_mask; /**< completion queue ring */
+	struct io_uring_cqe *cqes; /**< completion queue entries */
+	unsigned queued; /**< entries queued, but not submitted yet */
+	unsigned inflight; /**< reads submitted, but not completed yet */
+
+	struct slot slots[URING_DEPTH]; /**< the buffers */
+	char *buffers; /**< memory of all buffers, page aligned */
+	size_t next_off; /**< offset of the next chunk to read */
+	size_t off; /**< offset of the chunk being handed out */
+	size_t chunk; /**< number of the chunk being handed out */
+	size_t p; /**< bytes of the chunk handed out (or carried) so far */
+	int have; /**< nonzero once the chunk has been read */
+	int held; /**< nonzero while the caller holds a block of the chunk */
+
+	char *carry; /**< incomplete line, waiting for the head of the next chunk */
+	size_t carry_len; /**< bytes in carry */
+	size_t carry_cap; /**< size of carry */
+	int carry_held; /**< nonzero while the caller holds carry */
+
+};
+
+/* === Implementation === */
+
+#ifdef __NR_io_uring_setup
+
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int ring, unsigned submit, unsigned complete, unsigned flags)
+{
+	return (int) syscall(__NR_io_uring_enter, ring, submit, complete, flags, NULL, 0);
+}
+
+#else
+
+/* the headers don't know io_uring, so neither does the kernel we are built for */
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+	(void) entries;
+	(void) p;
+	errno = ENOSYS;
+	return -1;
+}
+
+static int sys_enter(int ring, unsigned submit, unsigned complete, unsigned flags)
+{
+	(void) ring;
+	(void) submit;
+	(void) complete;
+	(void) flags;
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif
+
+/* find the last '\n' in p[0] .. p[n - 1] */
+static const char *last_newline(const char *p, size_t n)
+{
+	while(n--) {
+		if(p[n] == '\n') {
+			return p + n;
+		}
+	}
+
+	return NULL;
+}
+
+/* put a read of what the slot still misses into the submission queue. It goes to the kernel with the next flush */
+static void push(struct uring *u, struct slot *s)
+{
+	unsigned tail = *u->sq_tail, idx = tail & *u->sq_mask;
+	struct io_uring_sqe *sqe = &u->sqes[idx];
+
+	s->iov.iov_base = s->data + s->got;
+	s->iov.iov_len = s->want - s->got;
+	s->busy = 1;
+
+	/* O_DIRECT takes whole blocks only, the read simply ends short at the end of the file */
+	if(u->fd == u->direct) {
+		s->iov.iov_len = (s->iov.iov_len + DIRECT_ALIGN - 1) & ~(size_t) (DIRECT_ALIGN - 1);
+		if(s->iov.iov_len > URING_BLOCK - s->got) {
+			s->iov.iov_len = URING_BLOCK - s->got;
+		}
+	}
+
+	(void) memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = u->fd;
+	sqe->addr = (uint64_t) (uintptr_t) &s->iov;
+	sqe->len = 1;
+	sqe->off = (uint64_t) (s->off + s->got);
+	sqe->user_data = (uint64_t) (s - u->slots);
+
+	u->sq_array[idx] = idx;
+	__atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	u->queued++;
+	u->inflight++;
+}
+
+/* give the slot the next chunk of the file, if there is one left */
+static void queue(struct uring *u, struct slot *s)
+{
+	s->got = 0;
+	s->err = 0;
+
+	if(u->next_off >= u->size) {
+		s->want = 0;
+		return;
+	}
+
+	s->off = u->next_off;
+	s->want = u->size - s->off < URING_BLOCK ? u->size - s->off : URING_BLOCK;
+	u->next_off += s->want;
+
+	push(u, s);
+}
+
+/* submit what has been queued, and wait for at least one completion if asked to */
+static int flush(struct uring *u, int wait)
+{
+	int n;
+
+	for(;;) {
+
+		n = sys_enter(u->ring, u->queued, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0);
+
+		if(n >= 0) {
+			break;
+		}
+		if(errno != EINTR) {
+			return -1;
+		}
+	}
+
+	u->queued -= (unsigned) n < u->queued ? (unsigned) n : u->queued;
+	return 0;
+}
+
+/* take the completions off the ring. Short reads and interrupted ones are queued again for the rest of their chunk */
+static void reap(struct uring *u)
+{
+	unsigned head = *u->cq_head;
+
+	while(head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+
+		const struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+		struct slot *s = &u->slots[cqe->user_data];
+		int res = cqe->res;
+
+		head++;
+		u->inflight--;
+		s->busy = 0;
+
+		if(res == -EINTR || res == -EAGAIN) {
+			push(u, s);
+		} else if(res == -EINVAL && u->fd == u->direct) {
+			/* some file systems open with O_DIRECT, but don't read with it. The page cache always works */
+			u->fd = u->file;
+			push(u, s);
+		} else if(res < 0) {
+			s->err = -res;
+		} else if(res == 0) {
+			/* the file shrank, it ends here */
+			s->want = s->got;
+			if(u->size > s->off + s->got) {
+				u->size = s->off + s->got;
+			}
+		} else if((s->got += (size_t) res) < s->want) {
+			push(u, s);
+		} else {
+			/* complete. A whole block read with O_DIRECT may bring more, if the file grew: only what it had at the start counts */
+			s->got = s->want;
+		}
+	}
+
+	__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* wait for the slot's chunk to be read completely */
+static int wait_slot(struct uring *u, struct slot *s)
+{
+	while(s->busy) {
+
+		if(flush(u, 1) == -1) {
+			return -1;
+		}
+
+		reap(u);
+	}
+
+	if(s->err) {
+		errno = s->err;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* the caller is done with the chunk, its slot reads the next one to come */
+static void recycle(struct uring *u)
+{
+	struct slot *s = &u->slots[u->chunk % URING_DEPTH];
+
+	u->off = s->off + s->want;
+	u->chunk++;
+	u->have = 0;
+	u->held = 0;
+
+	queue(u, s);
+	(void) flush(u, 0);
+}
+
+/* append to the incomplete line */
+static int carry(struct uring *u, const char *p, size_t n)
+{
+	if(n == 0) {
+		return 0;
+	}
+
+	if(u->carry_len + n > u->carry_cap) {
+
+		size_t cap = u->carry_cap ? u->carry_cap : URING_BLOCK;
+		char *grown;
+
+		while(cap < u->carry_len + n) {
+			cap *= 2;
+		}
+
+		if((grown = realloc(u->carry, cap)) == NULL) {
+			errno = ENOMEM;
+			return -1;
+		}
+
+		u->carry = grown;
+		u->carry_cap = cap;
+	}
+
+	(void) memcpy(u->carry + u->carry_len, p, n);
+	u->carry_len += n;
+
+	return 0;
+}
+
+/* the rings are shared with the kernel, their layout is told by the offsets in p */
+static int map_rings(struct uring *u, const struct io_uring_params *p)
+{
+	u->sq_len = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+	u->cq_len = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+	u->sqes_len = p->sq_entries * sizeof(struct io_uring_sqe);
+
+	if(p->features & IORING_FEAT_SINGLE_MMAP) {
+		u->sq_len = u->cq_len = u->sq_len > u->cq_len ? u->sq_len : u->cq_len;
+	}
+
+	if((u->sq_map = mmap(NULL, u->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED, u->ring, IORING_OFF_SQ_RING)) == MAP_FAILED) {
+		u->sq_map = NULL;
+		return -1;
+	}
+
+	if(p->features & IORING_FEAT_SINGLE_MMAP) {
+		u->cq_map = u->sq_map;
+	} else if((u->cq_map = mmap(NULL, u->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED, u->ring, IORING_OFF_CQ_RING)) == MAP_FAILED) {
+		u->cq_map = NULL;
+		return -1;
+	}
+
+	if((u->sqes = mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED, u->ring, IORING_OFF_SQES)) == MAP_FAILED) {
+		u->sqes = NULL;
+		return -1;
+	}
+
+	u->sq_tail = (unsigned *) ((char *) u->sq_map + p->sq_off.tail);
+	u->sq_mask = (unsigned *) ((char *) u->sq_map + p->sq_off.ring_mask);
+	u->sq_array = (unsigned *) ((char *) u->sq_map + p->sq_off.array);
+	u->cq_head = (unsigned *) ((char *) u->cq_map + p->cq_off.head);
+	u->cq_tail = (unsigned *) ((char *) u->cq_map + p->cq_off.tail);
+	u->cq_mask = (unsigned *) ((char *) u->cq_map + p->cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *) ((char *) u->cq_map + p->cq_off.cqes);
+
+	return 0;
+}
+
+/* the same file once more with O_DIRECT, -1 if the file system doesn't support it (tmpfs, ...) */
+static int open_direct(int fd)
+{
+	char path[32];
+
+	(void) snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+	return open(path, O_RDONLY | O_DIRECT);
+}
+
+struct uring *uring_start(int fd, size_t size)
+{
+	struct io_uring_params p;
+	struct uring *u;
+	size_t i;
+	int err;
+
+	if((u = calloc(1, sizeof(*u))) == NULL) {
+		return NULL;
+	}
+
+	u->file = fd;
+	u->direct = -1;
+	u->size = size;
+
+	(void) memset(&p, 0, sizeof(p));
+
+	if((u->ring = sys_setup(URING_DEPTH, &p)) == -1) {
+		free(u);
+		return NULL;
+	}
+
+	if(map_rings(u, &p) == -1) {
+		goto fail;
+	}
+
+	/* mapped memory is page aligned, as O_DIRECT needs it */
+	if((u->buffers = mmap(NULL, (size_t) URING_DEPTH * URING_BLOCK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+		u->buffers = NULL;
+		goto fail;
+	}
+
+	for(i = 0; i < URING_DEPTH; i++) {
+		u->slots[i].data = u->buffers + i * URING_BLOCK;
+	}
+
+	u->direct = open_direct(fd);
+	u->fd = u->direct != -1 ? u->direct : fd;
+
+	/* all slots get a chunk, one system call submits them */
+	for(i = 0; i < URING_DEPTH; i++) {
+		queue(u, &u->slots[i]);
+	}
+
+	if(flush(u, 0) == -1) {
+		goto fail;
+	}
+
+	return u;
+
+fail:
+	err = errno;
+	uring_stop(u);
+	errno = err;
+	return NULL;
+}
+
+int uring_next(struct uring *u, const char **data, size_t *len)
+{
+	if(u->carry_held) {
+		u->carry_len = 0;
+		u->carry_held = 0;
+	}
+
+	if(u->held) {
+		recycle(u);
+	}
+
+	for(;;) {
+
+		struct slot *s = &u->slots[u->chunk % URING_DEPTH];
+		const char *p, *nl;
+		size_t rest;
+
+		if(!u->have) {
+
+			/* the very last line may lack its '\n' */
+			if(u->off >= u->size) {
+
+				if(u->carry_len == 0) {
+					return 0;
+				}
+
+				*data = u->carry;
+				*len = u->carry_len;
+				u->carry_held = 1;
+				return 1;
+			}
+
+			if(wait_slot(u, s) == -1) {
+				return -1;
+			}
+
+			u->have = 1;
+			u->p = 0;
+		}
+
+		p = s->data + u->p;
+		rest = s->got - u->p;
+
+		/* complete the incomplete line first, it gets handed out on its own */
+		if(u->carry_len) {
+
+			size_t n;
+
+			nl = memchr(p, '\n', rest);
+			n = nl ? (size_t) (nl - p) + 1 : rest;
+
+			if(carry(u, p, n) == -1) {
+				return -1;
+			}
+
+			u->p += n;
+
+			if(nl) {
+				*data = u->carry;
+				*len = u->carry_len;
+				u->carry_held = 1;
+				return 1;
+			}
+
+			recycle(u);
+			continue;
+		}
+
+		/* the whole lines are handed out in place, the incomplete last one is carried to the next chunk */
+		nl = last_newline(p, rest);
+
+		if(carry(u, nl ? nl + 1 : p, nl ? rest - (size_t) (nl + 1 - p) : rest) == -1) {
+			return -1;
+		}
+
+		if(nl == NULL) {
+			recycle(u);
+			continue;
+		}
+
+		*data = p;
+		*len = (size_t) (nl + 1 - p);
+		u->held = 1;
+		return 1;
+	}
+}
+
+void uring_stop(struct uring *u)
+{
+	int drained = 1;
+
+	/* the kernel writes into the buffers until the reads complete */
+	while(u->sqes != NULL && u->inflight) {
+
+		if(flush(u, 1) == -1) {
+			/* entries that never got submitted don't matter */
+			drained = u->inflight <= u->queued;
+			break;
+		}
+
+		reap(u);
+	}
+
+	if(u->sqes != NULL) {
+		(void) munmap(u->sqes, u->sqes_len);
+	}
+	if(u->cq_map != NULL && u->cq_map != u->sq_map) {
+		(void) munmap(u->cq_map, u->cq_len);
+	}
+	if(u->sq_map != NULL) {
+		(void) munmap(u->sq_map, u->sq_len);
+	}
+
+	(void) close(u->ring);
+
+	if(u->direct != -1) {
+		(void) close(u->direct);
+	}
+
+	/* better leak the buffers than have them overwritten once they are reused */
+	if(!drained) {
+		return;
+	}
+
+	if(u->buffers != NULL) {
+		(void) munmap(u->buffers, (size_t) URING_DEPTH * URING_BLOCK);
+	}
+
+	free(u->carry);
+	free(u);
+}
@@ -0,0 +1,55 @@
+/**
+* @file uring.h
+* @brief header file for the io_uring file reader, which keeps several large reads of a regular file in flight
+*/
+
+#ifndef URING_H
+#define URING_H
+#include <stddef.h> //needed for size_t
+
+/**
+* @brief size of a single read
+*/
+#define URING_BLOCK (1 << 20)
+
+/**
+* @brief number of reads kept in flight per file
+*/
+#define URING_DEPTH 8
+
+/**
+* @brief opaque type of an io_uring reader
+*/
+struct uring;
+
+/**
+* @brief set up an io_uring of its own for fd and queue the first URING_DEPTH reads. Whenever the caller is done with a block,
+* the buffer it came from is queued for the next read right away, so the disk stays busy while lines get compared
+*
+* @param fd file descriptor of a regular file, read from offset 0 (not closed by the reader)
+* @param size size of the file
+*
+* @return the reader, NULL if io_uring is not available (no kernel support, disabled, ...) or memory ran out (errno is set)
+*/
+struct uring *uring_start(int fd, size_t size);
+
+/**
+* @brief hand the current block back to the reader and get the next one. Like reader_next (see reader.h),
+* a block holds whole lines only, just the very last one of the file may lack its '\n'
+*
+* @param u reader to get the block from
+* @param data receives the block's first char
+* @param len receives the block's length
+*
+* @return 1 if a block was returned, 0 at the end of the file, -1 on read errors (errno is set)
+*/
+int uring_next(struct uring *u, const char **data, size_t *len);
+
+/**
+* @brief wait for the reads still in flight and release the reader
+*
+* @param u reader to stop
+*/
+void uring_stop(struct uring *u);
+
+#endif
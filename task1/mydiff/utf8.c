@@ -0,0 +1,639 @@
+/**
+* @file utf8.c
+* @brief count mismatching code points of two lines, validating both as UTF-8 on the way
+* @details Equal bytes are equal code points, so the vectorized kernel walks both lines 32 bytes at a time as long as they are equal,
+* like the byte kernels do. Blocks holding no byte above 0x7f are valid as they are, the others go through the lookup
+* algorithm of Keiser and Lemire ("Validating UTF-8 In Less Than One Instruction Per Byte"): three table lookups on the nibbles
+* of each byte and the one in front of it classify every error of a 2 byte window, the 3 and 4 byte sequences are checked
+* by shifting in the bytes 2 and 3 places back. The state carried from block to block is the previous block.
+* Where the lines differ (or end) the equal run is cut back to the start of its last char, and the scalar decoder takes over
+* for one char of each line, so sequences of different lengths don't shift the comparison.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "utf8.h"
+#include "mismatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* === Constants === */
+
+/** Decoded value of an invalid byte c is INVALID + c, beyond all code points */
+#define INVALID 0x110000u
+
+/** Error classes of the lookup tables, one bit each (a 2 byte window is an error if all three lookups agree on a bit) */
+#define TOO_SHORT (1 << 0) /**< lead byte or ASCII followed by a lead byte or ASCII, where a continuation is due */
+#define TOO_LONG (1 << 1) /**< ASCII followed by a continuation */
+#define OVERLONG_3 (1 << 2) /**< E0 followed by 80 .. 9F */
+#define TOO_LARGE (1 << 3) /**< F4 followed by 90 .. BF, or F5 and above */
+#define SURROGATE (1 << 4) /**< ED followed by A0 .. BF */
+#define OVERLONG_2 (1 << 5) /**< C0 or C1 */
+#define TOO_LARGE_1000 (1 << 6) /**< F5 and above followed by 80 .. 8F */
+#define OVERLONG_4 (1 << 6) /**< F0 followed by 80 .. 8F */
+#define TWO_CONTS (1 << 7) /**< continuation followed by a continuation, fine only inside a 3 or 4 byte sequence */
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+/* === Scalar === */
+
+/* length of the sequence a lead byte asks for, 1 for ASCII and continuations */
+static inline size_t lead_length(unsigned char c)
+{
+	return c < 0xc0 ? 1 : c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4;
+}
+
+/* decode the char at p (n > 0 chars may be read). Returns its length, 1 for an invalid byte */
+static inline size_t decode(const unsigned char *p, size_t n, uint32_t *cp)
+{
+	uint32_t c = p[0], min;
+	size_t len, k;
+
+	if(c < 0x80) {
+		*cp = c;
+		return 1;
+	}
+
+	if(c >= 0xc2 && c <= 0xdf) {
+		len = 2;
+		c &= 0x1f;
+		min = 0x80;
+	} else if(c >= 0xe0 && c <= 0xef) {
+		len = 3;
+		c &= 0x0f;
+		min = 0x800;
+	} else if(c >= 0xf0 && c <= 0xf4) {
+		len = 4;
+		c &= 0x07;
+		min = 0x10000;
+	} else {
+		goto invalid;
+	}
+
+	if(n < len) {
+		goto invalid;
+	}
+
+	for(k = 1; k < len; k++) {
+		if((p[k] & 0xc0) != 0x80) {
+			goto invalid;
+		}
+		c = (c << 6) | (p[k] & 0x3f);
+	}
+
+	if(c < min || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff)) {
+		goto invalid;
+	}
+
+	*cp = c;
+	return len;
+
+invalid:
+	*cp = INVALID + p[0];
+	return 1;
+}
+
+/* compare one char of each line. Returns 0 instead at a stop char or the end of either line */
+static inline int step(const unsigned char *a, size_t na, const unsigned char *b, size_t nb, size_t *i, size_t *j, size_t *count, int *invalid)
+{
+	uint32_t ca, cb;
+
+	if(*i >= na || *j >= nb || STOP_COMPARE_CHAR(a[*i]) || STOP_COMPARE_CHAR(b[*j])) {
+		return 0;
+	}
+
+	*i += decode(a + *i, na - *i, &ca);
+	*j += decode(b + *j, nb - *j, &cb);
+
+	*invalid |= (ca >= INVALID ? UTF8_INVALID_A : 0) | (cb >= INVALID ? UTF8_INVALID_B : 0);
+	*count += ca != cb;
+
+	return 1;
+}
+
+/* reference implementation */
+static size_t utf8_scalar(const char *a, size_t na, const char *b, size_t nb, size_t *stop_a, size_t *stop_b, int *invalid)
+{
+	size_t i = 0, j = 0, count = 0;
+
+	*invalid = 0;
+
+	while(step((const unsigned char *) a, na, (const unsigned char *) b, nb, &i, &j, &count, invalid));
+
+	*stop_a = i;
+	*stop_b = j;
+	return count;
+}
+
+static int valid_scalar(const char *p, size_t n)
+{
+	const unsigned char *s = (const unsigned char *) p;
+	size_t i = 0;
+	uint32_t cp;
+
+	while(i < n) {
+
+		/* runs of ASCII a word at a time */
+		if(n - i >= 8) {
+
+			uint64_t w;
+
+			memcpy(&w, s + i, 8);
+			if(!(w & 0x8080808080808080ULL)) {
+				i += 8;
+				continue;
+			}
+		}
+
+		i += decode(s + i, n - i, &cp);
+
+		if(cp >= INVALID) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+* number of chars to cut off the end of the equal run from .. to, so it ends at the start of a char.
+* Any lead byte (and any ASCII byte) starts a char of the scalar decoder, whatever came in front of it
+*/
+static inline size_t cut_back(const unsigned char *a, size_t from, size_t to)
+{
+	size_t k;
+
+	for(k = 1; k <= 3 && to >= from + k; k++) {
+
+		unsigned char c = a[to - k];
+
+		if((c & 0xc0) != 0x80) {
+			return lead_length(c) > k ? k : 0;
+		}
+	}
+
+	return 0;
+}
+
+/* === AVX2 === */
+
+#ifdef HAVE_X86
+
+/** the bytes 1, 2 or 3 places in front of those of in, the first ones taken from the end of the previous block */
+#define PREV_AVX2(in, prev, n) _mm256_alignr_epi8((in), _mm256_permute2x128_si256((prev), (in), 0x21), 16 - (n))
+
+/** the table t0 .. t15 in both lanes, for _mm256_shuffle_epi8 */
+#define TABLE_AVX2(t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12, t13, t14, t15) \
+	_mm256_setr_epi8((char) (t0), (char) (t1), (char) (t2), (char) (t3), (char) (t4), (char) (t5), (char) (t6), (char) (t7), \
+			(char) (t8), (char) (t9), (char) (t10), (char) (t11), (char) (t12), (char) (t13), (char) (t14), (char) (t15), \
+			(char) (t0), (char) (t1), (char) (t2), (char) (t3), (char) (t4), (char) (t5), (char) (t6), (char) (t7), \
+			(char) (t8), (char) (t9), (char) (t10), (char) (t11), (char) (t12), (char) (t13), (char) (t14), (char) (t15))
+
+/**
+* @brief state of the validation of consecutive blocks
+*/
+struct validator {
+
+	__m256i prev; /**< the previous block */
+	__m256i incomplete; /**< nonzero if the previous block ends inside a sequence */
+	__m256i error; /**< nonzero once an error has been found */
+
+};
+
+__attribute__((target("avx2")))
+static inline __m256i high_nibbles_avx2(__m256i v)
+{
+	return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f));
+}
+
+/* errors of the 2, 3 and 4 byte windows ending in the bytes of in */
+__attribute__((always_inline, target("avx2")))
+static inline __m256i check_avx2(__m256i in, __m256i prev)
+{
+	const __m256i byte_1_high = TABLE_AVX2(
+		/* 0_______ ASCII */
+		TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+		/* 10______ continuation */
+		TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+		/* 1100____ 2 byte lead */
+		TOO_SHORT | OVERLONG_2,
+		/* 1101____ 2 byte lead */
+		TOO_SHORT,
+		/* 1110____ 3 byte lead */
+		TOO_SHORT | OVERLONG_3 | SURROGATE,
+		/* 1111____ 4 byte lead */
+		TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+	const __m256i byte_1_low = TABLE_AVX2(
+		/* ____0000 */
+		CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+		/* ____0001 */
+		CARRY | OVERLONG_2,
+		/* ____001_ */
+		CARRY, CARRY,
+		/* ____0100 */
+		CARRY | TOO_LARGE,
+		/* ____0101 .. ____1100 */
+		CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+		/* ____1101 */
+		CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+		/* ____111_ */
+		CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000);
+	const __m256i byte_2_high = TABLE_AVX2(
+		/* 0_______ ASCII */
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+		/* 1000____ */
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+		/* 1001____ */
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+		/* 101_____ */
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+		/* 11______ lead */
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+	__m256i prev1 = PREV_AVX2(in, prev, 1), prev2 = PREV_AVX2(in, prev, 2), prev3 = PREV_AVX2(in, prev, 3);
+	__m256i special = _mm256_and_si256(_mm256_and_si256(
+			_mm256_shuffle_epi8(byte_1_high, high_nibbles_avx2(prev1)),
+			_mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, _mm256_set1_epi8(0x0f)))),
+			_mm256_shuffle_epi8(byte_2_high, high_nibbles_avx2(in)));
+
+	/* a continuation is due 2 bytes after a 3 or 4 byte lead, and 3 bytes after a 4 byte lead: that's where two continuations are fine */
+	__m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char) (0xe0 - 0x80)));
+	__m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char) (0xf0 - 0x80)));
+	__m256i due = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char) 0x80));
+
+	return _mm256_xor_si256(due, special);
+}
+
+/* nonzero if the block ends inside a sequence: a lead byte in the last 3 places that asks for more bytes than are left */
+__attribute__((always_inline, target("avx2")))
+static inline __m256i incomplete_avx2(__m256i in)
+{
+	const __m256i max = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+			-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char) (0xf0 - 1), (char) (0xe0 - 1), (char) (0xc0 - 1));
+
+	return _mm256_subs_epu8(in, max);
+}
+
+__attribute__((always_inline, target("avx2")))
+static inline void validator_init(struct validator *v)
+{
+	v->prev = _mm256_setzero_si256();
+	v->incomplete = _mm256_setzero_si256();
+	v->error = _mm256_setzero_si256();
+}
+
+/* feed the next block. ASCII blocks only have to show that the previous one ended at a char */
+__attribute__((always_inline, target("avx2")))
+static inline void validator_feed(struct validator *v, __m256i in, uint32_t high)
+{
+	if(high) {
+		v->error = _mm256_or_si256(v->error, check_avx2(in, v->prev));
+		v->incomplete = incomplete_avx2(in);
+	} else {
+		v->error = _mm256_or_si256(v->error, v->incomplete);
+		v->incomplete = _mm256_setzero_si256();
+	}
+
+	v->prev = in;
+}
+
+__attribute__((target("avx2,bmi")))
+static size_t utf8_avx2(const char *a, size_t na, const char *b, size_t nb, size_t *stop_a, size_t *stop_b, int *invalid)
+{
+	const unsigned char *ua = (const unsigned char *) a, *ub = (const unsigned char *) b;
+	const __m256i nl = _mm256_set1_epi8('\n'), zero = _mm256_setzero_si256();
+	const __m256i index = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+			16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+	size_t i = 0, j = 0, count = 0;
+
+	*invalid = 0;
+
+	/* the vectorized run starts at a char of both lines, the scalar step always leaves them there */
+	do {
+
+		struct validator v;
+		size_t from = i;
+		int stopped = 0;
+
+		validator_init(&v);
+
+		while(na - i >= 32 && nb - j >= 32) {
+
+			__m256i va = _mm256_loadu_si256((const __m256i *) (a + i));
+			__m256i vb = _mm256_loadu_si256((const __m256i *) (b + j));
+			uint32_t diff = ~(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+			uint32_t end = (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(va, nl), _mm256_cmpeq_epi8(va, zero)));
+
+			if(diff | end) {
+
+				/* the equal part in front of the first difference or stop char, up to the start of its last char */
+				size_t keep = (size_t) __builtin_ctz(diff | end), cut = cut_back(ua, from, i + keep);
+
+				if(cut > keep) {
+					/* that char started in the previous block, which has been checked up to it already */
+					i -= cut - keep;
+					j -= cut - keep;
+				} else {
+					/* zeros in place of the rest, they are ASCII and fine after a complete char */
+					keep -= cut;
+					va = _mm256_and_si256(va, _mm256_cmpgt_epi8(_mm256_set1_epi8((char) keep), index));
+					validator_feed(&v, va, (uint32_t) _mm256_movemask_epi8(va));
+					i += keep;
+					j += keep;
+				}
+
+				stopped = 1;
+				break;
+			}
+
+			validator_feed(&v, va, (uint32_t) _mm256_movemask_epi8(va));
+			i += 32;
+			j += 32;
+		}
+
+		/* out of whole blocks: the last one may end inside a char, which is left to the scalar step */
+		if(!stopped) {
+
+			size_t cut = cut_back(ua, from, i);
+
+			i -= cut;
+			j -= cut;
+		}
+
+		if(!_mm256_testz_si256(v.error, v.error)) {
+			*invalid |= UTF8_INVALID_A | UTF8_INVALID_B;
+		}
+
+	} while(step(ua, na, ub, nb, &i, &j, &count, invalid));
+
+	*stop_a = i;
+	*stop_b = j;
+	return count;
+}
+
+__attribute__((target("avx2")))
+static int valid_avx2(const char *p, size_t n)
+{
+	struct validator v;
+	unsigned char tail[32];
+	size_t i;
+	__m256i in;
+
+	validator_init(&v);
+
+	for(i = 0; i + 32 <= n; i += 32) {
+		in = _mm256_loadu_si256((const __m256i *) (p + i));
+		validator_feed(&v, in, (uint32_t) _mm256_movemask_epi8(in));
+	}
+
+	/* zeros after the last char are ASCII, a sequence cut short by the end of the buffer is not */
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, p + i, n - i);
+	in = _mm256_loadu_si256((const __m256i *) tail);
+	validator_feed(&v, in, (uint32_t) _mm256_movemask_epi8(in));
+	v.error = _mm256_or_si256(v.error, v.incomplete);
+
+	return _mm256_testz_si256(v.error, v.error);
+}
+
+#endif
+
+/* === Implementation === */
+
+utf8_kernel_t count_utf8 = utf8_scalar;
+
+/** the checker of the same width as count_utf8 */
+static int (*valid_kernel)(const char *p, size_t n) = valid_scalar;
+
+int utf8_valid(const char *p, size_t n)
+{
+	return valid_kernel(p, n);
+}
+
+#ifdef HAVE_X86
+static int have_avx2(void)
+{
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi");
+}
+#endif
+
+const char *utf8_init(void)
+{
+#ifdef HAVE_X86
+	const char *force = getenv("MYDIFF_KERNEL");
+
+	__builtin_cpu_init();
+
+	/* there is no SSE2 or AVX-512 variant, those get the next narrower kernel */
+	if(have_avx2() && (force == NULL || (strcmp(force, "scalar") != 0 && strcmp(force, "sse2") != 0))) {
+		count_utf8 = utf8_avx2;
+		valid_kernel = valid_avx2;
+		return "avx2";
+	}
+#endif
+
+	count_utf8 = utf8_scalar;
+	valid_kernel = valid_scalar;
+	return "scalar";
+}
+
+/* === Self test === */
+
+/** number of random line pairs the kernels have to agree on */
+#define TEST_ROUNDS 100000
+/** maximum length of a random test line */
+#define TEST_MAX_LEN 400
+
+/** chars the test lines are made of: ASCII and 2, 3 and 4 byte sequences, then invalid ones, then the stop chars */
+static const char *const test_chars[] = {
+	"a", "b", "\xc3\xa4", "\xc3\xb6", "\xe2\x82\xac", "\xe2\x80\x94", "\xf0\x9d\x84\x9e", "\xf0\x9f\x98\x80",
+	"\xc0\x80", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xe2\x82", "\xf0\x9d\x84", "\x80", "\xff", "\xe0\x9f\xbf",
+	"\n", ""
+};
+
+#define TEST_VALID 8
+#define TEST_INVALID 16
+
+/** sequences that have to be found valid (as whole buffers) */
+static const char *const valid_vectors[] = {
+	"abc", "\xc3\xa4\xc3\xb6\xc3\xbc", "\xe2\x82\xac", "\xf0\x9d\x84\x9e", "\xc2\x80", "\xdf\xbf", "\xe0\xa0\x80",
+	"\xef\xbf\xbf", "\xed\x9f\xbf", "\xee\x80\x80", "\xf0\x90\x80\x80", "\xf4\x8f\xbf\xbf"
+};
+
+/** sequences that have to be found invalid */
+static const char *const invalid_vectors[] = {
+	"\xc0\x80", "\xc1\xbf", "\xe0\x9f\xbf", "\xed\xa0\x80", "\xed\xbf\xbf", "\xf0\x8f\xbf\xbf", "\xf4\x90\x80\x80",
+	"\xf5\x80\x80\x80", "\xff", "\x80", "\xbf\xbf", "\xc3", "\xe2\x82", "\xf0\x9d\x84", "\xc3\xc3\xa4", "a\x80"
+};
+
+/* xorshift, we want the same test data on every run */
+static uint32_t test_rand(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/* append char c of test_chars to line if it fits */
+static size_t test_put(char *line, size_t len, size_t c)
+{
+	size_t n = strlen(test_chars[c]);
+
+	if(c == TEST_INVALID + 1) {
+		n = 1;
+	}
+
+	if(len + n > TEST_MAX_LEN) {
+		return len;
+	}
+
+	memcpy(line + len, test_chars[c], n);
+	return len + n;
+}
+
+/* pick a char: mostly ASCII, some longer ones, invalid ones only if bad, stop chars rarely */
+static size_t test_pick(uint32_t *state, int bad)
+{
+	uint32_t r = test_rand(state) % 1024;
+
+	if(r < 2) {
+		return TEST_INVALID + r;
+	}
+	if(bad && r < 10) {
+		return TEST_VALID + r % (TEST_INVALID - TEST_VALID);
+	}
+
+	return r < 600 ? r & 1 : 2 + r % (TEST_VALID - 2);
+}
+
+/* compare the kernel with the scalar one on a and b */
+static int test_pair(const char *name, utf8_kernel_t kernel, const char *a, size_t na, const char *b, size_t nb)
+{
+	size_t ref_a, ref_b, stop_a, stop_b, ref, count;
+	int ref_invalid, inv;
+
+	ref = utf8_scalar(a, na, b, nb, &ref_a, &ref_b, &ref_invalid);
+	count = kernel(a, na, b, nb, &stop_a, &stop_b, &inv);
+
+	if(count != ref || stop_a != ref_a || stop_b != ref_b || inv != ref_invalid) {
+		(void) fprintf(stdout, "utf8 %s: FAILED (lengths %lu/%lu: counted %lu up to %lu/%lu invalid %d, expected %lu up to %lu/%lu invalid %d)\n",
+				name, (unsigned long) na, (unsigned long) nb, (unsigned long) count, (unsigned long) stop_a, (unsigned long) stop_b, inv,
+				(unsigned long) ref, (unsigned long) ref_a, (unsigned long) ref_b, ref_invalid);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* a vector behind a run of ASCII long enough for the vectorized kernels, and the same run behind it */
+static int test_vector(const char *v, int valid)
+{
+	char buf[3 * 40];
+	size_t n = strlen(v), pad, k;
+	int ret = 0;
+
+	for(pad = 0; pad < 40; pad += 13) {
+
+		memset(buf, 'x', sizeof(buf));
+		memcpy(buf + pad, v, n);
+
+		for(k = 0; k < 4; k++) {
+
+			size_t stop_a, stop_b, len = k & 1 ? sizeof(buf) : pad + n;
+			int inv;
+			utf8_kernel_t kernel = k & 2 ? count_utf8 : utf8_scalar;
+
+			if(!utf8_valid(buf, len) != !valid || !valid_scalar(buf, len) != !valid) {
+				ret = -1;
+			}
+
+			if(kernel(buf, len, buf, len, &stop_a, &stop_b, &inv) != 0 || stop_a != len || inv != (valid ? 0 : UTF8_INVALID_A | UTF8_INVALID_B)) {
+				ret = -1;
+			}
+		}
+	}
+
+	if(ret) {
+		(void) fprintf(stdout, "utf8: FAILED (%s sequence found %s)\n", valid ? "valid" : "invalid", valid ? "invalid" : "valid");
+	}
+
+	return ret;
+}
+
+/*
+* Line b is a copy of line a with some chars replaced by others of different lengths, in every other round
+* invalid sequences are mixed in. Both lines are placed in front of an inaccessible page, like in mismatch_self_test.
+*/
+int utf8_self_test(void)
+{
+	size_t page = (size_t) sysconf(_SC_PAGESIZE), region = 2 * ((TEST_MAX_LEN + page - 1) / page) * page;
+	char *mem, *end_a, *end_b, la[TEST_MAX_LEN], lb[TEST_MAX_LEN];
+	const char *name = utf8_init();
+	uint32_t state = 2463534242u;
+	size_t i, k;
+	int ret = 0;
+
+	if((mem = mmap(NULL, 2 * region, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+		(void) fprintf(stdout, "self test: could not map test pages\n");
+		return -1;
+	}
+
+	if(mprotect(mem + region - page, page, PROT_NONE) == -1 || mprotect(mem + 2 * region - page, page, PROT_NONE) == -1) {
+		(void) fprintf(stdout, "self test: could not protect guard pages\n");
+		(void) munmap(mem, 2 * region);
+		return -1;
+	}
+
+	end_a = mem + region - page;
+	end_b = mem + 2 * region - page;
+
+	for(i = 0; i < TEST_ROUNDS && ret == 0; i++) {
+
+		size_t n = test_rand(&state) % (TEST_MAX_LEN / 2), na = 0, nb = 0, rate = 1 + test_rand(&state) % 64;
+		int bad = (int) (i & 1);
+		char *a, *b;
+
+		for(k = 0; k < n; k++) {
+
+			size_t c = test_pick(&state, bad);
+
+			na = test_put(la, na, c);
+			nb = test_put(lb, nb, test_rand(&state) % rate == 0 ? test_pick(&state, bad) : c);
+		}
+
+		a = end_a - na;
+		b = end_b - nb;
+		memcpy(a, la, na);
+		memcpy(b, lb, nb);
+
+		ret = test_pair(name, count_utf8, a, na, b, nb);
+
+		if(ret == 0 && !utf8_valid(a, na) != !valid_scalar(a, na)) {
+			(void) fprintf(stdout, "utf8 %s: FAILED (length %lu: validity differs from the scalar check)\n", name, (unsigned long) na);
+			ret = -1;
+		}
+	}
+
+	for(k = 0; k < sizeof(valid_vectors) / sizeof(valid_vectors[0]) && ret == 0; k++) {
+		ret = test_vector(valid_vectors[k], 1);
+	}
+
+	for(k = 0; k < sizeof(invalid_vectors) / sizeof(invalid_vectors[0]) && ret == 0; k++) {
+		ret = test_vector(invalid_vectors[k], 0);
+	}
+
+	if(ret == 0) {
+		(void) fprintf(stdout, "utf8 %s: ok\n", name);
+	}
+
+	(void) munmap(mem, 2 * region);
+	return ret;
+}
@@ -0,0 +1,69 @@
+/**
+* @file utf8.h
+* @brief header file for the UTF-8 comparison kernels (-U): mismatches are counted per code point, and invalid sequences are found on the way
+*/
+
+#ifndef UTF8_H
+#define UTF8_H
+#include <stddef.h> //needed for size_t
+
+/**
+* @brief flag for the invalid result of a UTF-8 kernel: the first line holds an invalid sequence
+*/
+#define UTF8_INVALID_A 1
+
+/**
+* @brief flag for the invalid result of a UTF-8 kernel: the second line holds an invalid sequence
+*/
+#define UTF8_INVALID_B 2
+
+/**
+* @brief type definition of a UTF-8 comparison kernel.
+* Compares a and b code point by code point until one of them holds a STOP_COMPARE_CHAR (see mismatch.h) or its end is reached.
+* A byte that starts no valid sequence (truncated, overlong, surrogate, beyond U+10FFFF, stray continuation) is a char of its own,
+* it differs from every code point and from every other byte
+*
+* @param a chars of the first line
+* @param na number of chars that may be read from a
+* @param b chars of the second line
+* @param nb number of chars that may be read from b
+* @param stop_a receives the index in a where comparing stopped
+* @param stop_b receives the index in b where comparing stopped
+* @param invalid receives UTF8_INVALID_A and / or UTF8_INVALID_B if the compared part of a or b holds an invalid sequence, 0 else
+*
+* @return number of mismatching chars in front of the stops
+*/
+typedef size_t (*utf8_kernel_t)(const char *a, size_t na, const char *b, size_t nb, size_t *stop_a, size_t *stop_b, int *invalid);
+
+/**
+* @brief the kernel selected by utf8_init(). Defaults to the scalar kernel
+*/
+extern utf8_kernel_t count_utf8;
+
+/**
+* @brief check a buffer for invalid UTF-8, with the same width as count_utf8
+*
+* @param p first char of the buffer, which has to start at a char
+* @param n number of chars in the buffer
+*
+* @return nonzero if the buffer is valid UTF-8, 0 else
+*/
+int utf8_valid(const char *p, size_t n);
+
+/**
+* @brief select the widest kernel the cpu supports: AVX2 (validating 32 chars at once), or scalar.
+* MYDIFF_KERNEL=scalar or sse2 selects the scalar one
+*
+* @return name of the selected kernel
+*/
+const char *utf8_init(void);
+
+/**
+* @brief check the vectorized kernel against the scalar one on random lines of valid and invalid UTF-8,
+* and both against known valid and invalid sequences. Reports on stdout
+*
+* @return 0 if all kernels agree, -1 else
+*/
+int utf8_self_test(void);
+
+#endif
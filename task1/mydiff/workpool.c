@@ -0,0 +1,131 @@
+/**
+* @file workpool.c
+* @brief pool of worker threads that work off a numbered list of tasks
+*/
+#include <stdlib.h>
+#include "workpool.h"
+
+/* take the next task until there are none left */
+static void *worker(void *param)
+{
+	struct workpool *wp = param;
+
+	for(;;) {
+
+		size_t task;
+
+		(void) pthread_mutex_lock(&wp->lock);
+		task = wp->next < wp->ntasks ? wp->next++ : wp->ntasks;
+		(void) pthread_mutex_unlock(&wp->lock);
+
+		if(task == wp->ntasks) {
+			break;
+		}
+
+		wp->func(wp->arg, task);
+
+		(void) pthread_mutex_lock(&wp->lock);
+		wp->done[task] = 1;
+		(void) pthread_cond_broadcast(&wp->finished);
+		(void) pthread_mutex_unlock(&wp->lock);
+	}
+
+	return NULL;
+}
+
+int workpool_start(struct workpool *wp, size_t nthreads, size_t ntasks, workpool_func_t func, void *arg)
+{
+	wp->nthreads = 0;
+	wp->ntasks = ntasks;
+	wp->next = 0;
+	wp->func = func;
+	wp->arg = arg;
+
+	if(nthreads > ntasks) {
+		nthreads = ntasks;
+	}
+
+	if(nthreads == 0) {
+		nthreads = 1;
+	}
+
+	wp->threads = malloc(nthreads * sizeof(*wp->threads));
+	wp->done = calloc(ntasks ? ntasks : 1, sizeof(*wp->done));
+
+	if(wp->threads == NULL || wp->done == NULL) {
+		free(wp->threads);
+		free(wp->done);
+		return -1;
+	}
+
+	(void) pthread_mutex_init(&wp->lock, NULL);
+	(void) pthread_cond_init(&wp->finished, NULL);
+
+	for(; wp->nthreads < nthreads; wp->nthreads++) {
+
+		if(pthread_create(&wp->threads[wp->nthreads], NULL, worker, wp) != 0) {
+			break;
+		}
+
+	}
+
+	/* We can live with fewer threads than requested, but not without any */
+	if(wp->nthreads == 0) {
+		workpool_join(wp);
+		return -1;
+	}
+
+	return 0;
+}
+
+void workpool_wait(struct workpool *wp, size_t task)
+{
+	(void) pthread_mutex_lock(&wp->lock);
+
+	while(!wp->done[task]) {
+		(void) pthread_cond_wait(&wp->finished, &wp->lock);
+	}
+
+	(void) pthread_mutex_unlock(&wp->lock);
+}
+
+int workpool_run(size_t nthreads, size_t ntasks, workpool_func_t func, void *arg)
+{
+	struct workpool wp;
+	size_t i;
+
+	if(nthreads <= 1 || ntasks <= 1) {
+
+		for(i = 0; i < ntasks; i++) {
+			func(arg, i);
+		}
+
+		return 0;
+	}
+
+	if(workpool_start(&wp, nthreads, ntasks, func, arg) == -1) {
+		return -1;
+	}
+
+	workpool_join(&wp);
+	return 0;
+}
+
+void workpool_join(struct workpool *wp)
+{
+	size_t i;
+
+	for(i = 0; i < wp->nthreads; i++) {
+		(void) pthread_join(wp->threads[i], NULL);
+	}
+
+	(void) pthread_cond_destroy(&wp->finished);
+	(void) pthread_mutex_destroy(&wp->lock);
+
+	free(wp->threads);
+	free(wp->done);
+
+	wp->threads = NULL;
+	wp->done = NULL;
+	wp->nthreads = 0;
+}
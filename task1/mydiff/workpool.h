@@ -0,0 +1,76 @@
+/**
+* @file workpool.h
+* @brief header file for a simple pool of worker threads that work off a numbered list of tasks
+*/
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+#include <stddef.h> //needed for size_t
+#include <pthread.h>
+
+/**
+* @brief type definition of a task callback.
+*
+* @param arg generic argument given to workpool_start
+* @param task number of the task to work on (0 .. ntasks - 1)
+*/
+typedef void (*workpool_func_t)(void *arg, size_t task);
+
+/**
+* @brief a pool of threads. Tasks are handed out in ascending order, so they also tend to finish in that order
+*/
+struct workpool {
+
+	pthread_t *threads; /**< the worker threads */
+	size_t nthreads; /**< number of started worker threads */
+	pthread_mutex_t lock; /**< protects next and done */
+	pthread_cond_t finished; /**< signaled whenever a task has been finished */
+	size_t ntasks; /**< number of tasks */
+	size_t next; /**< next task to be handed out */
+	unsigned char *done; /**< done[i] is nonzero once task i has been finished */
+	workpool_func_t func; /**< callback that works on a task */
+	void *arg; /**< generic argument for func */
+
+};
+
+/**
+* @brief start nthreads threads that call func(arg, i) for every i in 0 .. ntasks - 1
+*
+* @param wp pool to initialize
+* @param nthreads number of threads to start (at most ntasks are started)
+* @param ntasks number of tasks
+* @param func callback working on a single task
+* @param arg generic argument for func
+*
+* @return 0 on success, -1 if memory or threads could not be allocated (no threads are left running then)
+*/
+int workpool_start(struct workpool *wp, size_t nthreads, size_t ntasks, workpool_func_t func, void *arg);
+
+/**
+* @brief block until the given task has been finished
+*
+* @param wp pool working on the task
+* @param task number of the task to wait for
+*/
+void workpool_wait(struct workpool *wp, size_t task);
+
+/**
+* @brief run all tasks and wait for them to finish. With a single thread the tasks are run right in the calling thread
+*
+* @param nthreads number of threads to use
+* @param ntasks number of tasks
+* @param func callback working on a single task
+* @param arg generic argument for func
+*
+* @return 0 on success, -1 if threads could not be started (no task has been run then)
+*/
+int workpool_run(size_t nthreads, size_t ntasks, workpool_func_t func, void *arg);
+
+/**
+* @brief wait for all tasks to finish and release the pool's resources
+*
+* @param wp pool to shut down
+*/
+void workpool_join(struct workpool *wp);
+
+#endif
@@ -4,12 +4,44 @@
 * @author Georg Hubinger 9947673 <georg.hubinger@tuwien.ac.at>
 * @date 2013-11-17
 */
+/* clone() is a linux extension */
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <spawn.h>
 #include <sys/wait.h>
 #include "fork_function.h"
 
+/**
+* @brief size of the stack the clone()d child runs on until it execs
+*/
+#define SPAWN_STACK_SIZE (64 * 1024)
+
+/**
+* @brief the stack pointer clone() takes: the top of the stack where stacks grow down, the bottom where they grow up (hppa)
+*/
+#if defined(__hppa__)
+#define SPAWN_STACK_POINTER(stack) (stack)
+#else
+#define SPAWN_STACK_POINTER(stack) ((stack) + SPAWN_STACK_SIZE)
+#endif
+
+/**
+* @brief what the clone()d child needs to exec the command
+*/
+struct spawn_params {
+
+	const char *cmd; /**< command for the shell */
+	int *pipe; /**< pipe to put stdout on */
+
+};
+
+extern char **environ;
+
 /* fork callback (with param as arg) and, if in child process exit with the returned value or if in parent return pit of child*/
 pid_t fork_function(fork_func_callback_t callback, fork_func_param_t param)
 {
@@ -30,6 +62,82 @@ pid_t fork_function(fork_func_callback_t callback, fork_func_param_t param)
 
 }
 
+/* the clone()d child shares our memory until execl: nothing but plain system calls here, and _exit instead of exit */
+static int spawn_child(void *arg)
+{
+	struct spawn_params *params = arg;
+
+	if(params->pipe[0] != -1) {
+		(void) close(params->pipe[0]);
+	}
+
+	if(dup2(params->pipe[1], STDOUT_FILENO) == -1) {
+		_exit(1);
+	}
+
+	if(params->pipe[1] != STDOUT_FILENO) {
+		(void) close(params->pipe[1]);
+	}
+
+	(void) execl("/bin/sh", "sh", "-c", params->cmd, (char *) NULL);
+	_exit(1);
+}
+
+/* posix_spawn with file actions in place of redirect(), or clone() sharing our memory so no page tables get copied */
+pid_t spawn_command(spawn_backend_t backend, const char *cmd, pipe_t p, int *status)
+{
+	pid_t child = -1;
+
+	if(backend == spawn_posix) {
+
+		posix_spawn_file_actions_t actions;
+		char *const argv[] = { "sh", "-c", (char *) cmd, NULL };
+		int err;
+
+		if((err = posix_spawn_file_actions_init(&actions)) != 0) {
+			errno = err;
+			return -1;
+		}
+
+		if((p[0] == -1 || (err = posix_spawn_file_actions_addclose(&actions, p[0])) == 0)
+			&& (err = posix_spawn_file_actions_adddup2(&actions, p[1], STDOUT_FILENO)) == 0
+			&& (p[1] == STDOUT_FILENO || (err = posix_spawn_file_actions_addclose(&actions, p[1])) == 0)) {
+			err = posix_spawn(&child, "/bin/sh", &actions, NULL, argv, environ);
+		}
+
+		(void) posix_spawn_file_actions_destroy(&actions);
+
+		/* out of processes or memory there is no child. Anything else is the error of an exec (E2BIG, ENOENT, ...), glibc has reaped that child already */
+		if(err == EAGAIN || err == ENOMEM) {
+			errno = err;
+			return -1;
+		}
+
+		if(err != 0) {
+			*status = SPAWN_EXEC_FAILED;
+			return 0;
+		}
+
+	} else if(backend == spawn_vfork) {
+
+		struct spawn_params params;
+		char *stack;
+
+		if((stack = malloc(SPAWN_STACK_SIZE)) == NULL) {
+			return -1;
+		}
+
+		params.cmd = cmd;
+		params.pipe = p;
+
+		/* we are suspended until the child has exec'd (or exited), then its stack is ours again */
+		child = clone(spawn_child, SPAWN_STACK_POINTER(stack), CLONE_VM | CLONE_VFORK | SIGCHLD, &params);
+		free(stack);
+	}
+
+	return child;
+}
+
 /* wrapper aroung waitpit, that returns the WEXITSTATUS */
 int wait_for_child(pid_t child)
 {
@@ -24,6 +24,15 @@ typedef enum pipe_channel {
 */
 typedef int pipe_t[2];
 
+/**
+* @brief enumeration of the ways spawn_command starts a process that execs right away
+*/
+typedef enum spawn_backend {
+	spawn_fork = 0, /**< a full fork() of the caller, left to fork_function */
+	spawn_posix, /**< posix_spawn(), the pipe is installed by file actions */
+	spawn_vfork /**< clone(CLONE_VM | CLONE_VFORK): the child runs in our memory until it execs, while we are suspended */
+} spawn_backend_t;
+
 /**
 * @brief void * Pointer that holds the generic param for the fork callback
 */
@@ -48,6 +57,24 @@ typedef unsigned int (*fork_func_callback_t)(fork_func_param_t param);
 */
 pid_t fork_function(fork_func_callback_t fork_func, fork_func_param_t param);
 
+/**
+* @brief exit code reported for a command whose shell could not be exec'd by spawn_command (as sh reports a command it can't run)
+*/
+#define SPAWN_EXEC_FAILED 127
+
+/**
+* @brief start "/bin/sh -c cmd" with stdout on the write end of a pipe, without copying the caller's memory
+*
+* @param backend spawn_posix or spawn_vfork
+* @param cmd command for the shell
+* @param p pipe. The child closes the read end (unless it's -1), our ends stay open
+* @param status receives SPAWN_EXEC_FAILED if 0 is returned
+*
+* @return pid_t of the shell, 0 if the child could not exec the shell (it has been waited for already, that's a failure of the command),
+* -1 if no child could be started (errno is set)
+*/
+pid_t spawn_command(spawn_backend_t backend, const char *cmd, pipe_t p, int *status);
+
 /**
 * @brief wrapper around waitpid
 *
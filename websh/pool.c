@@ -0,0 +1,273 @@
+/**
+* @file pool.c
+* @brief worker pool library: workers are forked once and then receive jobs (a string and a file descriptor) over a unix socket
+*/
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "fork_function.h"
+#include "pool.h"
+
+/* === Structures === */
+
+/**
+* @brief what is sent in front of every job, the job's fd comes along with it
+*/
+struct job_header {
+
+	size_t len; /**< length of the string following the header */
+
+};
+
+/**
+* @brief params for the worker loop
+*/
+struct loop_params {
+
+	struct pool *pool; /**< the pool the worker belongs to */
+	unsigned int index; /**< index of the worker in the pool */
+	int sock; /**< worker's end of the control socket */
+	pool_func_callback_t callback; /**< callback to run per job */
+
+};
+
+/* === Implementation === */
+
+/* read exactly n bytes. Returns 0 on success, -1 on error or if the other end is closed before */
+static int read_full(int fd, void *buf, size_t n)
+{
+	char *p = buf;
+
+	while(n > 0) {
+
+		ssize_t r = read(fd, p, n);
+
+		if(r == -1 && errno == EINTR) {
+			continue;
+		}
+		if(r <= 0) {
+			return -1;
+		}
+
+		p += r;
+		n -= (size_t) r;
+	}
+
+	return 0;
+}
+
+/* write exactly n bytes. Returns 0 on success, -1 else */
+static int write_full(int fd, const void *buf, size_t n)
+{
+	const char *p = buf;
+
+	while(n > 0) {
+
+		ssize_t w = write(fd, p, n);
+
+		if(w == -1 && errno == EINTR) {
+			continue;
+		}
+		if(w == -1) {
+			return -1;
+		}
+
+		p += w;
+		n -= (size_t) w;
+	}
+
+	return 0;
+}
+
+/* receive a job header and the fd attached to it. Returns 0 on success, -1 on error or if the socket has been closed */
+static int recv_header(int sock, struct job_header *h, int *fd)
+{
+	char control[CMSG_SPACE(sizeof(int))];
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	ssize_t r;
+
+	iov.iov_base = h;
+	iov.iov_len = sizeof(*h);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	while((r = recvmsg(sock, &msg, 0)) == -1 && errno == EINTR);
+
+	if(r <= 0) {
+		return -1;
+	}
+
+	*fd = -1;
+	for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+			memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+		}
+	}
+
+	/* the fd comes with the first byte, the rest of the header may follow on its own */
+	if(*fd == -1 || read_full(sock, (char *) h + r, sizeof(*h) - (size_t) r) == -1) {
+		if(*fd != -1) {
+			(void) close(*fd);
+		}
+		return -1;
+	}
+
+	return 0;
+}
+
+/* the worker: run the callback for every job, until the pool closes the control socket */
+static unsigned int worker_loop(fork_func_param_t param)
+{
+	/* Cast argument */
+	struct loop_params *params = (struct loop_params *) param;
+	struct job_header h;
+	unsigned int i;
+	int fd;
+
+	/* we don't need the other ends, neither those of the workers started before us (they would never see their socket closed) */
+	for(i = 0; i <= params->index; i++) {
+		(void) close(params->pool->workers[i].sock);
+	}
+
+	while(recv_header(params->sock, &h, &fd) == 0) {
+
+		char *arg;
+		int status;
+
+		if((arg = malloc(h.len + 1)) == NULL || read_full(params->sock, arg, h.len) == -1) {
+			(void) close(fd);
+			free(arg);
+			return 1;
+		}
+		arg[h.len] = '\0';
+
+		status = (int) params->callback(fd, arg);
+		free(arg);
+
+		if(write_full(params->sock, &status, sizeof(status)) == -1) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int pool_start(struct pool *pool, unsigned int n, pool_func_callback_t callback)
+{
+	unsigned int i;
+
+	if((pool->workers = malloc(n * sizeof(*pool->workers))) == NULL) {
+		return -1;
+	}
+
+	for(pool->n = 0; pool->n < n; pool->n++) {
+
+		struct pool_worker *w = &pool->workers[pool->n];
+		struct loop_params params;
+		int sv[2];
+
+		if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+			pool_stop(pool);
+			return -1;
+		}
+
+		/* commands started by the workers must not hold the sockets */
+		for(i = 0; i < 2; i++) {
+			(void) fcntl(sv[i], F_SETFD, FD_CLOEXEC);
+		}
+
+		w->sock = sv[0];
+		params.pool = pool;
+		params.index = pool->n;
+		params.sock = sv[1];
+		params.callback = callback;
+
+		w->pid = fork_function(worker_loop, &params);
+		(void) close(sv[1]);
+
+		if(w->pid == -1) {
+			(void) close(sv[0]);
+			pool_stop(pool);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int pool_submit(struct pool_worker *w, int fd, const char *arg)
+{
+	char control[CMSG_SPACE(sizeof(int))];
+	struct job_header h;
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	ssize_t r;
+
+	h.len = strlen(arg);
+	iov.iov_base = &h;
+	iov.iov_len = sizeof(h);
+
+	memset(&msg, 0, sizeof(msg));
+	memset(control, 0, sizeof(control));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	/* attach fd to the header */
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+	while((r = sendmsg(w->sock, &msg, 0)) == -1 && errno == EINTR);
+
+	if(r <= 0 || write_full(w->sock, (const char *) &h + r, sizeof(h) - (size_t) r) == -1) {
+		return -1;
+	}
+
+	return write_full(w->sock, arg, h.len);
+}
+
+int pool_wait(struct pool_worker *w)
+{
+	int status;
+
+	if(read_full(w->sock, &status, sizeof(status)) == -1) {
+		return -1;
+	}
+
+	return status;
+}
+
+void pool_stop(struct pool *pool)
+{
+	unsigned int i;
+
+	/* closing the sockets first lets all workers quit at the same time */
+	for(i = 0; i < pool->n; i++) {
+		(void) close(pool->workers[i].sock);
+	}
+
+	for(i = 0; i < pool->n; i++) {
+		(void) wait_for_child(pool->workers[i].pid);
+	}
+
+	free(pool->workers);
+	pool->workers = NULL;
+	pool->n = 0;
+}
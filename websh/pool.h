@@ -0,0 +1,80 @@
+/**
+* @file pool.h
+* @brief header file for the worker pool library: long-lived processes that run a callback per job, jobs are handed over a control socket
+*/
+
+
+#ifndef POOL_H
+#define POOL_H
+#include <sys/types.h> //needed for pid_t
+
+/**
+* @brief type defination of a job callback, run by a pool worker for every job it receives
+*
+* @param fd file descriptor sent along with the job. The callback owns it and has to close it
+* @param arg string sent along with the job
+*
+* @return status reported back to the submitter of the job
+*/
+typedef unsigned int (*pool_func_callback_t)(int fd, const char *arg);
+
+/**
+* @brief a worker process of a pool, as seen by the process that started it
+*/
+struct pool_worker {
+
+	pid_t pid; /**< pid of the worker, -1 if not running */
+	int sock; /**< our end of the worker's control socket */
+
+};
+
+/**
+* @brief a pool of workers running the same callback
+*/
+struct pool {
+
+	struct pool_worker *workers; /**< the workers */
+	unsigned int n; /**< number of workers */
+
+};
+
+/**
+* @brief fork n workers that run callback for each job they receive, until their control socket is closed.
+* Streams should be flushed before, the workers inherit their buffers
+*
+* @param pool pool to start
+* @param n number of workers
+* @param callback callback to run per job
+*
+* @return 0 on success, -1 else (workers started so far are stopped again)
+*/
+int pool_start(struct pool *pool, unsigned int n, pool_func_callback_t callback);
+
+/**
+* @brief hand a job to a worker: fd is passed on with the job (we keep our copy), arg is copied
+*
+* @param w worker to run the job
+* @param fd file descriptor for the job
+* @param arg string for the job
+*
+* @return 0 on success, -1 else
+*/
+int pool_submit(struct pool_worker *w, int fd, const char *arg);
+
+/**
+* @brief wait for the worker to finish its job
+*
+* @param w worker running a job
+*
+* @return status returned by the callback, or -1 if the worker is gone
+*/
+int pool_wait(struct pool_worker *w);
+
+/**
+* @brief close the control sockets of all workers and wait for them to exit
+*
+* @param pool pool to stop
+*/
+void pool_stop(struct pool *pool);
+
+#endif
@@ -0,0 +1,174 @@
+/**
+* @file splitter.c
+* @brief splitter library: lines of any length from large reads, found with memchr (which scans many chars at once),
+* and output written as slices with writev
+*/
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include "splitter.h"
+
+int split_init(struct splitter *s, int fd)
+{
+	s->fd = fd;
+	s->size = SPLIT_BUFFER_SIZE;
+	s->start = s->scan = s->end = 0;
+	s->eof = 0;
+
+	if((s->buf = malloc(s->size)) == NULL) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int split_line(struct splitter *s, char **line, size_t *len)
+{
+	char *nl = memchr(s->buf + s->scan, '\n', s->end - s->scan);
+
+	if(nl == NULL) {
+
+		/* everything read so far has been searched */
+		s->scan = s->end;
+
+		/* the last line may lack its '\n', split_fill left room for the '\0' */
+		if(!s->eof || s->start == s->end) {
+			return 0;
+		}
+
+		nl = s->buf + s->end;
+	}
+
+	*line = s->buf + s->start;
+	*len = (size_t) (nl - *line);
+	*nl = '\0';
+
+	s->start = s->scan = nl < s->buf + s->end ? (size_t) (nl - s->buf) + 1 : s->end;
+
+	return 1;
+}
+
+int split_fill(struct splitter *s)
+{
+	ssize_t r;
+
+	if(s->start == s->end) {
+		/* nothing left over, start at the front again */
+		s->start = s->scan = s->end = 0;
+	} else if(s->start > 0) {
+		/* move the incomplete line to the front. It stays there until it's complete, so it's moved only once */
+		(void) memmove(s->buf, s->buf + s->start, s->end - s->start);
+		s->end -= s->start;
+		s->scan -= s->start;
+		s->start = 0;
+	}
+
+	/* a line that doesn't fit gets twice the room, one char is kept free for the '\0' of a last line without '\n' */
+	if(s->size - s->end < 2) {
+
+		char *buf;
+
+		if((buf = realloc(s->buf, 2 * s->size)) == NULL) {
+			return -1;
+		}
+
+		s->buf = buf;
+		s->size *= 2;
+	}
+
+	while((r = read(s->fd, s->buf + s->end, s->size - s->end - 1)) == -1 && errno == EINTR);
+
+	if(r == -1) {
+		return -1;
+	}
+
+	if(r == 0) {
+		s->eof = 1;
+		return 0;
+	}
+
+	s->end += (size_t) r;
+	return 1;
+}
+
+void split_free(struct splitter *s)
+{
+	free(s->buf);
+	s->buf = NULL;
+}
+
+void slices_init(struct slices *o, int fd, FILE *arena)
+{
+	o->fd = fd;
+	o->arena = arena;
+	o->n = 0;
+	o->error = 0;
+}
+
+int slices_add(struct slices *o, const char *p, size_t len)
+{
+	if(o->n == SLICES_MAX && slices_flush(o) == -1) {
+		return -1;
+	}
+
+	o->iov[o->n].iov_base = (void *) p;
+	o->iov[o->n].iov_len = len;
+	o->n++;
+
+	return 0;
+}
+
+int slices_flush(struct slices *o)
+{
+	struct iovec *iov = o->iov;
+	int n = o->n, i;
+
+	o->n = 0;
+
+	/* the output has a gap, nothing after it is any good. The error sticks, for callers that only check the last flush */
+	if(o->error) {
+		return -1;
+	}
+
+	if(o->arena != NULL) {
+
+		for(i = 0; i < n; i++) {
+			if(fwrite(iov[i].iov_base, 1, iov[i].iov_len, o->arena) != iov[i].iov_len) {
+				o->error = 1;
+				return -1;
+			}
+		}
+
+		return 0;
+	}
+
+	while(n > 0) {
+
+		ssize_t w = writev(o->fd, iov, n);
+
+		if(w == -1 && errno == EINTR) {
+			continue;
+		}
+		if(w == -1) {
+			o->error = 1;
+			return -1;
+		}
+
+		/* skip what has been written, a slice may have been written in part */
+		while(n > 0 && (size_t) w >= iov->iov_len) {
+			w -= (ssize_t) iov->iov_len;
+			iov++;
+			n--;
+		}
+
+		if(n > 0) {
+			iov->iov_base = (char *) iov->iov_base + w;
+			iov->iov_len -= (size_t) w;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,117 @@
+/**
+* @file splitter.h
+* @brief header file for the splitter library: split what is read from a file descriptor into lines of any length,
+* and write output as slices of memory with writev
+*/
+
+
+#ifndef SPLITTER_H
+#define SPLITTER_H
+#include <stdio.h> //needed for FILE
+#include <sys/uio.h> //needed for struct iovec
+
+/**
+* @brief Size of the first read buffer of a splitter, it doubles whenever a line doesn't fit
+*/
+#define SPLIT_BUFFER_SIZE 65536
+
+/**
+* @brief Maximum number of slices collected before they are written
+*/
+#define SLICES_MAX 256
+
+/**
+* @brief lines read from a file descriptor. Each byte is searched for '\n' only once, and moved at most once before its line is complete
+*/
+struct splitter {
+
+	int fd; /**< file descriptor read from */
+	char *buf; /**< read buffer */
+	size_t size; /**< size of buf */
+	size_t start; /**< start of the first line not returned yet */
+	size_t scan; /**< where the search for its end goes on */
+	size_t end; /**< end of the chars read */
+	int eof; /**< true once fd has reached EOF */
+
+};
+
+/**
+* @brief slices of memory to be written to a file descriptor with writev, or to be copied to a stream
+*/
+struct slices {
+
+	int fd; /**< file descriptor to write to */
+	FILE *arena; /**< stream to write to instead, NULL to write to fd */
+	struct iovec iov[SLICES_MAX]; /**< the slices */
+	int n; /**< number of slices */
+	int error; /**< true once a write has failed, the slices queued with it are lost */
+
+};
+
+/**
+* @brief prepare a splitter
+*
+* @param s splitter to work on
+* @param fd file descriptor to read from
+*
+* @return 0 on success, -1 if the buffer could not be allocated
+*/
+int split_init(struct splitter *s, int fd);
+
+/**
+* @brief get the next complete line from what has been read. At EOF a last line without '\n' counts as complete
+*
+* @param s splitter to work on
+* @param line receives the line. Its '\n' is replaced by '\0', it stays valid until the next split_fill
+* @param len receives the length of the line, without the '\n'
+*
+* @return 1 if there is a line, 0 if more has to be read (or s->eof is set and all lines have been returned)
+*/
+int split_line(struct splitter *s, char **line, size_t *len);
+
+/**
+* @brief read more chars. Lines returned by split_line before are gone then
+*
+* @param s splitter to work on
+*
+* @return 1 if chars have been read, 0 at EOF (s->eof is set), -1 on error (errno is EAGAIN if fd is non-blocking and has nothing to read)
+*/
+int split_fill(struct splitter *s);
+
+/**
+* @brief release the buffer of a splitter
+*
+* @param s splitter to work on
+*/
+void split_free(struct splitter *s);
+
+/**
+* @brief prepare empty slices
+*
+* @param o slices to work on
+* @param fd file descriptor to write to
+* @param arena stream to write to instead, NULL to write to fd
+*/
+void slices_init(struct slices *o, int fd, FILE *arena);
+
+/**
+* @brief add a slice. The memory is not copied, it has to stay valid until the slices are written
+*
+* @param o slices to work on
+* @param p first char of the slice
+* @param len number of chars in the slice
+*
+* @return 0 on success, -1 if the slices had to be written and that failed (slices_flush reports it again)
+*/
+int slices_add(struct slices *o, const char *p, size_t len);
+
+/**
+* @brief write all slices
+*
+* @param o slices to work on
+*
+* @return 0 on success, -1 if this or any write since slices_init failed
+*/
+int slices_flush(struct slices *o);
+
+#endif
@@ -1,6 +1,11 @@
 /**
 * @file websh.c
-* @brief read commands from stdin, spawn two worker processes: one to execute the command, one to format it's output in html
+* @brief read commands from stdin, spawn two worker processes: one to execute the command, one to format it's output in html.
+* With -p the workers are forked once at the start (a pool of an exec launcher and a formatter, see pool.h) and get every command over a socket.
+* With -x spawn or -x vfork the command's shell is started by posix_spawn or clone(CLONE_VM | CLONE_VFORK) instead of a fork of websh.
+* With -i there is no format worker: websh reads the command's pipe itself, non-blocking in an epoll loop, and formats the output in-process.
+* With -j N up to N commands run at once (formatted in-process), each one's output is kept in memory until the ones before it are printed.
+* Commands and output lines may be of any length: they are split from large reads (see splitter.h), the formatted output is written as slices with writev
 * @author Georg Hubinger 9947673 <georg.hubinger@tuwien.ac.at>
 * @date 2013-11-17
 */
@@ -8,15 +13,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
 #include "fork_function.h"
+#include "pool.h"
+#include "splitter.h"
 
 /* === Constants === */
 
 /**
-* @brief Maximum Length of a command, or of a command's output line that's being formatted
+* @brief Maximum number of commands running at once (-j)
 */
-#define MAX_LINE_LENGTH 255
+#define MAX_JOBS 1024
+
+/**
+* @brief Maximum number of pipes handled per epoll_wait
+*/
+#define MAX_EVENTS 64
 
 /* === Global Variables === */
 
@@ -27,9 +43,17 @@ static struct {
 
 	int opt_e; /**< true if called with -e  */
 	int opt_h; /**< true if called with -h  */
+	int opt_i; /**< true if called with -i (or -j with more than one job) */
+	int opt_j; /**< true if called with -j  */
+	unsigned int jobs; /**< number of commands running at once (-j), 1 by default */
+	int opt_p; /**< true if called with -p  */
 	int opt_s; /**< true if called with -s  */
+	int opt_x; /**< true if called with -x  */
+	spawn_backend_t backend; /**< how the execute worker is started (-x), spawn_fork by default */
 	char *s_word; /**< if called with -s search for output lines containing s_word ... */
 	char *s_tag; /**< and wrap the line withing s_tag  */
+	size_t s_word_len; /**< length of s_word */
+	size_t s_tag_len; /**< length of s_tag */
 
 } opts;
 
@@ -46,10 +70,51 @@ char *pgname = "websh";
 struct worker_params {
 
 	pipe_t pipe; /**< pipe to handle communication between processes */
-	char *cmd /**< command to execute */;
+	const char *cmd /**< command to execute */;
 
 };
 
+/**
+* @brief a command whose output is formatted in-process (-i, -j)
+*/
+struct job {
+
+	char *cmd; /**< the command (a copy) */
+	unsigned int slot; /**< index of the job among the ones running at once, with -p also of its exec launcher */
+	int fd; /**< read end of the command's pipe, -1 once closed */
+	pid_t pid; /**< pid of the execute worker (not with -p) */
+	struct splitter in; /**< the command's output, split into lines */
+	struct slices out; /**< formatted output: to stdout if only one job runs at once, else to a stream on the job's arena */
+	char *arena; /**< memory the output is kept in until the jobs before have been printed */
+	size_t size; /**< number of chars in arena */
+	int status; /**< exit code of the execute worker, -1 if it could not be waited for */
+	int done; /**< true once the command's output has ended */
+	int failed; /**< true if the command's output could not be read */
+
+};
+
+/* === Global Variables === */
+
+/**
+* @brief with -p: the long-lived exec launcher, which forks and execs every command with stdout on the pipe it is sent
+*/
+static struct pool launchers;
+
+/**
+* @brief with -p: the long-lived format worker, which formats what it reads from the pipe it is sent
+*/
+static struct pool formatters;
+
+/**
+* @brief with -i: the epoll instance the commands' pipes are watched with
+*/
+static int epfd = -1;
+
+/**
+* @brief the commands read from stdin
+*/
+static struct splitter input;
+
 /* === Prototypes === */
 
 /**
@@ -62,11 +127,65 @@ struct worker_params {
 static unsigned int execute(fork_func_param_t param);
 
 /**
-* @brief Remove trailing newline char in string
+* @brief Start the execute worker for given params, with the backend selected by -x
+*
+* @param params worker_params for the worker
+* @param status receives the exit code of the command if 0 is returned
+* @details uses opts global var
 *
-* @param str string to work on
+* @return pid_t of the worker, 0 if the command failed to exec without a worker left to wait for, -1 if it could not be started
 */
-static void trim(char *str);
+static pid_t start_execute(struct worker_params *params, int *status);
+
+/**
+* @brief Search a line for the word given with -s
+*
+* @param line the line
+* @param len length of the line
+* @details uses opts global var
+*
+* @return 1 if line contains the word, 0 otherwise
+*/
+static int contains(const char *line, size_t len);
+
+/**
+* @brief Add the html header of a command (-h)
+*
+* @param out slices to add the header to
+* @param cmd the command, it has to stay valid until out is written
+*/
+static void format_header(struct slices *out, const char *cmd);
+
+/**
+* @brief Format a single line of a command's output as html
+*
+* @param out slices to add the formatted line to
+* @param line the line, without its newline char
+* @param len length of the line
+* @details uses opts global var
+*/
+static void format_line(struct slices *out, const char *line, size_t len);
+
+/**
+* @brief Format all lines of a command's output that have been read completely, and write them
+*
+* @param in splitter on the command's output
+* @param out slices to write the formatted lines with
+*
+* @return 0 on success, -1 if the output could not be written
+*/
+static int format_lines(struct splitter *in, struct slices *out);
+
+/**
+* @brief Format a command's output as html to stdout, line by line
+*
+* @param fd command's output
+* @param cmd the command
+* @details uses opts global var
+*
+* @return 0 on success, -1 if fd could not be read or stdout could not be written
+*/
+static int format_output(int fd, const char *cmd);
 
 /**
 * @brief This is the callback, that handles the formatted output. stdin is redirected from pipe
@@ -74,10 +193,31 @@ static void trim(char *str);
 * @param param  worker_params type argument for the worker
 * @details uses opts global var
 *
-* @return 1 if redirect fails, 0 otherwise
+* @return 1 if redirect fails or the output can't be formatted, 0 otherwise
 */
 static unsigned int format(fork_func_param_t param);
 
+/**
+* @brief This is the job callback of the exec launcher (-p): fork an execute worker for cmd with stdout on fd and wait for it
+*
+* @param fd write end of the command's pipe
+* @param cmd command to execute
+*
+* @return exit code of the execute worker, 1 if it could not be forked
+*/
+static unsigned int launch(int fd, const char *cmd);
+
+/**
+* @brief This is the job callback of the format worker (-p): format what can be read from fd until EOF
+*
+* @param fd read end of the command's pipe
+* @param cmd the command
+* @details uses opts global var
+*
+* @return 1 if fd can't be read or stdout can't be written, 0 otherwise
+*/
+static unsigned int format_job(int fd, const char *cmd);
+
 /**
 * @brief spawn execute and format worker for given command
 *
@@ -88,6 +228,78 @@ static unsigned int format(fork_func_param_t param);
 */
 static int spawn_worker(char *cmd);
 
+/**
+* @brief hand given command to the pooled workers (-p), and wait for both to finish it
+*
+* @param cmd command to be executed.
+* @details uses pgname global var
+*
+* @return -1 if pipe can't be created or one of the workers is gone, 0 otherwise (even if the command returns nonzero)
+*/
+static int spawn_pooled(char *cmd);
+
+/**
+* @brief start the execute worker for given command (or hand it to the job's exec launcher with -p), and watch its pipe
+*
+* @param job job to start, its slot has to be set
+* @param cmd command to be executed.
+* @param buffered true to keep the output in the job's arena, false to print it right away
+* @param retry true if another job is running: if we are out of pipes or processes, the job is dropped without a message
+* @details uses pgname and epfd global vars
+*
+* @return -1 if pipe can't be created, the worker could not be started or the pipe could not be watched,
+* 1 if retry is set and that's only because of a limit (start the command again once a job has finished), 0 otherwise
+*/
+static int job_start(struct job *job, const char *cmd, int buffered, int retry);
+
+/**
+* @brief format what can be read from the job's pipe without blocking
+*
+* @param job running job
+* @details uses pgname global var
+*
+* @return 1 at the end of the command's output, 0 if there is more to come, -1 if the pipe could not be read
+*/
+static int job_read(struct job *job);
+
+/**
+* @brief close the job's pipe once its output has ended, and wait for the execute worker
+*
+* @param job job to finish
+*/
+static void job_finish(struct job *job);
+
+/**
+* @brief print the output of a finished job from its arena, and report its exit code
+*
+* @param job finished job
+* @param discard true to drop the output instead
+* @details uses pgname global var
+*
+* @return -1 if the job's output could not be read, 0 otherwise (even if the command returns nonzero)
+*/
+static int job_emit(struct job *job, int discard);
+
+/**
+* @brief read commands from stdin and run up to n at once, formatting their output in-process (-i, -j). Output is printed in the order of the commands
+*
+* @param n number of commands running at once
+* @details uses pgname and epfd global vars
+*
+* @return -1 if a command could not be started or its output could not be read (the commands before are printed), 0 otherwise
+*/
+static int run_jobs(unsigned int n);
+
+/**
+* @brief read the next command from stdin
+*
+* @param cmd receives the command, without its newline char. It stays valid until the next call
+* @details uses pgname and input global vars
+*
+* @return 1 if there is a command, 0 at the end of stdin, -1 if stdin could not be read
+*/
+static int next_command(char **cmd);
+
 /**
 * @brief Parse command line arguments
 *
@@ -125,11 +337,111 @@ static unsigned int execute(fork_func_param_t param)
 	return 1;
 }
 
-static void trim(char *str)
+static pid_t start_execute(struct worker_params *params, int *status)
+{
+	if(opts.backend == spawn_fork) {
+		return fork_function(execute, params);
+	}
+
+	/* the shell gets exec'd without a copy of us in between, the pipe is installed by the backend instead of redirect() */
+	return spawn_command(opts.backend, params->cmd, params->pipe, status);
+}
+
+static int contains(const char *line, size_t len)
+{
+	const char *p = line, *end = line + len;
+
+	if(opts.s_word_len == 0) {
+		return 1;
+	}
+
+	/* memchr finds the candidates for the first char, many chars at a time */
+	while((size_t) (end - p) >= opts.s_word_len && (p = memchr(p, opts.s_word[0], (size_t) (end - p) - opts.s_word_len + 1)) != NULL) {
+
+		if(memcmp(p, opts.s_word, opts.s_word_len) == 0) {
+			return 1;
+		}
+
+		p++;
+	}
+
+	return 0;
+}
+
+static void format_header(struct slices *out, const char *cmd)
+{
+	(void) slices_add(out, "<h1>", 4);
+	(void) slices_add(out, cmd, strlen(cmd));
+	(void) slices_add(out, "</h1>\n", 6);
+}
+
+static void format_line(struct slices *out, const char *line, size_t len)
+{
+	/* the line is not copied, the tags are added as slices around it */
+	if(opts.opt_s && contains(line, len)) { /* put special lines in special tags */
+		(void) slices_add(out, "<", 1);
+		(void) slices_add(out, opts.s_tag, opts.s_tag_len);
+		(void) slices_add(out, ">", 1);
+		(void) slices_add(out, line, len);
+		(void) slices_add(out, "</", 2);
+		(void) slices_add(out, opts.s_tag, opts.s_tag_len);
+		(void) slices_add(out, "><br />\n", 8);
+	} else { /* standard format */
+		(void) slices_add(out, line, len);
+		(void) slices_add(out, "<br />\n", 7);
+	}
+}
+
+static int format_lines(struct splitter *in, struct slices *out)
+{
+	char *line;
+	size_t len;
+
+	while(split_line(in, &line, &len)) {
+		format_line(out, line, len);
+	}
+
+	/* the lines are gone with the next read */
+	return slices_flush(out);
+}
+
+static int format_output(int fd, const char *cmd)
 {
-	while(str[strlen(str) - 1] == '\n') {
-		str[strlen(str) - 1] = '\0' ;
+	struct splitter in;
+	struct slices out;
+	int ret = 0;
+
+	if(split_init(&in, fd) == -1) {
+		return -1;
+	}
+
+	slices_init(&out, STDOUT_FILENO, NULL);
+
+	/* Print out issued command if -h*/
+	if(opts.opt_h) {
+		format_header(&out, cmd);
+	}
+
+	/* Read cmd's output, and format it line by line */
+	for(;;) {
+
+		if(format_lines(&in, &out) == -1) {
+			ret = -1;
+			break;
+		}
+
+		if(in.eof) {
+			break;
+		}
+
+		if(split_fill(&in) == -1) {
+			ret = -1;
+			break;
+		}
 	}
+
+	split_free(&in);
+	return ret;
 }
 
 static unsigned int format(fork_func_param_t param) 
@@ -137,8 +449,6 @@ static unsigned int format(fork_func_param_t param)
 	
 	/* Cast argument */
 	struct worker_params *params = (struct worker_params *) param;
-	/* To read the commands output in, line by line */
-	char output[MAX_LINE_LENGTH];
 
 	/* close write end of pipe */
 	close_pipe(params->pipe, channel_write);
@@ -147,26 +457,43 @@ static unsigned int format(fork_func_param_t param)
 		return 1;
 	}
 
-	/* Print out issued command if -h*/
-	if(opts.opt_h) {
-		(void) fprintf(stdout, "<h1>%s</h1>\n", params->cmd);
-	}
+	return format_output(STDIN_FILENO, params->cmd) == -1 ? 1 : 0;
+}
+
+static unsigned int launch(int fd, const char *cmd)
+{
+	struct worker_params params;
+	pid_t child;
+	int status;
 
-	/* Read cmd's output line by line */
-	while(fgets(output, MAX_LINE_LENGTH, stdin) != NULL) {
+	/* the read end went to the format worker, execute has nothing to close there */
+	params.pipe[0] = -1;
+	params.pipe[1] = fd;
+	params.cmd = cmd;
 
-		trim(output);
+	/* the launcher is small, forking it is cheap */
+	child = start_execute(&params, &status);
+	(void) close(fd);
 
-		/* put special lines in special tags */
-		if(opts.opt_s && strstr(output, opts.s_word)) {
-			(void) fprintf(stdout, "<%s>%s</%s><br />\n", opts.s_tag, output, opts.s_tag);
-		} else { /* standard format */
-			(void) fprintf(stdout, "%s<br />\n", output);
-		}
+	if(child == -1) {
+		return 1;
+	}
 
+	if(child != 0) {
+		status = wait_for_child(child);
 	}
 
-	return 0;
+	return status == -1 ? 1 : (unsigned int) status;
+}
+
+static unsigned int format_job(int fd, const char *cmd)
+{
+	/* the output is written before we report back, the next command's output can't overtake it */
+	int ret = format_output(fd, cmd);
+
+	(void) close(fd);
+
+	return ret == -1 ? 1 : 0;
 }
 
 static int spawn_worker(char *cmd) 
@@ -177,7 +504,6 @@ static int spawn_worker(char *cmd)
 	pid_t c1, c2;
 	int status, ret = 0;
 
-	trim(cmd);
 	params.cmd = cmd;
 
 	if(open_pipe(params.pipe) == -1) {
@@ -191,7 +517,7 @@ static int spawn_worker(char *cmd)
 	fflush(stderr);
 
 	/* Fork execute worker */
-	if((c1 = fork_function(execute, &params)) == -1) {
+	if((c1 = start_execute(&params, &status)) == -1) {
 		(void) fprintf(stderr, "%s: Could not spawn execute worker\n", pgname);
 		close_pipe(params.pipe, channel_all);
 		return -1;
@@ -201,7 +527,7 @@ static int spawn_worker(char *cmd)
 	if((c2 = fork_function(format, &params)) == -1) {
 		(void) fprintf(stderr, "%s: Could not spawn format worker\n", pgname);
 		/* Wait for child 1 */
-		if(wait_for_child(c1) == -1) {
+		if(c1 != 0 && wait_for_child(c1) == -1) {
 			(void) fprintf(stderr, "%s: Error waiting for execute worker to finish\n", pgname);
 		}
 		close_pipe(params.pipe, channel_all);
@@ -211,7 +537,11 @@ static int spawn_worker(char *cmd)
 	/* We need to close the pipe in parent, so that the format worker will quit working when execute's output has finished */
 	close_pipe(params.pipe, channel_all);
 	
-	if((status = wait_for_child(c1)) != 0) {
+	if(c1 != 0) {
+		status = wait_for_child(c1);
+	}
+
+	if(status != 0) {
 		(void) fprintf(stderr, "%s: Execute worker returned %d\n", pgname, status);
 		/* not neccessarily an error. If there was a typo in cmd don't quit the whole programm */
 	//	ret = -1;
@@ -225,15 +555,354 @@ static int spawn_worker(char *cmd)
 	return ret;
 }
 
+static int spawn_pooled(char *cmd)
+{
+	pipe_t p;
+	int status, ret = 0;
+
+	if(open_pipe(p) == -1) {
+		(void) fprintf(stderr, "%s: Could not create pipe\n", pgname);
+		return -1;
+	}
+
+	/* The workers get their own copies of the ends, ours have to be closed for the format worker to see EOF */
+	if(pool_submit(&launchers.workers[0], p[1], cmd) == -1) {
+		(void) fprintf(stderr, "%s: Could not hand command to exec launcher\n", pgname);
+		close_pipe(p, channel_all);
+		return -1;
+	}
+
+	close_pipe(p, channel_write);
+
+	if(pool_submit(&formatters.workers[0], p[0], cmd) == -1) {
+		(void) fprintf(stderr, "%s: Could not hand command to format worker\n", pgname);
+		close_pipe(p, channel_read);
+		/* the command runs into a closed pipe, which ends it */
+		(void) pool_wait(&launchers.workers[0]);
+		return -1;
+	}
+
+	close_pipe(p, channel_read);
+
+	if((status = pool_wait(&launchers.workers[0])) == -1) {
+		(void) fprintf(stderr, "%s: Exec launcher is gone\n", pgname);
+		ret = -1;
+	} else if(status != 0) {
+		(void) fprintf(stderr, "%s: Execute worker returned %d\n", pgname, status);
+	}
+
+	if((status = pool_wait(&formatters.workers[0])) == -1) {
+		(void) fprintf(stderr, "%s: Format worker is gone\n", pgname);
+		ret = -1;
+	} else if(status != 0) {
+		(void) fprintf(stderr, "%s: Format worker returned %d\n", pgname, status);
+	}
+
+	return ret;
+}
+
+static int job_start(struct job *job, const char *cmd, int buffered, int retry)
+{
+	struct worker_params params;
+	struct epoll_event ev;
+
+	job->fd = -1;
+	job->in.buf = NULL;
+	job->arena = NULL;
+	job->size = 0;
+	job->status = 0;
+	job->done = 0;
+	job->failed = 0;
+	slices_init(&job->out, STDOUT_FILENO, NULL);
+
+	if((job->cmd = strdup(cmd)) == NULL || split_init(&job->in, -1) == -1
+		|| (buffered && (job->out.arena = open_memstream(&job->arena, &job->size)) == NULL)) {
+		(void) fprintf(stderr, "%s: Could not allocate output buffer\n", pgname);
+		(void) job_emit(job, 1);
+		return -1;
+	}
+
+	params.cmd = job->cmd;
+
+	if(open_pipe(params.pipe) == -1) {
+
+		/* too many fds open, the jobs running hold some of them */
+		if(retry && (errno == EMFILE || errno == ENFILE)) {
+			(void) job_emit(job, 1);
+			return 1;
+		}
+
+		(void) fprintf(stderr, "%s: Could not create pipe\n", pgname);
+		(void) job_emit(job, 1);
+		return -1;
+	}
+
+	/* the execute worker must not inherit our buffers */
+	fflush(stdout);
+	fflush(stderr);
+
+	if(opts.opt_p ? pool_submit(&launchers.workers[job->slot], params.pipe[1], job->cmd) == -1 : (job->pid = start_execute(&params, &job->status)) == -1) {
+
+		int err = errno;
+
+		close_pipe(params.pipe, channel_all);
+
+		/* too many processes, the jobs running are some of them */
+		if(retry && !opts.opt_p && err == EAGAIN) {
+			(void) job_emit(job, 1);
+			return 1;
+		}
+
+		(void) fprintf(stderr, "%s: Could not spawn execute worker\n", pgname);
+		(void) job_emit(job, 1);
+		return -1;
+	}
+
+	/* We need to close the write end, so that we see EOF when execute's output has finished */
+	close_pipe(params.pipe, channel_write);
+	job->fd = job->in.fd = params.pipe[0];
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = job;
+
+	/* the commands of the other jobs must not hold the read end: it would stay in the epoll set after we closed it */
+	if(fcntl(job->fd, F_SETFL, O_NONBLOCK) == -1 || fcntl(job->fd, F_SETFD, FD_CLOEXEC) == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, job->fd, &ev) == -1) {
+		(void) fprintf(stderr, "%s: Could not watch pipe\n", pgname);
+		/* the command runs into a closed pipe, which ends it */
+		job->failed = 1;
+		job_finish(job);
+		(void) job_emit(job, 1);
+		return -1;
+	}
+
+	/* Print out issued command if -h*/
+	if(opts.opt_h) {
+		format_header(&job->out, job->cmd);
+	}
+
+	return 0;
+}
+
+static int job_read(struct job *job)
+{
+	for(;;) {
+
+		if(format_lines(&job->in, &job->out) == -1) {
+			(void) fprintf(stderr, "%s: Could not write output\n", pgname);
+			return -1;
+		}
+
+		/* the last line, even without its newline char, has been formatted */
+		if(job->in.eof) {
+			return 1;
+		}
+
+		if(split_fill(&job->in) == -1) {
+
+			if(errno == EAGAIN) {
+				return 0;
+			}
+
+			(void) fprintf(stderr, "%s: Could not read pipe\n", pgname);
+			return -1;
+		}
+	}
+}
+
+static void job_finish(struct job *job)
+{
+	/* an execute worker forked after this job was started may still hold a copy until it execs */
+	(void) epoll_ctl(epfd, EPOLL_CTL_DEL, job->fd, NULL);
+	(void) close(job->fd);
+	job->fd = -1;
+	split_free(&job->in);
+
+	if(opts.opt_p) {
+		job->status = pool_wait(&launchers.workers[job->slot]);
+	} else if(job->pid != 0) {
+		job->status = wait_for_child(job->pid);
+	}
+	job->done = 1;
+}
+
+static int job_emit(struct job *job, int discard)
+{
+	if(job->out.arena != NULL) {
+
+		(void) fclose(job->out.arena);
+		slices_init(&job->out, STDOUT_FILENO, NULL);
+
+		if(!discard && (slices_add(&job->out, job->arena, job->size) == -1 || slices_flush(&job->out) == -1)) {
+			(void) fprintf(stderr, "%s: Could not write output\n", pgname);
+			discard = 1;
+		}
+
+		free(job->arena);
+		job->arena = NULL;
+	}
+
+	free(job->cmd);
+	job->cmd = NULL;
+	split_free(&job->in);
+
+	if(discard) {
+		return -1;
+	}
+
+	if(job->status == -1) {
+		(void) fprintf(stderr, "%s: Error waiting for execute worker to finish\n", pgname);
+		return -1;
+	}
+
+	if(job->status != 0) {
+		(void) fprintf(stderr, "%s: Execute worker returned %d\n", pgname, job->status);
+	}
+
+	return job->failed ? -1 : 0;
+}
+
+static int run_jobs(unsigned int n)
+{
+	struct epoll_event events[MAX_EVENTS];
+	char *cmd = NULL;
+	/* job k runs in slot k % n, which is free again once job k - n has been printed */
+	struct job *jobs;
+	/* jobs from stop on are dropped, as if they had never been started. The ones before are printed */
+	unsigned long next = 0, head = 0, stop = ULONG_MAX;
+	int eof = 0, pending = 0;
+
+	if((jobs = malloc(n * sizeof(*jobs))) == NULL) {
+		(void) fprintf(stderr, "%s: Could not allocate jobs\n", pgname);
+		return -1;
+	}
+
+	for(;;) {
+
+		int i, ready;
+
+		/* print the finished jobs in order. A failed one is printed as far as it got, the rest is dropped */
+		while(head < next && jobs[head % n].done) {
+
+			if(job_emit(&jobs[head % n], head >= stop) == -1 && head < stop) {
+				stop = head + 1;
+			}
+
+			head++;
+		}
+
+		/* start commands while there are free slots */
+		while(!eof && stop == ULONG_MAX && next - head < n) {
+
+			struct job *job = &jobs[next % n];
+			int r;
+
+			/* a command that hit a limit is still in the input buffer, we haven't read on */
+			if(!pending && (r = next_command(&cmd)) != 1) {
+				if(r == -1) {
+					stop = next;
+				}
+				eof = 1;
+				break;
+			}
+
+			pending = 0;
+			job->slot = (unsigned int) (next % n);
+
+			/* the first job not printed yet is running. Once it has finished, its pipe and process are free again */
+			if((r = job_start(job, cmd, n > 1, head < next)) == 1) {
+				pending = 1;
+				break;
+			}
+
+			if(r == -1) {
+				stop = next;
+				break;
+			}
+
+			next++;
+		}
+
+		/* nothing left to run. Else the first job is not done, so there is a pipe to wait for */
+		if(head == next) {
+			break;
+		}
+
+		if((ready = epoll_wait(epfd, events, MAX_EVENTS, -1)) == -1) {
+
+			if(errno == EINTR) {
+				continue;
+			}
+
+			(void) fprintf(stderr, "%s: Could not wait for pipes\n", pgname);
+			stop = head;
+			ready = 0;
+
+			/* the remaining commands run into closed pipes */
+			for(; head < next; head++) {
+				if(!jobs[head % n].done) {
+					job_finish(&jobs[head % n]);
+				}
+				(void) job_emit(&jobs[head % n], 1);
+			}
+		}
+
+		for(i = 0; i < ready; i++) {
+
+			struct job *job = events[i].data.ptr;
+			int r = job_read(job);
+
+			/* nothing after this job is started anymore */
+			if(r == -1) {
+
+				unsigned long seq = head + (job->slot + n - head % n) % n;
+
+				job->failed = 1;
+				if(seq < stop) {
+					stop = seq + 1;
+				}
+			}
+
+			if(r != 0) {
+				job_finish(job);
+			}
+		}
+	}
+
+	free(jobs);
+	return stop != ULONG_MAX ? -1 : 0;
+}
+
+static int next_command(char **cmd)
+{
+	size_t len;
+
+	while(!split_line(&input, cmd, &len)) {
+
+		if(input.eof) {
+			return 0;
+		}
+
+		if(split_fill(&input) == -1) {
+			(void) fprintf(stderr, "%s: Could not read commands\n", pgname);
+			return -1;
+		}
+	}
+
+	return 1;
+}
+
 static int parse_args(int argc, char **argv)
 {
-	char c, *s_arg = NULL;
+	char c, *s_arg = NULL, *end;
+	long jobs;
 
 	if(argc > 0) {
 		pgname = argv[0];
 	}
 
-	while((c = getopt(argc, argv, "ehs:")) != -1) {
+	opts.jobs = 1;
+
+	while((c = getopt(argc, argv, "ehij:ps:x:")) != -1) {
 		switch(c) {
 		
 			case 'e':
@@ -250,6 +919,34 @@ static int parse_args(int argc, char **argv)
 				}
 				opts.opt_h = 1;
 			break;
+			case 'i':
+				if(opts.opt_i == 1) {
+					(void) fprintf(stderr, "option '-i' may only be given once\n");
+					return -1;
+				}
+				opts.opt_i = 1;
+			break;
+			case 'j':
+				if(opts.opt_j == 1) {
+					(void) fprintf(stderr, "option '-j' may only be given once\n");
+					return -1;
+				}
+
+				opts.opt_j = 1;
+				jobs = strtol(optarg, &end, 10);
+				if(*optarg == '\0' || *end != '\0' || jobs < 1 || jobs > MAX_JOBS) {
+					(void) fprintf(stderr, "Argument for -j has to be a number from 1 to %d\n", MAX_JOBS);
+					return -1;
+				}
+				opts.jobs = (unsigned int) jobs;
+			break;
+			case 'p':
+				if(opts.opt_p == 1) {
+					(void) fprintf(stderr, "option '-p' may only be given once\n");
+					return -1;
+				}
+				opts.opt_p = 1;
+			break;
 			case 's':	
 				if(opts.opt_s == 1) {
 					(void) fprintf(stderr, "option '-s' may only be given once\n");
@@ -259,6 +956,24 @@ static int parse_args(int argc, char **argv)
 				opts.opt_s = 1;
 				s_arg = opts.s_word = optarg;
 			break;
+			case 'x':
+				if(opts.opt_x == 1) {
+					(void) fprintf(stderr, "option '-x' may only be given once\n");
+					return -1;
+				}
+
+				opts.opt_x = 1;
+				if(strcmp(optarg, "fork") == 0) {
+					opts.backend = spawn_fork;
+				} else if(strcmp(optarg, "spawn") == 0) {
+					opts.backend = spawn_posix;
+				} else if(strcmp(optarg, "vfork") == 0) {
+					opts.backend = spawn_vfork;
+				} else {
+					(void) fprintf(stderr, "Argument for -x has to be one of 'fork', 'spawn' or 'vfork'\n");
+					return -1;
+				}
+			break;
 			default:
 				return -1;
 			break;
@@ -271,6 +986,11 @@ static int parse_args(int argc, char **argv)
 		return -1;
 	}
 
+	/* commands running at once can't share stdout, their output is formatted in-process */
+	if(opts.jobs > 1) {
+		opts.opt_i = 1;
+	}
+
 	if(opts.opt_s) {
 
 		int colon = 0;
@@ -298,6 +1018,9 @@ static int parse_args(int argc, char **argv)
 			return -1;
 		}
 
+		opts.s_word_len = strlen(opts.s_word);
+		opts.s_tag_len = strlen(opts.s_tag);
+
 	}
 
 	return 0;
@@ -305,7 +1028,7 @@ static int parse_args(int argc, char **argv)
 
 void usage(void) 
 {
-	(void) fprintf(stderr, "Usage: %s [-e] [-h] [-s WORD:TAG]\n", pgname);
+	(void) fprintf(stderr, "Usage: %s [-e] [-h] [-i] [-j N] [-p] [-s WORD:TAG] [-x fork|spawn|vfork]\n", pgname);
 }
 
 /**
@@ -320,7 +1043,8 @@ void usage(void)
 int main(int argc, char **argv)
 {
 
-	char cmd[MAX_LINE_LENGTH];
+	char *cmd;
+	int r = 0, ret = EXIT_SUCCESS;
 	
 	/* chack opts */
 	if(parse_args(argc, argv) == -1) {
@@ -328,19 +1052,79 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
-	/* needs to be done here */
+	if(split_init(&input, STDIN_FILENO) == -1) {
+		(void) fprintf(stderr, "%s: Could not allocate input buffer\n", pgname);
+		return EXIT_FAILURE;
+	}
+
+	/* needs to be done here. The formatted output goes to fd 1 directly, so it must not stay in the buffer */
 	if(opts.opt_e) {
 		(void) fprintf(stdout, "<html><head></head><body>\n");
+		(void) fflush(stdout);
 	}
 
-	/* read commands */
-	while(fgets(cmd, MAX_LINE_LENGTH, stdin) != NULL) {
+	/* the pooled workers are forked once, with nothing left in our buffers */
+	if(opts.opt_p) {
+
+		(void) fflush(stdout);
+		(void) fflush(stderr);
+
+		/* one exec launcher per command running at once */
+		if(pool_start(&launchers, opts.jobs, launch) == -1) {
+			(void) fprintf(stderr, "%s: Could not start exec launcher\n", pgname);
+			split_free(&input);
+			return EXIT_FAILURE;
+		}
 
-		/* and spanw the workers */
-		if(spawn_worker(cmd) == -1) {
+		/* with -i we are the formatter */
+		if(!opts.opt_i && pool_start(&formatters, 1, format_job) == -1) {
+			(void) fprintf(stderr, "%s: Could not start format worker\n", pgname);
+			pool_stop(&launchers);
+			split_free(&input);
 			return EXIT_FAILURE;
 		}
+	}
+
+	if(opts.opt_i && ((epfd = epoll_create(1)) == -1 || fcntl(epfd, F_SETFD, FD_CLOEXEC) == -1)) {
+		(void) fprintf(stderr, "%s: Could not create epoll instance\n", pgname);
+		ret = EXIT_FAILURE;
+	}
+
+	/* read commands, and format their output ourselves */
+	if(ret == EXIT_SUCCESS && opts.opt_i && run_jobs(opts.jobs) == -1) {
+		ret = EXIT_FAILURE;
+	}
+
+	/* read commands */
+	while(ret == EXIT_SUCCESS && !opts.opt_i && (r = next_command(&cmd)) == 1) {
+
+		/* and spanw the workers, or hand the command to the pooled ones */
+		if((opts.opt_p ? spawn_pooled(cmd) : spawn_worker(cmd)) == -1) {
+			ret = EXIT_FAILURE;
+		}
+
+	}
+
+	if(r == -1) {
+		ret = EXIT_FAILURE;
+	}
+
+	if(opts.opt_p) {
+		/* the format worker was forked after the launcher and holds its socket, so it has to go first */
+		if(!opts.opt_i) {
+			pool_stop(&formatters);
+		}
+		pool_stop(&launchers);
+	}
+
+	if(epfd != -1) {
+		(void) close(epfd);
+	}
+
+	split_free(&input);
 
+	if(ret == EXIT_FAILURE) {
+		return ret;
 	}
 
 	if(opts.opt_e) {